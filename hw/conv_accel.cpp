@@ -1,11 +1,96 @@
 #include "conv_accel.h"
 
+// Profiling counters (see hw_profile_t), nothing without PROFILING option
+#ifdef PROFILING
+#define PROFILE_ITERATION(profile) profile.iterations++
+#define PROFILE_STALL(profile, blocked) do { if(blocked) profile.stalls++; } while(0)
+#ifndef __SYNTHESIS__
+unsigned int hw_fifo_max[FIFOS];
+#define PROFILE_FIFO(f, fifo) do { if(fifo.size() > hw_fifo_max[f]) hw_fifo_max[f] = fifo.size(); } while(0)
+#else
+#define PROFILE_FIFO(f, fifo)
+#endif
+#else
+#define PROFILE_ITERATION(profile)
+#define PROFILE_STALL(profile, blocked)
+#define PROFILE_FIFO(f, fifo)
+#endif
+
+#if defined(ENABLE_HARDWARE_ABFT) && !defined(__SYNTHESIS__)
+hw_fault_t hw_faults[HW_FAULTS];
+
+// Injected error on a full-precision output (see hw_fault_t)
+static data_out_t hw_fault(int tile, int m, int r, int c)
+{
+  data_out_t delta = 0;
+  for(int f = 0; f < HW_FAULTS; f++)
+  {
+    const hw_fault_t &fault = hw_faults[f];
+    if((fault.tile == tile) && (fault.m == m) && (fault.r == r) && (fault.c == c))
+      delta += fault.delta;
+  }
+  return delta;
+}
+#endif
+
+// Checksums are compared on their bits from the lowest one reaching an output
+#ifdef REQUANT
+#define HW_ABFT_SHIFT abft_shift
+#else
+#define HW_ABFT_SHIFT (data_in_t::width - 1)
+#endif
+
+#ifdef PROFILING
+// Clear counters at the beginning of a top-level call
+static void hw_profile_reset(hw_profile_t profile[ACTORS])
+{
+#pragma HLS INLINE
+  for(int a = 0; a < ACTORS; a++)
+  {
+#pragma HLS UNROLL
+    profile[a].iterations = 0;
+    profile[a].stalls = 0;
+  }
+#ifndef __SYNTHESIS__
+  for(int f = 0; f < FIFOS; f++)
+    hw_fifo_max[f] = 0;
+#endif
+}
+#endif
+
+#ifdef INPUT_ZERO_COPY
+// Input tile element, read from the whole input (out of bounds: padding)
+static data_in_t hw_read_input(
+  int ti, int row, int col,
+  int iti, int ir, int ic,
+  data_in_t input[N][RR][CC]
+)
+{
+#pragma HLS INLINE
+  if((iti >= N - ti) || (ir >= RR - S * row) || (ic >= CC - S * col))
+    return 0;
+  return input[ti + iti][S * row + ir][S * col + ic];
+}
+#endif
+
 void hw_recv_input(
+#ifdef INPUT_ZERO_COPY
+  int ti, int row, int col,
+  data_in_t input_whole[N][RR][CC],
+#else
   data_in_t input_tile[Tn][Trr][Tcc],
+#endif
   data_in_t input_tile_hw[Tn][Trr][Tcc]
 #ifdef ENABLE_HARDWARE_ABFT
   , hls::stream<section_t>& section_fifo
 #endif
+#ifdef FINE_ABFT
+  , hls::stream<section_t> row_section_fifo[SECTIONS]
+  , hls::stream<section_t> col_section_fifo[SECTIONS]
+#endif
+#ifdef PROFILING
+  , hw_profile_t &profile
+#endif
 )
 {
 #ifndef ENABLE_HARDWARE_ABFT
@@ -17,17 +102,30 @@ void hw_recv_input(
       for(int ic = 0; ic < Tcc; ic++)
       {
 #pragma HLS PIPELINE rewind
+        PROFILE_ITERATION(profile);
+#ifdef INPUT_ZERO_COPY
+        input_tile_hw[iti][ir][ic] = hw_read_input(ti, row, col, iti, ir, ic, input_whole);
+#else
         input_tile_hw[iti][ir][ic] = input_tile[iti][ir][ic];
+#endif
       }
     }
   }
 
 #else
   // Section coordinates + aging (init to 1, sy/sx will start with 0/0)
-  ap_uint<ceillog2(2 * K - 1)> sy, sx, old_sx(1), old_sy(1);
+  ap_uint<ceillog2(SECTIONS)> sy, sx, old_sx(1), old_sy(1);
 
-  section_t section[2 * K - 1][2 * K - 1], acc;
+  section_t section[SECTIONS][SECTIONS], acc;
 #pragma HLS RESOURCE variable=section core=RAM_S2P_LUTRAM
+#ifdef FINE_ABFT
+  // Column sections of the current input row (row checksums), and row
+  // sections of each input column (column checksums)
+  section_t row_section[SECTIONS];
+  section_t col_section[Tcc][SECTIONS];
+#pragma HLS ARRAY_PARTITION variable=row_section complete
+#pragma HLS ARRAY_PARTITION variable=col_section complete dim=2
+#endif
 
 
   for(int iti = 0; iti < Tn; iti++)
@@ -40,44 +138,80 @@ void hw_recv_input(
 
         // False dependency on section: trick with old_sy/sx + acc
 #pragma HLS dependence variable=section inter false
+#ifdef FINE_ABFT
+        // Same for col_section: ic changes at each cycle
+#pragma HLS dependence variable=col_section inter false
+#endif
+        PROFILE_ITERATION(profile);
 
+#ifdef INPUT_ZERO_COPY
+        data_in_t input = hw_read_input(ti, row, col, iti, ir, ic, input_whole);
+#else
         data_in_t input = input_tile[iti][ir][ic];
+#endif
         input_tile_hw[iti][ir][ic] = input;
 
         // Compute to which section this input will be accumulated
-        if(ir < K - 1)
-          sy = ir;
-        else if(ir <= Trr - K)
-          sy = K - 1;
-        else
-          sy = -Trr + 2 * K + ir - 1;
-
-        if(ic < K - 1)
-          sx = ic;
-        else if(ic <= Tcc - K)
-          sx = K - 1;
-        else
-          sx = -Tcc + 2 * K + ic - 1;
+        sy = hw_section(ir, S, K, Tr);
+        sx = hw_section(ic, S, K, Tc);
 
         // Accumulate to sections
-        if(old_sx == sx && old_sy == sy)
+        // We need to initialize section if input is its first value accumulated
+        if(hw_section_first(ir, S, K, Tr) && hw_section_first(ic, S, K, Tc))
+          acc = input;
+        else if(old_sx == sx && old_sy == sy)
           acc += input;
-        else {
-          // We need to initialize section if input is its first value accumulated
-          if(((ir < K) || (ir > Tr - 1)) && ((ic < K) || (ic > Tc - 1)))
-            acc = input;
-          else
-            acc = section[sy][sx] + input;
-        }
+        else
+          acc = section[sy][sx] + input;
 
         old_sx = sx;
         old_sy = sy;
 
-        // Last step
-        if(((ir < K - 1) || (ir > Tr - 2)) && ((ic < K - 1) || (ic > Tc - 2)))
+        // Last step (sections are completed in sy, sx order)
+        if(hw_section_last(ir, S, K, Tr) && hw_section_last(ic, S, K, Tc))
+        {
+          PROFILE_STALL(profile, section_fifo.full());
           section_fifo << acc;
+          PROFILE_FIFO(FIFO_SECTION, section_fifo);
+        }
         else
           section[sy][sx] = acc;
+
+#ifdef FINE_ABFT
+        if(hw_section_first(ic, S, K, Tc))
+          row_section[sx] = input;
+        else
+          row_section[sx] += input;
+
+        // Row end: all its column sections at once
+        if(ic == Tcc - 1)
+        {
+          for(int s = 0; s < SECTIONS; s++)
+          {
+#pragma HLS UNROLL
+            PROFILE_STALL(profile, row_section_fifo[s].full());
+            row_section_fifo[s] << row_section[s];
+            PROFILE_FIFO(FIFO_ROW_SECTION, row_section_fifo[s]);
+          }
+        }
+
+        if(hw_section_first(ir, S, K, Tr))
+          col_section[ic][sy] = input;
+        else
+          col_section[ic][sy] += input;
+
+        // Last row: all row sections of the column at once
+        if(ir == Trr - 1)
+        {
+          for(int s = 0; s < SECTIONS; s++)
+          {
+#pragma HLS UNROLL
+            PROFILE_STALL(profile, col_section_fifo[s].full());
+            col_section_fifo[s] << col_section[ic][s];
+            PROFILE_FIFO(FIFO_COL_SECTION, col_section_fifo[s]);
+          }
+        }
+#endif
       }
     }
   }
@@ -86,13 +220,25 @@ void hw_recv_input(
 } // hw_recv_input()
 
 void hw_recv_weights(
+#ifdef WEIGHTS_REUSE
+  bool reload, int ti1,
+#endif
   data_in_t weights_tile[Tn][Tm][K][K],
   data_in_t weights_tile_hw[Tn][Tm][K][K]
 #ifdef ENABLE_HARDWARE_ABFT
   , hls::stream<kernel_t>& kernel_fifo
 #endif
+#ifdef PROFILING
+  , hw_profile_t &profile
+#endif
 )
 {
+#ifdef WEIGHTS_REUSE
+  // Weight tiles of current output feature maps, kept while only rows/columns change
+  static data_in_t weights_cache[TILES_N][Tn][Tm][K][K];
+#pragma HLS RESOURCE variable=weights_cache core=RAM_2P_BRAM
+#endif
+
 #ifndef ENABLE_HARDWARE_ABFT
 
   for(int iti = 0; iti < Tn; iti++)
@@ -104,7 +250,20 @@ void hw_recv_weights(
         for(int ic = 0; ic < K; ic++)
         {
 #pragma HLS PIPELINE rewind
+          PROFILE_ITERATION(profile);
+#ifdef WEIGHTS_REUSE
+          data_in_t weight;
+          if(reload)
+          {
+            weight = weights_tile[iti][ito][ir][ic];
+            weights_cache[ti1][iti][ito][ir][ic] = weight;
+          }
+          else
+            weight = weights_cache[ti1][iti][ito][ir][ic];
+          weights_tile_hw[iti][ito][ir][ic] = weight;
+#else
           weights_tile_hw[iti][ito][ir][ic] = weights_tile[iti][ito][ir][ic];
+#endif
         }
       }
     }
@@ -113,7 +272,12 @@ void hw_recv_weights(
 #else
 
   // Local data
+#ifdef FINE_ABFT
+  // One kernel per lane: sums of output maps ito % Um == lane
+  static kernel_t kernel[Um][K][K];
+#else
   static kernel_t kernel[K][K];
+#endif
 #pragma HLS RESOURCE variable=kernel core=RAM_S2P_LUTRAM
 
   for(int iti = 0; iti < Tn; iti++)
@@ -128,10 +292,37 @@ void hw_recv_weights(
 
           // False dependency on kernel: ic changes at each cycle
 #pragma HLS dependence variable=kernel inter false
+          PROFILE_ITERATION(profile);
 
+#ifdef WEIGHTS_REUSE
+          data_in_t weight;
+          if(reload)
+          {
+            weight = weights_tile[iti][ito][ir][ic];
+            weights_cache[ti1][iti][ito][ir][ic] = weight;
+          }
+          else
+            weight = weights_cache[ti1][iti][ito][ir][ic];
+#else
           data_in_t weight = weights_tile[iti][ito][ir][ic];
+#endif
           weights_tile_hw[iti][ito][ir][ic] = weight;
 
+#ifdef FINE_ABFT
+          // Same steps per lane, kernels are sent lane by lane
+          int lane = ito % Um;
+          if(ito < Um)
+            kernel[lane][ir][ic] = weight;
+          else
+            kernel[lane][ir][ic] += weight;
+
+          if(ito >= Tm - Um)
+          {
+            PROFILE_STALL(profile, kernel_fifo.full());
+            kernel_fifo << kernel[lane][ir][ic];
+            PROFILE_FIFO(FIFO_KERNEL, kernel_fifo);
+          }
+#else
           // First step
           if(ito == 0)
             kernel[ir][ic] = weight;
@@ -141,7 +332,12 @@ void hw_recv_weights(
 
           // Last step
           if(ito == Tm - 1)
+          {
+            PROFILE_STALL(profile, kernel_fifo.full());
             kernel_fifo << kernel[ir][ic];
+            PROFILE_FIFO(FIFO_KERNEL, kernel_fifo);
+          }
+#endif
         }
       }
     }
@@ -152,8 +348,14 @@ void hw_recv_weights(
 
 void hw_send_output(
   bool end,
+#ifdef EPILOGUE
+  bool pool,
+#endif
   hls::stream<data_in_t> output_fifo[Um],
   data_in_t output_tile[Tm][Tr][Tc]
+#ifdef PROFILING
+  , hw_profile_t &profile
+#endif
 )
 {
   if(end)
@@ -167,6 +369,17 @@ void hw_send_output(
           for(int ic = 0; ic < Tc; ic++)
           {
 #pragma HLS PIPELINE
+            PROFILE_ITERATION(profile);
+#ifdef EPILOGUE
+            // Pooled outputs at the top-left, the whole tile is still
+            // written (sequential access)
+            if(pool && ((ir >= Tr / 2) || (ic >= Tc / 2)))
+            {
+              output_tile[Um * ito1 + um][ir][ic] = 0;
+              continue;
+            }
+#endif
+            PROFILE_STALL(profile, output_fifo[um].empty());
             output_tile[Um * ito1 + um][ir][ic] = output_fifo[um].read();
           }
         }
@@ -175,145 +388,708 @@ void hw_send_output(
   }
 } // hw_send_output()
 
-#pragma SDS data access_pattern(input_tile:SEQUENTIAL)
-#pragma SDS data access_pattern(weights_tile:SEQUENTIAL)
-#pragma SDS data access_pattern(output_tile:SEQUENTIAL)
-#pragma SDS data access_pattern(failed:SEQUENTIAL)
-// #pragma SDS data mem_attribute(input_tile:PHYSICAL_CONTIGUOUS) // Faster in AXIDMA_SIMPLE
-#pragma SDS data mem_attribute(weights_tile:PHYSICAL_CONTIGUOUS)
-#pragma SDS data mem_attribute(output_tile:PHYSICAL_CONTIGUOUS)
-// #pragma SDS data mem_attribute(failed:PHYSICAL_CONTIGUOUS) // Faster without it
-void hw_toplevel(
-  // Inputs
-  data_in_t input_tile[TILES][TILES_N][Tn][Trr][Tcc],
-  data_in_t weights_tile[TILES][TILES_N][Tn][Tm][K][K],
+#ifdef EPILOGUE
+template<int TILES_HW>
+void hw_epilogue(
+  bool end,
+  int tile,
+  epilogue_t epilogue,
+  data_in_t bias_tile[Tm],
+  data_in_t residual_tile[Tm / Um][Tr][Tc][Um],
+  hls::stream<data_in_t> output_fifo[Um],
+  hls::stream<data_in_t> epilogue_fifo[Um]
+#ifndef ENABLE_HARDWARE_ABFT
+  , data_in_t outcs_tile[TILES_HW]
+#endif
+#ifdef PROFILING
+  , hw_profile_t &profile
+#endif
+)
+{
+  data_in_t bias[Tm];
+  // 2x2 max-pool: maximum of the column pair on the left, and of the pairs
+  // of the row above
+  data_in_t pool_left[Um];
+  data_in_t pool_row[Um][UPPERDIV(Tc, 2)];
+#ifndef ENABLE_HARDWARE_ABFT
+  data_out_t outcs_hw[Um];
+#pragma HLS ARRAY_PARTITION variable=outcs_hw complete
+#endif
+DO_PRAGMA(HLS ARRAY_PARTITION variable=bias cyclic factor=Um)
+#pragma HLS ARRAY_PARTITION variable=pool_left complete
+#pragma HLS ARRAY_PARTITION variable=pool_row complete dim=1
 
-  // Outputs
-  data_in_t output_tile[TILES][Tm][Tr][Tc]
+  if(end)
+  {
+    for(int ito = 0; ito < Tm; ito++)
+    {
+#pragma HLS PIPELINE
+      PROFILE_ITERATION(profile);
+      bias[ito] = (epilogue & EPILOGUE_BIAS) ? bias_tile[ito] : data_in_t(0);
+    }
+#ifndef ENABLE_HARDWARE_ABFT
+    for(int um = 0; um < Um; um++)
+    {
+#pragma HLS UNROLL
+      outcs_hw[um] = 0;
+    }
+#endif
+
+    for(int ito = 0, ito1 = 0; ito < Tm; ito += Um, ito1++)
+    {
+      for(int ir = 0; ir < Tr; ir++)
+      {
+        for(int ic = 0; ic < Tc; ic++)
+        {
+#pragma HLS PIPELINE
+          PROFILE_ITERATION(profile);
+          for(int um = 0; um < Um; um++)
+          {
+#pragma HLS UNROLL
+            PROFILE_STALL(profile, output_fifo[um].empty());
+            data_in_t value = output_fifo[um].read();
+
+            // ABFT covers the convolution: checksum before the epilogue
+#ifndef ENABLE_HARDWARE_ABFT
+            outcs_hw[um] += value;
+#endif
+
+            value += bias[ito + um];
+            if(epilogue & EPILOGUE_RESIDUAL)
+              value += residual_tile[ito1][ir][ic][um];
+            if((epilogue & EPILOGUE_RELU) && value.sign())
+              value = 0;
+
+            if(epilogue & EPILOGUE_POOL)
+            {
+              if(ic % 2 == 0)
+                pool_left[um] = value;
+              else
+              {
+                data_in_t pair = MAX(pool_left[um], value);
+                if(ir % 2 == 0)
+                  pool_row[um][ic / 2] = pair;
+                else
+                {
+                  PROFILE_STALL(profile, epilogue_fifo[um].full());
+                  epilogue_fifo[um] << MAX(pool_row[um][ic / 2], pair);
+                  PROFILE_FIFO(FIFO_EPILOGUE, epilogue_fifo[um]);
+                }
+              }
+            }
+            else
+            {
+              PROFILE_STALL(profile, epilogue_fifo[um].full());
+              epilogue_fifo[um] << value;
+              PROFILE_FIFO(FIFO_EPILOGUE, epilogue_fifo[um]);
+            }
+          } // um
+        } // ic
+      } // ir
+    } // ito
 
+#ifndef ENABLE_HARDWARE_ABFT
+    data_out_t outcs_sum = 0;
+    for(int um = 0; um < Um; um++)
+    {
+#pragma HLS UNROLL
+      outcs_sum += outcs_hw[um];
+    }
+    outcs_tile[tile] = data_in_t(outcs_sum);
+#else
+    (void) tile;
+#endif
+  }
+} // hw_epilogue()
+#endif
+
+template<int TILES_HW>
+void hw_dataflow(
+  bool start, bool end, bool last,
+  ap_uint<1> pingpong,
+  int tile,
+#ifdef INPUT_ZERO_COPY
+  int ti, int row, int col,
+  data_in_t input[N][RR][CC],
+#else
+  data_in_t input_tile[Tn][Trr][Tcc],
+#endif
+#ifdef WEIGHTS_REUSE
+  bool reload, int ti1,
+#endif
+  data_in_t weights_tile[Tn][Tm][K][K],
+#ifdef EPILOGUE
+  epilogue_t epilogue,
+  data_in_t bias_tile[Tm],
+  data_in_t residual_tile[Tm / Um][Tr][Tc][Um],
+#endif
+#ifdef REQUANT
+  shift_t abft_shift,
+  data_in_t mult_tile[Tm],
+  shift_t shift_tile[Tm],
+#endif
+  data_in_t output_tile[Tm][Tr][Tc]
 #ifdef ENABLE_HARDWARE_ABFT
-  , ap_uint<FAILED_BITS> failed[FAILED_SIZE]
+  , ap_uint<FAILED_BITS> failed[UPPERDIV(TILES_HW, 32)]
+#elif defined(EPILOGUE)
+  , data_in_t outcs_tile[TILES_HW]
+#endif
+#ifdef FINE_ABFT
+  , abft_region_t region[TILES_HW]
+#endif
+#ifdef PROFILING
+  , hw_profile_t profile[ACTORS]
 #endif
 )
 {
-  dataflowTile:for(int tile = 0; tile < TILES; tile++)
-  {
-    dataflowN:for(int ti1 = 0; ti1 < TILES_N; ti1++)
-    {
 #pragma HLS DATAFLOW
-      hls::stream<data_in_t> output_fifo[Um];
+  hls::stream<data_in_t> output_fifo[Um];
 DO_PRAGMA(HLS stream depth=OUTPUT_FIFO_DEPTH variable=output_fifo)
+#ifdef EPILOGUE
+  // Epilogue outputs are in the order of the convolution ones
+  hls::stream<data_in_t> epilogue_fifo[Um];
+DO_PRAGMA(HLS stream depth=OUTPUT_FIFO_DEPTH variable=epilogue_fifo)
+#endif
 
-      data_in_t input_tile_hw[Tn][Trr][Tcc];
-      data_in_t weights_tile_hw[Tn][Tm][K][K];
+  data_in_t input_tile_hw[Tn][Trr][Tcc];
+  data_in_t weights_tile_hw[Tn][Tm][K][K];
 
+#ifdef HW_OUTCS
+  hls::stream<data_out_t> output_fifo_fullp[Um];
+#endif
 #ifdef ENABLE_HARDWARE_ABFT
-      hls::stream<data_out_t> output_fifo_fullp[Um];
-      hls::stream<section_t> section_fifo;
-      hls::stream<kernel_t> kernel_fifo;
+  hls::stream<section_t> section_fifo;
+  hls::stream<kernel_t> kernel_fifo;
+#ifdef FINE_ABFT
+  // Kernels of all lanes, sections of each input row and column
+DO_PRAGMA(HLS stream depth=Um*K2 variable=kernel_fifo)
+  hls::stream<section_t> row_section_fifo[SECTIONS];
+  hls::stream<section_t> col_section_fifo[SECTIONS];
+DO_PRAGMA(HLS stream depth=Trr variable=row_section_fifo)
+DO_PRAGMA(HLS stream depth=Tcc variable=col_section_fifo)
+#else
 DO_PRAGMA(HLS stream depth=K2 variable=kernel_fifo)
+#endif
 /* #pragma HLS RESOURCE variable=output_fifo_fullp core=FIFO_LUTRAM */
 /* #pragma HLS RESOURCE variable=section_fifo core=FIFO_LUTRAM */
 /* #pragma HLS RESOURCE variable=kernel_fifo core=FIFO_LUTRAM */
 #endif
 
-      // Partition for unrolled loop related dimensions
+  // Partition for unrolled loop related dimensions
 DO_PRAGMA(HLS ARRAY_PARTITION variable=input_tile_hw cyclic factor=Un dim=1)
 DO_PRAGMA(HLS ARRAY_PARTITION variable=weights_tile_hw cyclic factor=Un dim=1)
 DO_PRAGMA(HLS ARRAY_PARTITION variable=weights_tile_hw cyclic factor=Um dim=2)
 
-      // Force tile memories to be in BRAM (otherwise, in some case, they are
-      // implemented in LUTRAM and use too much LUT)
+  // Force tile memories to be in BRAM (otherwise, in some case, they are
+  // implemented in LUTRAM and use too much LUT)
 #pragma HLS RESOURCE variable=input_tile_hw core=RAM_2P_BRAM
 #pragma HLS RESOURCE variable=weights_tile_hw core=RAM_2P_BRAM
 
 #ifdef ENABLE_HARDWARE_ABFT
-      data_in_t incs, outcs;
+  data_in_t incs, outcs;
+#endif
+#ifdef FINE_ABFT
+  data_in_t incs_lane[Um], outcs_lane[Um], incs_row[Tr], outcs_row[Tr];
+  data_in_t incs_col[Tc], outcs_col[Tc];
+#endif
+
+  hw_recv_input(
+#ifdef INPUT_ZERO_COPY
+    ti, row, col,
+    input,
+#else
+    input_tile,
+#endif
+    input_tile_hw
+#ifdef ENABLE_HARDWARE_ABFT
+    , section_fifo
+#endif
+#ifdef FINE_ABFT
+    , row_section_fifo
+    , col_section_fifo
+#endif
+#ifdef PROFILING
+    , profile[ACTOR_RECV_INPUT]
+#endif
+  );
+
+  hw_recv_weights(
+#ifdef WEIGHTS_REUSE
+    reload, ti1,
+#endif
+    weights_tile,
+    weights_tile_hw
+#ifdef ENABLE_HARDWARE_ABFT
+    , kernel_fifo
+#endif
+#ifdef PROFILING
+    , profile[ACTOR_RECV_WEIGHTS]
+#endif
+  );
+
+#ifdef ENABLE_HARDWARE_ABFT
+  hw_incs(
+    start,
+    end,
+#ifdef REQUANT
+    abft_shift,
+#endif
+    section_fifo,
+    kernel_fifo,
+#ifdef FINE_ABFT
+    row_section_fifo,
+    col_section_fifo,
+    incs_lane,
+    incs_row,
+    incs_col,
+#endif
+    &incs
+#ifdef PROFILING
+    , profile[ACTOR_INCS]
+#endif
+  );
+#endif
+
+  hw_conv(
+    start,
+    end,
+    pingpong,
+    input_tile_hw,
+    weights_tile_hw,
+#ifdef HW_OUTCS
+    output_fifo_fullp
+#else
+    output_fifo
+#endif
+#ifdef PROFILING
+    , profile[ACTOR_CONV]
+#endif
+  );
+
+#ifdef HW_OUTCS
+  hw_outcs(
+    end,
+    tile,
+#ifdef REQUANT
+    abft_shift,
+    mult_tile,
+    shift_tile,
+#endif
+    output_fifo_fullp,
+    output_fifo
+#ifdef ENABLE_HARDWARE_ABFT
+    , &outcs
+#endif
+#ifdef FINE_ABFT
+    , outcs_lane
+    , outcs_row
+    , outcs_col
+#endif
+#ifdef PROFILING
+    , profile[ACTOR_OUTCS]
+#endif
+  );
+#endif
+
+#ifdef EPILOGUE
+  hw_epilogue<TILES_HW>(
+    end,
+    tile,
+    epilogue,
+    bias_tile,
+    residual_tile,
+    output_fifo,
+    epilogue_fifo
+#ifndef ENABLE_HARDWARE_ABFT
+    , outcs_tile
+#endif
+#ifdef PROFILING
+    , profile[ACTOR_EPILOGUE]
+#endif
+  );
+
+  hw_send_output(
+    end,
+    (epilogue & EPILOGUE_POOL) != 0,
+    epilogue_fifo,
+    output_tile
+#ifdef PROFILING
+    , profile[ACTOR_SEND_OUTPUT]
+#endif
+  );
+#else
+  hw_send_output(
+    end,
+    output_fifo,
+    output_tile
+#ifdef PROFILING
+    , profile[ACTOR_SEND_OUTPUT]
+#endif
+  );
+#endif
+
+#ifdef ENABLE_HARDWARE_ABFT
+  hw_compare_cs<TILES_HW>(
+    end,
+    last,
+    incs,
+    outcs,
+#ifdef FINE_ABFT
+    incs_lane,
+    outcs_lane,
+    incs_row,
+    outcs_row,
+    incs_col,
+    outcs_col,
+    region,
+#endif
+    tile,
+    failed
+  );
+#endif
+} // hw_dataflow()
+
+#ifdef INPUT_ZERO_COPY
+#pragma SDS data zero_copy(input)
+#pragma SDS data mem_attribute(input:PHYSICAL_CONTIGUOUS)
+#else
+#pragma SDS data access_pattern(input_tile:SEQUENTIAL)
+#pragma SDS data copy(input_tile[0:BATCHES * tiles_m * tiles_r * tiles_c * tiles_n])
+#endif
+#pragma SDS data access_pattern(weights_tile:SEQUENTIAL)
+#ifdef WEIGHTS_REUSE
+#pragma SDS data copy(weights_tile[0:BATCHES * tiles_m * tiles_n])
+#pragma SDS data access_pattern(weights_index:SEQUENTIAL)
+#pragma SDS data copy(weights_index[0:BATCHES * tiles_m * tiles_r * tiles_c])
+#else
+#pragma SDS data copy(weights_tile[0:BATCHES * tiles_m * tiles_r * tiles_c * tiles_n])
+#endif
+#pragma SDS data access_pattern(output_tile:SEQUENTIAL)
+#pragma SDS data copy(output_tile[0:BATCHES * tiles_m * tiles_r * tiles_c])
+#pragma SDS data access_pattern(failed:SEQUENTIAL)
+#pragma SDS data copy(failed[0:UPPERDIV(BATCHES * tiles_m * tiles_r * tiles_c, FAILED_BITS)])
+#ifdef FINE_ABFT
+#pragma SDS data access_pattern(region:SEQUENTIAL)
+#pragma SDS data copy(region[0:BATCHES * tiles_m * tiles_r * tiles_c])
+#endif
+#ifdef EPILOGUE
+#pragma SDS data access_pattern(bias_tile:SEQUENTIAL)
+#pragma SDS data copy(bias_tile[0:BATCHES * tiles_m * tiles_r * tiles_c])
+// Residual is only read with EPILOGUE_RESIDUAL (not transferred otherwise)
+#pragma SDS data zero_copy(residual_tile)
+#pragma SDS data mem_attribute(residual_tile:PHYSICAL_CONTIGUOUS)
+#pragma SDS data access_pattern(outcs_tile:SEQUENTIAL)
+#pragma SDS data copy(outcs_tile[0:BATCHES * tiles_m * tiles_r * tiles_c])
+#endif
+#ifdef REQUANT
+#pragma SDS data access_pattern(mult_tile:SEQUENTIAL)
+#pragma SDS data copy(mult_tile[0:BATCHES * tiles_m * tiles_r * tiles_c])
+#pragma SDS data access_pattern(shift_tile:SEQUENTIAL)
+#pragma SDS data copy(shift_tile[0:BATCHES * tiles_m * tiles_r * tiles_c])
+#endif
+// #pragma SDS data mem_attribute(input_tile:PHYSICAL_CONTIGUOUS) // Faster in AXIDMA_SIMPLE
+#pragma SDS data mem_attribute(weights_tile:PHYSICAL_CONTIGUOUS)
+#pragma SDS data mem_attribute(output_tile:PHYSICAL_CONTIGUOUS)
+// #pragma SDS data mem_attribute(failed:PHYSICAL_CONTIGUOUS) // Faster without it
+#ifdef PROFILING
+#pragma SDS data access_pattern(profile:SEQUENTIAL)
+#pragma SDS data copy(profile[0:ACTORS])
+#endif
+void hw_toplevel(
+  // Runtime shape
+  int tiles_m, int tiles_n, int tiles_r, int tiles_c,
+
+  // Inputs
+#ifdef INPUT_ZERO_COPY
+  data_in_t input[BATCHES][N][RR][CC],
+#else
+  data_in_t input_tile[TILES * TILES_N][Tn][Trr][Tcc],
+#endif
+#ifdef WEIGHTS_REUSE
+  data_in_t weights_tile[WEIGHTS_TILES * TILES_N][Tn][Tm][K][K],
+  int weights_index[TILES],
+#else
+  data_in_t weights_tile[TILES * TILES_N][Tn][Tm][K][K],
+#endif
+#ifdef EPILOGUE
+  epilogue_t epilogue,
+  data_in_t bias_tile[TILES][Tm],
+  data_in_t residual_tile[TILES][Tm / Um][Tr][Tc][Um],
+#endif
+#ifdef REQUANT
+  shift_t abft_shift,
+  data_in_t mult_tile[TILES][Tm],
+  shift_t shift_tile[TILES][Tm],
+#endif
+
+  // Outputs
+  data_in_t output_tile[TILES][Tm][Tr][Tc]
+
+#ifdef ENABLE_HARDWARE_ABFT
+  , ap_uint<FAILED_BITS> failed[FAILED_SIZE]
+#elif defined(EPILOGUE)
+  , data_in_t outcs_tile[TILES]
+#endif
+#ifdef FINE_ABFT
+  , abft_region_t region[TILES]
+#endif
+#ifdef PROFILING
+  , hw_profile_t profile[ACTORS]
+#endif
+)
+{
+  int tiles = BATCHES * tiles_m * tiles_r * tiles_c;
+#ifdef WEIGHTS_REUSE
+  int last_wtile = 0;
+#endif
+#ifdef INPUT_ZERO_COPY
+  // Current output tile coordinates (tiles are in b, to, row, col order)
+  int b = 0, to1 = 0, row = 0, col = 0;
+#endif
+#ifdef PROFILING
+  // Counters stay in registers, profile is only written at the end
+  hw_profile_t profile_hw[ACTORS];
+#pragma HLS ARRAY_PARTITION variable=profile_hw complete
+  hw_profile_reset(profile_hw);
+#endif
+
+  dataflowTile:for(int tile = 0; tile < tiles; tile++)
+  {
+DO_PRAGMA(HLS loop_tripcount max=TILES)
+#ifdef WEIGHTS_REUSE
+    // Weights are only received when they differ from previous output tile
+    int wtile = weights_index[tile];
+    bool reload = (tile == 0) || (wtile != last_wtile);
+    last_wtile = wtile;
+#endif
+
+    dataflowN:for(int ti1 = 0; ti1 < tiles_n; ti1++)
+    {
+DO_PRAGMA(HLS loop_tripcount max=TILES_N)
+      hw_dataflow<TILES>(
+        ti1 == 0,
+        ti1 == tiles_n - 1,
+        tile == tiles - 1,
+        ti1 % 2,
+        tile,
+#ifdef INPUT_ZERO_COPY
+        ti1 * Tn, row, col,
+        input[b],
+#else
+        input_tile[tile * tiles_n + ti1],
+#endif
+#ifdef WEIGHTS_REUSE
+        reload, ti1,
+        weights_tile[wtile * tiles_n + ti1],
+#else
+        weights_tile[tile * tiles_n + ti1],
+#endif
+#ifdef EPILOGUE
+        epilogue,
+        bias_tile[tile],
+        residual_tile[tile],
+#endif
+#ifdef REQUANT
+        abft_shift,
+        mult_tile[tile],
+        shift_tile[tile],
 #endif
-
-      bool start = (ti1 == 0);
-      bool end = (ti1 == TILES_N - 1);
-      ap_uint<ceillog2(TILES)> tile_df = tile;
-      ap_uint<1> pingpong = (ti1 % 2);
-
-      hw_recv_input(
-        input_tile[tile][ti1],
-        input_tile_hw
+        output_tile[tile]
 #ifdef ENABLE_HARDWARE_ABFT
-        , section_fifo
+        , failed
+#elif defined(EPILOGUE)
+        , outcs_tile
+#endif
+#ifdef FINE_ABFT
+        , region
+#endif
+#ifdef PROFILING
+        , profile_hw
 #endif
       );
+    }
 
-      hw_recv_weights(
-        weights_tile[tile][ti1],
-        weights_tile_hw
-#ifdef ENABLE_HARDWARE_ABFT
-        , kernel_fifo
+#ifdef INPUT_ZERO_COPY
+    col += Tc;
+    if(col >= tiles_c * Tc)
+    {
+      col = 0;
+      row += Tr;
+      if(row >= tiles_r * Tr)
+      {
+        row = 0;
+        to1++;
+        if(to1 == tiles_m)
+        {
+          to1 = 0;
+          b++;
+        }
+      }
+    }
 #endif
-      );
+  }
 
-#ifdef ENABLE_HARDWARE_ABFT
-      hw_incs(
-        start,
-        end,
-        section_fifo,
-        kernel_fifo,
-        &incs
-      );
+#ifdef PROFILING
+  for(int a = 0; a < ACTORS; a++)
+    profile[a] = profile_hw[a];
+#endif
+} // hw_toplevel()
+
+// All arguments are read/written directly in memory, so that the number of
+// tiles is only known by the descriptors (sizes are used by simulation only)
+#pragma SDS data zero_copy(desc)
+#ifdef INPUT_ZERO_COPY
+#pragma SDS data zero_copy(input)
+#pragma SDS data mem_attribute(input:PHYSICAL_CONTIGUOUS)
+#else
+#pragma SDS data zero_copy(input_tile)
+#pragma SDS data mem_attribute(input_tile:PHYSICAL_CONTIGUOUS)
+#endif
+#pragma SDS data zero_copy(weights_tile)
+#pragma SDS data zero_copy(output_tile)
+#pragma SDS data zero_copy(failed)
+#pragma SDS data mem_attribute(desc:PHYSICAL_CONTIGUOUS)
+#pragma SDS data mem_attribute(weights_tile:PHYSICAL_CONTIGUOUS)
+#pragma SDS data mem_attribute(output_tile:PHYSICAL_CONTIGUOUS)
+#pragma SDS data mem_attribute(failed:PHYSICAL_CONTIGUOUS)
+#ifdef FINE_ABFT
+#pragma SDS data zero_copy(region)
+#pragma SDS data mem_attribute(region:PHYSICAL_CONTIGUOUS)
+#endif
+#ifdef EPILOGUE
+#pragma SDS data zero_copy(bias_tile)
+#pragma SDS data zero_copy(residual_tile)
+#pragma SDS data zero_copy(outcs_tile)
+#pragma SDS data mem_attribute(bias_tile:PHYSICAL_CONTIGUOUS)
+#pragma SDS data mem_attribute(residual_tile:PHYSICAL_CONTIGUOUS)
+#pragma SDS data mem_attribute(outcs_tile:PHYSICAL_CONTIGUOUS)
+#endif
+#ifdef REQUANT
+#pragma SDS data zero_copy(mult_tile)
+#pragma SDS data zero_copy(shift_tile)
+#pragma SDS data mem_attribute(mult_tile:PHYSICAL_CONTIGUOUS)
+#pragma SDS data mem_attribute(shift_tile:PHYSICAL_CONTIGUOUS)
 #endif
+#ifdef PROFILING
+#pragma SDS data zero_copy(profile)
+#pragma SDS data mem_attribute(profile:PHYSICAL_CONTIGUOUS)
+#endif
+void hw_toplevel_stream(
+  // Runtime shape
+  int tiles_n,
 
-      hw_conv(
-        start,
-        end,
-        pingpong,
-        input_tile_hw,
-        weights_tile_hw,
-#ifdef ENABLE_HARDWARE_ABFT
-        output_fifo_fullp
+  // Inputs
+  tile_desc_t desc[STREAM_TILES],
+#ifdef INPUT_ZERO_COPY
+  data_in_t input[STREAM_BATCHES][N][RR][CC],
 #else
-        output_fifo
+  data_in_t input_tile[STREAM_TILES * TILES_N][Tn][Trr][Tcc],
 #endif
-      );
+  data_in_t weights_tile[STREAM_TILES * TILES_N][Tn][Tm][K][K],
+#ifdef EPILOGUE
+  epilogue_t epilogue,
+  data_in_t bias_tile[STREAM_TILES][Tm],
+  data_in_t residual_tile[STREAM_TILES][Tm / Um][Tr][Tc][Um],
+#endif
+#ifdef REQUANT
+  shift_t abft_shift,
+  data_in_t mult_tile[STREAM_TILES][Tm],
+  shift_t shift_tile[STREAM_TILES][Tm],
+#endif
+
+  // Outputs
+  data_in_t output_tile[STREAM_TILES][Tm][Tr][Tc]
 
 #ifdef ENABLE_HARDWARE_ABFT
-      hw_outcs(
-        end,
-        output_fifo_fullp,
-        output_fifo,
-        &outcs
-      );
+  , ap_uint<FAILED_BITS> failed[STREAM_FAILED_SIZE]
+#elif defined(EPILOGUE)
+  , data_in_t outcs_tile[STREAM_TILES]
+#endif
+#ifdef FINE_ABFT
+  , abft_region_t region[STREAM_TILES]
+#endif
+#ifdef PROFILING
+  , hw_profile_t profile[ACTORS]
+#endif
+)
+{
+  bool last = false;
+#ifdef PROFILING
+  // Counters stay in registers, profile is only written at the end
+  hw_profile_t profile_hw[ACTORS];
+#pragma HLS ARRAY_PARTITION variable=profile_hw complete
+  hw_profile_reset(profile_hw);
 #endif
 
-      hw_send_output(
-        end,
-        output_fifo,
-        output_tile[tile]
-      );
+  streamTile:for(int tile = 0; !last; tile++)
+  {
+    tile_desc_t d = desc[tile];
+    last = d.last;
 
+    streamN:for(int ti1 = 0; ti1 < tiles_n; ti1++)
+    {
+DO_PRAGMA(HLS loop_tripcount max=TILES_N)
+      hw_dataflow<STREAM_TILES>(
+        ti1 == 0,
+        ti1 == tiles_n - 1,
+        last,
+        ti1 % 2,
+        tile,
+#ifdef INPUT_ZERO_COPY
+        ti1 * Tn, d.row, d.col,
+        input[d.input],
+#else
+        input_tile[d.input + ti1],
+#endif
+#ifdef WEIGHTS_REUSE
+        d.reload, ti1,
+#endif
+        weights_tile[d.weights + ti1],
+#ifdef EPILOGUE
+        epilogue,
+        bias_tile[tile],
+        residual_tile[tile],
+#endif
+#ifdef REQUANT
+        abft_shift,
+        mult_tile[tile],
+        shift_tile[tile],
+#endif
+        output_tile[tile]
 #ifdef ENABLE_HARDWARE_ABFT
-      hw_compare_cs(
-        end,
-        incs,
-        outcs,
-        tile_df,
-        failed
-      );
+        , failed
+#elif defined(EPILOGUE)
+        , outcs_tile
 #endif
-
+#ifdef FINE_ABFT
+        , region
+#endif
+#ifdef PROFILING
+        , profile_hw
+#endif
+      );
     }
   }
-}
+
+#ifdef PROFILING
+  for(int a = 0; a < ACTORS; a++)
+    profile[a] = profile_hw[a];
+#endif
+} // hw_toplevel_stream()
 
 void hw_conv(
   bool start, bool end,
   ap_uint<1> pingpong,
   data_in_t input_tile_hw[Tn][Trr][Tcc],
   data_in_t weights_tile_hw[Tn][Tm][K][K],
-#ifdef ENABLE_HARDWARE_ABFT
+#ifdef HW_OUTCS
   hls::stream<data_out_t> output_fifo_fullp[Um]
 #else
   hls::stream<data_in_t> output_fifo[Um]
 #endif
+#ifdef PROFILING
+  , hw_profile_t &profile
+#endif
 )
 {
   // Local data
@@ -349,6 +1125,7 @@ DO_PRAGMA(HLS ARRAY_PARTITION variable=output_tile_hw_local complete dim=3)
 #endif
             {
 #pragma HLS PIPELINE rewind
+              PROFILE_ITERATION(profile);
               // Um Processing Elements, with mul + add tree Un-wide
 #ifdef OPTIDSP
 #warning "DSP usage optimization enabled"
@@ -428,29 +1205,39 @@ DO_PRAGMA(HLS ARRAY_PARTITION variable=output_tile_hw_local complete dim=3)
                   {
 #pragma HLS UNROLL
                     // Accumulate to output_tile_hw_local
-                    data_pe_t pe_output_sum = output_tile_hw_local[1 - pingpong][ito1][um + s][ir][ic] + pe_hw[um + s];
-                    if(start)
-                      output_tile_hw_local[pingpong][ito1][um + s][ir][ic] = pe_hw[um + s];
-                    else if(end)
-#ifdef ENABLE_HARDWARE_ABFT
+                    // (start and end: only one input tile)
+                    data_pe_t pe_output_sum = (start ? data_pe_t(0) : output_tile_hw_local[1 - pingpong][ito1][um + s][ir][ic]) + pe_hw[um + s];
+                    if(end)
+                    {
+#ifdef HW_OUTCS
+                      PROFILE_STALL(profile, output_fifo_fullp[um + s].full());
                       output_fifo_fullp[um + s] << pe_output_sum;
+                      PROFILE_FIFO(FIFO_OUTPUT_FULLP, output_fifo_fullp[um + s]);
 #else
+                      PROFILE_STALL(profile, output_fifo[um + s].full());
                       output_fifo[um + s] << (pe_output_sum >> (data_in_t::width - 1));
+                      PROFILE_FIFO(FIFO_OUTPUT, output_fifo[um + s]);
 #endif
+                    }
                     else
                       output_tile_hw_local[pingpong][ito1][um + s][ir][ic] = pe_output_sum;
                   }
 #else // OPTIDSP
                   // Accumulate to output_tile_hw_local
-                  data_pe_t pe_output_sum = output_tile_hw_local[1 - pingpong][ito1][um][ir][ic] + pe_hw[um];
-                  if(start)
-                    output_tile_hw_local[pingpong][ito1][um][ir][ic] = pe_hw[um];
-                  else if(end)
-#ifdef ENABLE_HARDWARE_ABFT
+                  // (start and end: only one input tile)
+                  data_pe_t pe_output_sum = (start ? data_pe_t(0) : output_tile_hw_local[1 - pingpong][ito1][um][ir][ic]) + pe_hw[um];
+                  if(end)
+                  {
+#ifdef HW_OUTCS
+                    PROFILE_STALL(profile, output_fifo_fullp[um].full());
                     output_fifo_fullp[um] << pe_output_sum;
+                    PROFILE_FIFO(FIFO_OUTPUT_FULLP, output_fifo_fullp[um]);
 #else
+                    PROFILE_STALL(profile, output_fifo[um].full());
                     output_fifo[um] << (pe_output_sum >> (data_in_t::width - 1));
+                    PROFILE_FIFO(FIFO_OUTPUT, output_fifo[um]);
 #endif
+                  }
                   else
                     output_tile_hw_local[pingpong][ito1][um][ir][ic] = pe_output_sum;
 #endif // OPTIDSP
@@ -465,17 +1252,168 @@ DO_PRAGMA(HLS ARRAY_PARTITION variable=output_tile_hw_local complete dim=3)
 } // hw_conv()
 
 
+#ifdef HW_OUTCS
+// Requantization of one output (see requant_acc_t)
+static inline data_in_t hw_requant(data_out_t acc, data_in_t mult, shift_t shift)
+{
+#pragma HLS INLINE
+  requant_acc_t product = requant_acc_t(acc) * mult;
+  return data_in_t(product >> shift);
+}
+
+void hw_outcs(
+  bool end,
+  int tile,
+#ifdef REQUANT
+  shift_t abft_shift,
+  data_in_t mult_tile[Tm],
+  shift_t shift_tile[Tm],
+#endif
+  hls::stream<data_out_t> output_fifo_fullp[Um],
+  hls::stream<data_in_t> output_fifo[Um]
+#ifdef ENABLE_HARDWARE_ABFT
+  , data_in_t *outcs
+#endif
+#ifdef FINE_ABFT
+  , data_in_t outcs_lane[Um]
+  , data_in_t outcs_row[Tr]
+  , data_in_t outcs_col[Tc]
+#endif
+#ifdef PROFILING
+  , hw_profile_t &profile
+#endif
+)
+{
+#ifdef ENABLE_HARDWARE_ABFT
+  static data_out_t outcs_hw[Um];
+#pragma HLS ARRAY_PARTITION variable=outcs_hw complete
+#endif
+#ifdef FINE_ABFT
+  static data_out_t outcs_row_hw[Tr], outcs_col_hw[Tc];
+#pragma HLS ARRAY_PARTITION variable=outcs_row_hw complete
+#pragma HLS ARRAY_PARTITION variable=outcs_col_hw complete
+#endif
+#ifdef REQUANT
+  data_in_t mult[Tm];
+  shift_t shift[Tm];
+DO_PRAGMA(HLS ARRAY_PARTITION variable=mult cyclic factor=Um)
+DO_PRAGMA(HLS ARRAY_PARTITION variable=shift cyclic factor=Um)
+#endif
+
+  if(end) {
+#ifdef REQUANT
+    for(int ito = 0; ito < Tm; ito++)
+    {
+#pragma HLS PIPELINE
+      PROFILE_ITERATION(profile);
+      mult[ito] = mult_tile[ito];
+      shift[ito] = shift_tile[ito];
+    }
+#endif
+
+    for(int ito = 0, ito1 = 0; ito < Tm; ito += Um, ito1++)
+    {
+      for(int ir = 0; ir < Tr; ir++)
+      {
+        for(int ic = 0; ic < Tc; ic++)
+        {
+          PROFILE_ITERATION(profile);
+#ifdef FINE_ABFT
+          data_out_t sum = 0;
+#endif
+          for(int um = 0; um < Um; um++)
+          {
+#pragma HLS UNROLL
+            PROFILE_STALL(profile, output_fifo_fullp[um].empty());
+            data_out_t data = output_fifo_fullp[um].read();
+#if defined(ENABLE_HARDWARE_ABFT) && !defined(__SYNTHESIS__)
+            data += hw_fault(tile, ito + um, ir, ic);
+#endif
+            PROFILE_STALL(profile, output_fifo[um].full());
+#ifdef REQUANT
+            output_fifo[um] << hw_requant(data, mult[ito + um], shift[ito + um]);
+#else
+            output_fifo[um] << data_in_t(data >> (data_in_t::width - 1));
+#endif
+            PROFILE_FIFO(FIFO_OUTPUT, output_fifo[um]);
+
+#ifdef ENABLE_HARDWARE_ABFT
+            outcs_hw[um] += data;
+#endif
+#ifdef FINE_ABFT
+            sum += data;
+#endif
+          } // um
+#ifdef FINE_ABFT
+          outcs_row_hw[ir] += sum;
+          outcs_col_hw[ic] += sum;
+#endif
+        } // ic
+      } // ir
+    } // ito
+
+#ifdef ENABLE_HARDWARE_ABFT
+    data_out_t outcs_sum = 0;
+    for(int um = 0; um < Um; um++)
+    {
+#pragma HLS UNROLL
+      outcs_sum += outcs_hw[um];
+#ifdef FINE_ABFT
+      outcs_lane[um] = data_in_t(outcs_hw[um] >> HW_ABFT_SHIFT);
+#endif
+      outcs_hw[um] = 0;
+    }
+    *outcs = data_in_t(outcs_sum >> HW_ABFT_SHIFT);
+#ifdef FINE_ABFT
+    for(int ir = 0; ir < Tr; ir++)
+    {
+#pragma HLS UNROLL
+      outcs_row[ir] = data_in_t(outcs_row_hw[ir] >> HW_ABFT_SHIFT);
+      outcs_row_hw[ir] = 0;
+    }
+    for(int ic = 0; ic < Tc; ic++)
+    {
+#pragma HLS UNROLL
+      outcs_col[ic] = data_in_t(outcs_col_hw[ic] >> HW_ABFT_SHIFT);
+      outcs_col_hw[ic] = 0;
+    }
+#endif
+#elif defined(REQUANT)
+    (void) abft_shift;
+#endif
+  }
+
+  // Only used by fault injection
+#if !defined(ENABLE_HARDWARE_ABFT) || defined(__SYNTHESIS__)
+  (void) tile;
+#endif
+} // hw_outcs()
+#endif
+
 #ifdef ENABLE_HARDWARE_ABFT
 
 void hw_incs(
   bool start, bool end,
+#ifdef REQUANT
+  shift_t abft_shift,
+#endif
   hls::stream<section_t>& section_fifo,
   hls::stream<kernel_t>& kernel_fifo,
+#ifdef FINE_ABFT
+  hls::stream<section_t> row_section_fifo[SECTIONS],
+  hls::stream<section_t> col_section_fifo[SECTIONS],
+  data_in_t incs_lane[Um],
+  data_in_t incs_row[Tr],
+  data_in_t incs_col[Tc],
+#endif
   data_in_t *incs
+#ifdef PROFILING
+  , hw_profile_t &profile
+#endif
 )
 {
   // Local data
-  static section_t section[2 * K - 1][2 * K - 1];
+  static section_t section[SECTIONS][SECTIONS];
   static ap_int<data_in_t::width + ceillog2(Tr * Tc) + ceillog2(K * K)> X[K][K];
   static data_checksum_t rho; // max 32 bits
 
@@ -485,12 +1423,33 @@ void hw_incs(
 
 DO_PRAGMA(HLS ARRAY_PARTITION variable=X cyclic factor=2 dim=1)
 DO_PRAGMA(HLS ARRAY_PARTITION variable=X cyclic factor=2 dim=2)
+#if S != 1
+  // Sums of sections for each kernel row
+  typedef ap_int<data_in_t::width + ceillog2(Tr * Tcc)> strip_t;
+  static strip_t Y[K][SECTIONS];
+#endif
+#ifdef FINE_ABFT
+  // Lane, output row and output column checksums. Output row ir only sees
+  // input rows S * ir + i (kernel row i): its X is taken on their column
+  // sections (same for columns)
+  typedef ap_int<data_in_t::width + ceillog2(Trr + Tcc)> line_t;
+  static data_checksum_t rho_lane[Um], rho_row[Tr], rho_col[Tc];
+  static kernel_t kernel[K][K]; // all lanes
+  static section_t row_section[Trr][SECTIONS], col_section[Tcc][SECTIONS];
+#pragma HLS ARRAY_PARTITION variable=rho_lane complete
+#pragma HLS ARRAY_PARTITION variable=rho_row complete
+#pragma HLS ARRAY_PARTITION variable=rho_col complete
+#pragma HLS ARRAY_PARTITION variable=row_section complete dim=2
+#pragma HLS ARRAY_PARTITION variable=col_section complete dim=2
+#endif
 
   incs_Nloop:for(int iti = 0; iti < Tn; iti++)
   {
-    incs_sectioncopy:for(int sy = 0; sy < 2 * K - 1; sy++) {
-      for(int sx = 0; sx < 2 * K - 1; sx++) {
+    incs_sectioncopy:for(int sy = 0; sy < SECTIONS; sy++) {
+      for(int sx = 0; sx < SECTIONS; sx++) {
 #pragma HLS PIPELINE
+        PROFILE_ITERATION(profile);
+        PROFILE_STALL(profile, section_fifo.empty());
         section_fifo >> section[sy][sx];
 
         // init for incsX00 loop
@@ -498,11 +1457,35 @@ DO_PRAGMA(HLS ARRAY_PARTITION variable=X cyclic factor=2 dim=2)
       }
     }
 
+#ifdef FINE_ABFT
+    incs_rowcopy:for(int y = 0; y < Trr; y++) {
+#pragma HLS PIPELINE
+      PROFILE_ITERATION(profile);
+      for(int sx = 0; sx < SECTIONS; sx++) {
+#pragma HLS UNROLL
+        PROFILE_STALL(profile, row_section_fifo[sx].empty());
+        row_section_fifo[sx] >> row_section[y][sx];
+      }
+    }
+
+    incs_colcopy:for(int x = 0; x < Tcc; x++) {
+#pragma HLS PIPELINE
+      PROFILE_ITERATION(profile);
+      for(int sy = 0; sy < SECTIONS; sy++) {
+#pragma HLS UNROLL
+        PROFILE_STALL(profile, col_section_fifo[sy].empty());
+        col_section_fifo[sy] >> col_section[x][sy];
+      }
+    }
+#endif
+
 
+#if S == 1
     // Compute X[0][0]
     incsX00:for(int c3 = 0; c3 < K; c3 += 1) {
       for(int c4 = 0; c4 < K; c4 += 1) {
 #pragma HLS PIPELINE
+        PROFILE_ITERATION(profile);
         X[0][0] += section[c3][c4];
       }
     }
@@ -511,6 +1494,7 @@ DO_PRAGMA(HLS ARRAY_PARTITION variable=X cyclic factor=2 dim=2)
     incsXn0:for(int c2 = 1; c2 < K; c2 += 1) {
       for(int c4 = 0; c4 < K; c4 += 1) {
 #pragma HLS PIPELINE
+        PROFILE_ITERATION(profile);
         if(c4 == 0)
           X[c2][0] = X[c2 - 1][0] + section[c2 + K - 1][c4] - section[c2 - 1][c4];
         else
@@ -523,6 +1507,7 @@ DO_PRAGMA(HLS ARRAY_PARTITION variable=X cyclic factor=2 dim=2)
       for(int c3 = 1; c3 < K; c3 += 1) {
         for(int c5 = 0; c5 < K; c5 += 1) {
 #pragma HLS PIPELINE
+          PROFILE_ITERATION(profile);
           if(c5 == 0)
             X[c2][c3] = X[c2][c3 - 1] + section[c5 + c2][c3 + K - 1] - section[c5 + c2][c3 - 1];
           else
@@ -530,72 +1515,154 @@ DO_PRAGMA(HLS ARRAY_PARTITION variable=X cyclic factor=2 dim=2)
         }
       }
     }
+#else
+    // Strided: X[i][j] is the sum of sections whose rows (resp. columns) are
+    // multiplied by kernel row i (resp. column j), separately on rows (Y) and
+    // columns
+    incsY:for(int i = 0; i < K; i++) {
+      for(int sx = 0; sx < SECTIONS; sx++) {
+        for(int sy = 0; sy < SECTIONS; sy++) {
+#pragma HLS PIPELINE
+          PROFILE_ITERATION(profile);
+          section_t value = hw_section_has(sy, i, S, K, Tr) ? section[sy][sx] : section_t(0);
+          if(sy == 0)
+            Y[i][sx] = value;
+          else
+            Y[i][sx] += value;
+        }
+      }
+    }
+
+    incsX:for(int i = 0; i < K; i++) {
+      for(int j = 0; j < K; j++) {
+        for(int sx = 0; sx < SECTIONS; sx++) {
+#pragma HLS PIPELINE
+          PROFILE_ITERATION(profile);
+          strip_t value = hw_section_has(sx, j, S, K, Tc) ? Y[i][sx] : strip_t(0);
+          if(sx == 0)
+            X[i][j] = value;
+          else
+            X[i][j] += value;
+        }
+      }
+    }
+#endif
+
+#ifdef FINE_ABFT
+    // Compute product + final accumulation, lane by lane
+    incsacc:for(int lane = 0; lane < Um; lane++) {
+      for(int c4 = 0; c4 < K; c4 += 1) {
+        for(int c5 = 0; c5 < K; c5 += 1) {
+#pragma HLS PIPELINE
+          PROFILE_ITERATION(profile);
+          PROFILE_STALL(profile, kernel_fifo.empty());
+          kernel_t weight = kernel_fifo.read();
+          data_checksum_t prod = weight * X[c4][c5];
+#pragma HLS RESOURCE variable=prod core=Mul_LUT
+
+          rho += prod;
+          rho_lane[lane] += prod;
+
+          if(lane == 0)
+            kernel[c4][c5] = weight;
+          else
+            kernel[c4][c5] += weight;
+        }
+      }
+    }
+
+    incsrows:for(int ir = 0; ir < Tr; ir++) {
+      for(int i = 0; i < K; i++) {
+        for(int j = 0; j < K; j++) {
+#pragma HLS PIPELINE
+          PROFILE_ITERATION(profile);
+          line_t x = 0;
+          for(int sx = 0; sx < SECTIONS; sx++) {
+#pragma HLS UNROLL
+            if(hw_section_has(sx, j, S, K, Tc))
+              x += row_section[S * ir + i][sx];
+          }
+          data_checksum_t prod = kernel[i][j] * x;
+#pragma HLS RESOURCE variable=prod core=Mul_LUT
+
+          rho_row[ir] += prod;
+        }
+      }
+    }
+
+    incscols:for(int ic = 0; ic < Tc; ic++) {
+      for(int i = 0; i < K; i++) {
+        for(int j = 0; j < K; j++) {
+#pragma HLS PIPELINE
+          PROFILE_ITERATION(profile);
+          line_t y = 0;
+          for(int sy = 0; sy < SECTIONS; sy++) {
+#pragma HLS UNROLL
+            if(hw_section_has(sy, i, S, K, Tr))
+              y += col_section[S * ic + j][sy];
+          }
+          data_checksum_t prod = kernel[i][j] * y;
+#pragma HLS RESOURCE variable=prod core=Mul_LUT
 
+          rho_col[ic] += prod;
+        }
+      }
+    }
+#else
     // Compute product + final accumulation
     incsacc:for(int c4 = 0; c4 < K; c4 += 1) {
       for(int c5 = 0; c5 < K; c5 += 1) {
 #pragma HLS PIPELINE
+        PROFILE_ITERATION(profile);
+        PROFILE_STALL(profile, kernel_fifo.empty());
         data_checksum_t prod = kernel_fifo.read() * X[c4][c5];
 #pragma HLS RESOURCE variable=prod core=Mul_LUT
 
         rho += prod;
       }
     }
+#endif
   } // iti
 
   if(end) {
-    *incs = data_in_t(rho >> (data_in_t::width - 1));
+    *incs = data_in_t(rho >> HW_ABFT_SHIFT);
     rho = 0; // Reset for next call
-  }
-} // hw_incs()
-
-void hw_outcs(
-  bool end,
-  hls::stream<data_out_t> output_fifo_fullp[Um],
-  hls::stream<data_in_t> output_fifo[Um],
-  data_in_t *outcs
-)
-{
-  static data_out_t outcs_hw[Um];
-#pragma HLS ARRAY_PARTITION variable=outcs_hw complete
-
-  if(end) {
-    for(int ito = 0, ito1 = 0; ito < Tm; ito += Um, ito1++)
-    {
-      for(int ir = 0; ir < Tr; ir++)
-      {
-        for(int ic = 0; ic < Tc; ic++)
-        {
-          for(int um = 0; um < Um; um++)
-          {
+#ifdef FINE_ABFT
+    for(int um = 0; um < Um; um++) {
 #pragma HLS UNROLL
-            data_out_t data = output_fifo_fullp[um].read();
-            output_fifo[um] << data_in_t(data >> (data_in_t::width - 1));
-
-            outcs_hw[um] += data;
-          } // um
-        } // ic
-      } // ir
-    } // ito
-
-
-    data_out_t outcs_sum = 0;
-    for(int um = 0; um < Um; um++)
-    {
+      incs_lane[um] = data_in_t(rho_lane[um] >> HW_ABFT_SHIFT);
+      rho_lane[um] = 0;
+    }
+    for(int ir = 0; ir < Tr; ir++) {
 #pragma HLS UNROLL
-      outcs_sum += outcs_hw[um];
-      outcs_hw[um] = 0;
+      incs_row[ir] = data_in_t(rho_row[ir] >> HW_ABFT_SHIFT);
+      rho_row[ir] = 0;
     }
-    *outcs = data_in_t(outcs_sum >> (data_in_t::width - 1));
+    for(int ic = 0; ic < Tc; ic++) {
+#pragma HLS UNROLL
+      incs_col[ic] = data_in_t(rho_col[ic] >> HW_ABFT_SHIFT);
+      rho_col[ic] = 0;
+    }
+#endif
   }
-} // hw_outcs()
+} // hw_incs()
 
+template<int TILES_HW>
 void hw_compare_cs(
-  bool end,
+  bool end, bool last,
   data_in_t incs,
   data_in_t outcs,
-  ap_uint<ceillog2(TILES)> tile,
-  ap_uint<FAILED_BITS> failed[FAILED_SIZE]
+#ifdef FINE_ABFT
+  data_in_t incs_lane[Um],
+  data_in_t outcs_lane[Um],
+  data_in_t incs_row[Tr],
+  data_in_t outcs_row[Tr],
+  data_in_t incs_col[Tc],
+  data_in_t outcs_col[Tc],
+  abft_region_t region[TILES_HW],
+#endif
+  int tile,
+  ap_uint<FAILED_BITS> failed[UPPERDIV(TILES_HW, 32)]
 )
 {
   static ap_uint<FAILED_BITS> failed_hw;
@@ -604,8 +1671,28 @@ void hw_compare_cs(
   if(end) {
     failed_hw[tile % FAILED_BITS] = (incs != outcs) ? ap_uint<1>(1) : ap_uint<1>(0);
 
-    if(((tile % FAILED_BITS) == (FAILED_BITS - 1)) || (tile == TILES - 1))
+    if(((tile % FAILED_BITS) == (FAILED_BITS - 1)) || last)
       failed[tile / FAILED_BITS] = failed_hw;
+
+#ifdef FINE_ABFT
+    abft_region_t failed_region;
+    for(int um = 0; um < Um; um++)
+    {
+#pragma HLS UNROLL
+      failed_region.lanes[um] = (incs_lane[um] != outcs_lane[um]) ? ap_uint<1>(1) : ap_uint<1>(0);
+    }
+    for(int ir = 0; ir < Tr; ir++)
+    {
+#pragma HLS UNROLL
+      failed_region.rows[ir] = (incs_row[ir] != outcs_row[ir]) ? ap_uint<1>(1) : ap_uint<1>(0);
+    }
+    for(int ic = 0; ic < Tc; ic++)
+    {
+#pragma HLS UNROLL
+      failed_region.cols[ic] = (incs_col[ic] != outcs_col[ic]) ? ap_uint<1>(1) : ap_uint<1>(0);
+    }
+    region[tile] = failed_region;
+#endif
   }
 } // hw_compare_cs()
 
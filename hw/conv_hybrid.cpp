@@ -0,0 +1,177 @@
+#include "conv_hybrid.h"
+
+#include <thread>
+#include <algorithm> // copy
+
+ConvHybrid::ConvHybrid(double _cpu_fraction, bool _adaptive)
+  : cpu_fraction(_cpu_fraction)
+  , adaptive(_adaptive)
+  , hw_cost(0)
+  , cpu_cost(0)
+{
+  if(cpu_fraction < 0 || cpu_fraction > 1)
+    errx(-2, "CPU fraction must be in [0, 1]");
+}
+
+ConvHybrid::~ConvHybrid()
+{
+  teardown();
+}
+
+void ConvHybrid::init()
+{
+  session.init();
+}
+
+void ConvHybrid::teardown()
+{
+  session.teardown();
+}
+
+bool ConvHybrid::ready() const
+{
+  return session.ready();
+}
+
+double ConvHybrid::fraction() const
+{
+  return cpu_fraction;
+}
+
+int ConvHybrid::split(const conv_shape_t &shape) const
+{
+  int units = shape.tiles_m();
+  int cpu_units = (int) (cpu_fraction * units + 0.5);
+
+  return MIN((units - cpu_units) * Tm, shape.m);
+}
+
+int ConvHybrid::run(
+  const conv_shape_t &shape,
+  const data_in_t *input,
+  const data_in_t *weights,
+  data_in_t *output,
+  bool *failed,
+  bool doabft
+)
+{
+  int b, ti, to, tile, failedcount = 0;
+  int m_hw = split(shape);
+  int m_cpu = shape.m - m_hw;
+  conv_shape_t shape_hw = {shape.n, m_hw, shape.r, shape.c, shape.k};
+  conv_shape_t shape_cpu = {shape.n, m_cpu, shape.r, shape.c, shape.k};
+  size_t kk = (size_t) shape.k * shape.k;
+  size_t rc = (size_t) shape.r * shape.c;
+  int tiles_rc = shape.tiles_r() * shape.tiles_c();
+  uint64_t hw_before = hw.tot, cpu_before = cpu.tot;
+  std::thread worker;
+
+  total.start();
+
+  // One part only: no split
+  if(m_cpu == 0)
+  {
+    hw.start();
+    failedcount = session.run(shape, input, weights, output, failed, doabft);
+    hw.stop();
+  }
+  else if(m_hw == 0)
+  {
+    cpu.start();
+    convolution_simd(shape, input, weights, output, failed);
+    cpu.stop();
+  }
+  else
+  {
+    // Weights of each part (input is shared)
+    weights_hw.resize(BATCHES * shape.n * m_hw * kk);
+    weights_cpu.resize(BATCHES * shape.n * m_cpu * kk);
+    output_hw.resize(BATCHES * m_hw * rc);
+    output_cpu.resize(BATCHES * m_cpu * rc);
+    for(b = 0; b < BATCHES; b++)
+    {
+      for(ti = 0; ti < shape.n; ti++)
+      {
+        const data_in_t *w = weights + (size_t) (b * shape.n + ti) * shape.m * kk;
+
+        std::copy(w, w + m_hw * kk, &weights_hw[(size_t) (b * shape.n + ti) * m_hw * kk]);
+        std::copy(w + m_hw * kk, w + shape.m * kk, &weights_cpu[(size_t) (b * shape.n + ti) * m_cpu * kk]);
+      }
+    }
+
+    worker = std::thread([&] {
+      bool failed_cpu[TILES];
+
+      cpu.start();
+      convolution_simd(shape_cpu, input, weights_cpu.data(), output_cpu.data(), failed_cpu);
+      cpu.stop();
+    });
+
+    hw.start();
+    failedcount = session.run(shape_hw, input, weights_hw.data(), output_hw.data(), failed_hw, doabft);
+    hw.stop();
+
+    worker.join();
+
+    // Outputs and failed tiles in layer order
+    for(b = 0; b < BATCHES; b++)
+    {
+      std::copy(
+        &output_hw[b * m_hw * rc],
+        &output_hw[(b + 1) * m_hw * rc],
+        output + (size_t) b * shape.m * rc
+      );
+      std::copy(
+        &output_cpu[b * m_cpu * rc],
+        &output_cpu[(b + 1) * m_cpu * rc],
+        output + ((size_t) b * shape.m + m_hw) * rc
+      );
+
+      for(to = 0; to < shape.tiles_m(); to++)
+        for(tile = 0; tile < tiles_rc; tile++)
+          failed[(b * shape.tiles_m() + to) * tiles_rc + tile] =
+            (to < shape_hw.tiles_m()) &&
+            failed_hw[(b * shape_hw.tiles_m() + to) * tiles_rc + tile];
+    }
+  }
+
+  total.stop();
+
+  // Rebalance: per-unit costs (smoothed), both sides finish together when
+  // cpu_units * cpu_cost == hw_units * hw_cost
+  if(adaptive)
+  {
+    if(m_hw > 0)
+    {
+      double cost = (double) (hw.tot - hw_before) / shape_hw.tiles_m();
+      hw_cost = hw_cost > 0 ? (hw_cost + cost) / 2 : cost;
+    }
+    if(m_cpu > 0)
+    {
+      double cost = (double) (cpu.tot - cpu_before) * Tm / m_cpu;
+      cpu_cost = cpu_cost > 0 ? (cpu_cost + cost) / 2 : cost;
+    }
+    if(hw_cost > 0 && cpu_cost > 0)
+      cpu_fraction = hw_cost / (hw_cost + cpu_cost);
+  }
+
+  return failedcount;
+} // ConvHybrid::run()
+
+int ConvHybrid::run(
+  data_in_t input[BATCHES][N][RR][CC],
+  data_in_t weights[BATCHES][N][M][K][K],
+  data_in_t output[BATCHES][M][R][C],
+  bool failed[TILES],
+  bool doabft
+)
+{
+  return run(
+    max_shape,
+    &input[0][0][0][0],
+    &weights[0][0][0][0][0],
+    &output[0][0][0][0],
+    failed,
+    doabft
+  );
+} // ConvHybrid::run()
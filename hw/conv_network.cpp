@@ -0,0 +1,154 @@
+#include "conv_network.h"
+
+ConvNetwork::ConvNetwork(const std::vector<conv_layer_t> &_layers)
+  : layers(_layers)
+  , activation(_layers.size(), NULL)
+  , failedcount(_layers.size(), 0)
+  , tile_failed(NULL)
+  , layer_time(_layers.size())
+{
+  size_t i;
+
+  if(layers.empty())
+    errx(-2, "network needs at least 1 layer");
+
+  for(i = 0; i < layers.size(); i++)
+  {
+    const conv_shape_t &shape = layers[i].shape;
+
+    if(!shape_fits(shape))
+      errx(-2, "layer %zu shape does not fit in the accelerator", i);
+
+    if(i > 0)
+    {
+      const conv_layer_t &prev = layers[i - 1];
+      int pad = layers[i].pad;
+
+      if((pad < 0) || (shape.n != prev.shape.m) ||
+         (shape.rr() != prev.epilogue.rows(prev.shape) + 2 * pad) ||
+         (shape.cc() != prev.epilogue.cols(prev.shape) + 2 * pad))
+        errx(-2, "layer %zu input is not the padded output of layer %zu", i, i - 1);
+    }
+  }
+}
+
+ConvNetwork::~ConvNetwork()
+{
+  teardown();
+}
+
+void ConvNetwork::init()
+{
+  size_t i, bytes;
+
+  if(ready())
+    return;
+
+  session.init();
+
+  // Borders stay zero: layers only write map interiors
+  for(i = 1; i < layers.size(); i++)
+  {
+    const conv_shape_t &shape = layers[i].shape;
+
+    bytes = (size_t) BATCHES * shape.n * shape.rr() * shape.cc() * sizeof(data_in_t);
+    activation[i] = (data_in_t *) sds_alloc(bytes);
+    if(activation[i] == NULL)
+      errx(-2, "sds_alloc() of layer %zu activations failed", i);
+    memset((void *) activation[i], 0, bytes);
+  }
+
+  tile_failed = new bool[TILES];
+}
+
+void ConvNetwork::teardown()
+{
+  size_t i;
+
+  if(!ready())
+    return;
+
+  for(i = 1; i < layers.size(); i++)
+  {
+    sds_free(activation[i]);
+    activation[i] = NULL;
+  }
+
+  delete[] tile_failed;
+  tile_failed = NULL;
+
+  session.teardown();
+}
+
+bool ConvNetwork::ready() const
+{
+  return tile_failed != NULL;
+}
+
+int ConvNetwork::run(
+  const data_in_t *input,
+  data_in_t *output,
+  bool doabft
+)
+{
+  size_t i, last = layers.size() - 1;
+  int total_failed = 0;
+
+  if(!ready())
+    errx(-2, "network used before init()");
+
+  total.start();
+
+  for(i = 0; i < layers.size(); i++)
+  {
+    const conv_layer_t &layer = layers[i];
+
+    layer_time[i].start();
+
+    session.set_epilogue(layer.epilogue);
+    session.set_requant(layer.requant);
+    session.prepare(layer.shape, (i == 0) ? input : activation[i], layer.weights);
+    session.compute(doabft);
+
+    // Output in the padded input of the next layer, or the network output
+    if(i < last)
+    {
+      const conv_layer_t &next = layers[i + 1];
+      failedcount[i] = session.finish(
+        activation[i + 1],
+        next.shape.rr(), next.shape.cc(), next.pad,
+        tile_failed,
+        doabft
+      );
+    }
+    else
+      failedcount[i] = session.finish(output, tile_failed, doabft);
+
+    layer_time[i].stop();
+    total_failed += failedcount[i];
+  }
+
+  total.stop();
+
+  return total_failed;
+} // ConvNetwork::run()
+
+int ConvNetwork::size() const
+{
+  return layers.size();
+}
+
+int ConvNetwork::failed(int layer) const
+{
+  return failedcount[layer];
+}
+
+const data_in_t *ConvNetwork::activations(int layer) const
+{
+  return activation[layer];
+}
+
+ConvSession &ConvNetwork::conv_session()
+{
+  return session;
+}
@@ -0,0 +1,149 @@
+#include "conv_pipeline.h"
+
+ConvPipeline::ConvPipeline(int _slots)
+  : slots(_slots)
+  , submitted(0)
+  , waited(0)
+  , computed(0)
+  , stop(false)
+  , slot(NULL)
+{
+  if(slots < 1)
+    errx(-2, "pipeline needs at least 1 slot");
+}
+
+ConvPipeline::~ConvPipeline()
+{
+  teardown();
+}
+
+void ConvPipeline::init()
+{
+  int i;
+
+  if(ready())
+    return;
+
+  slot = new slot_t[slots];
+  for(i = 0; i < slots; i++)
+    slot[i].session.init();
+
+  submitted = waited = computed = 0;
+  stop = false;
+  worker = std::thread(&ConvPipeline::work, this);
+}
+
+void ConvPipeline::teardown()
+{
+  if(!ready())
+    return;
+
+  // Pending results are dropped, but hardware calls are completed
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    changed.wait(guard, [this] { return computed == submitted; });
+    stop = true;
+  }
+  changed.notify_all();
+  worker.join();
+
+  delete[] slot; // sessions free their buffers
+  slot = NULL;
+}
+
+bool ConvPipeline::ready() const
+{
+  return slot != NULL;
+}
+
+// Worker thread: hardware calls in submission order
+void ConvPipeline::work()
+{
+  slot_t *s;
+
+  while(true)
+  {
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      changed.wait(guard, [this] { return stop || computed < submitted; });
+      if(computed == submitted)
+        return;
+      s = &slot[computed % slots];
+    }
+
+    s->session.compute(s->doabft, &compute);
+
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      s->done = true;
+      computed++;
+    }
+    changed.notify_all();
+  }
+}
+
+void ConvPipeline::submit(
+  data_in_t input[BATCHES][N][RR][CC],
+  data_in_t weights[BATCHES][N][M][K][K],
+  data_in_t output[BATCHES][M][R][C],
+  bool failed[TILES],
+  bool doabft
+)
+{
+  slot_t *s;
+
+  if(!ready())
+    errx(-2, "pipeline used before init()");
+  if(full())
+    errx(-2, "submit() with all slots in flight (missing wait()?)");
+
+  // Slot is free: the worker does not use it until submitted is increased
+  s = &slot[submitted % slots];
+  s->output = &output[0][0][0][0];
+  s->failed = failed;
+  s->doabft = doabft;
+  s->done = false;
+
+  pack.start();
+  s->session.prepare(max_shape, &input[0][0][0][0], &weights[0][0][0][0][0]);
+  pack.stop();
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    submitted++;
+  }
+  changed.notify_all();
+}
+
+int ConvPipeline::wait()
+{
+  slot_t *s;
+  int failedcount;
+
+  if(in_flight() == 0)
+    errx(-2, "wait() without submitted call");
+
+  s = &slot[waited % slots];
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    changed.wait(guard, [s] { return s->done; });
+  }
+
+  scatter.start();
+  failedcount = s->session.finish(s->output, s->failed, s->doabft);
+  scatter.stop();
+
+  waited++;
+
+  return failedcount;
+}
+
+bool ConvPipeline::full() const
+{
+  return in_flight() == slots;
+}
+
+int ConvPipeline::in_flight() const
+{
+  return submitted - waited;
+}
@@ -0,0 +1,240 @@
+#include "conv_simd.h"
+
+#include <vector>
+#include <algorithm> // fill
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SIMD_NEON
+#elif (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define SIMD_X86
+#endif
+
+// Output maps computed together (each packed input row is reused for them)
+#define SIMD_BLOCK_M 8
+
+// Native types: 16 bits data for vector units (wider data is computed by
+// scalar code), accumulators wrap as data_out_t
+#if DATA_WL <= 16
+typedef int16_t simd_in_t;
+typedef int32_t simd_acc_t;
+typedef uint32_t simd_uacc_t;
+#else
+#undef SIMD_NEON
+#undef SIMD_X86
+typedef int32_t simd_in_t;
+typedef int64_t simd_acc_t;
+typedef uint64_t simd_uacc_t;
+#endif
+
+// acc[x] += w * in[x] for x < c
+typedef void (*simd_mac_t)(simd_acc_t *acc, const simd_in_t *in, simd_in_t w, int c);
+
+static inline void mac_scalar(simd_acc_t *acc, const simd_in_t *in, simd_in_t w, int c, int x)
+{
+  for(; x < c; x++)
+    acc[x] = (simd_acc_t) ((simd_uacc_t) acc[x] + (simd_uacc_t) ((simd_acc_t) w * in[x]));
+}
+
+static void mac_generic(simd_acc_t *acc, const simd_in_t *in, simd_in_t w, int c)
+{
+  int x = 0;
+
+#ifdef SIMD_NEON
+  for(; x + 4 <= c; x += 4)
+    vst1q_s32(acc + x, vmlal_n_s16(vld1q_s32(acc + x), vld1_s16(in + x), w));
+#elif defined(SIMD_X86) && defined(__SSE2__)
+  __m128i wv = _mm_set1_epi16(w);
+  for(; x + 8 <= c; x += 8)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i *) (in + x));
+    __m128i lo = _mm_mullo_epi16(v, wv);
+    __m128i hi = _mm_mulhi_epi16(v, wv);
+    __m128i *a = (__m128i *) (acc + x);
+
+    _mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a), _mm_unpacklo_epi16(lo, hi)));
+    _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), _mm_unpackhi_epi16(lo, hi)));
+  }
+#endif
+
+  mac_scalar(acc, in, w, c, x);
+}
+
+#ifdef SIMD_X86
+__attribute__((target("avx2")))
+static void mac_avx2(simd_acc_t *acc, const simd_in_t *in, simd_in_t w, int c)
+{
+  int x = 0;
+  __m256i wv = _mm256_set1_epi32(w);
+
+  for(; x + 8 <= c; x += 8)
+  {
+    __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) (in + x)));
+    __m256i *a = (__m256i *) (acc + x);
+
+    _mm256_storeu_si256(a, _mm256_add_epi32(_mm256_loadu_si256(a), _mm256_mullo_epi32(v, wv)));
+  }
+
+  mac_scalar(acc, in, w, c, x);
+}
+
+static bool has_avx2()
+{
+  return __builtin_cpu_supports("avx2");
+}
+#endif
+
+static simd_mac_t simd_mac()
+{
+#ifdef SIMD_X86
+  if(has_avx2())
+    return mac_avx2;
+#endif
+  return mac_generic;
+}
+
+// Same rescaling as the accelerator, from a native accumulator of map m
+static inline data_in_t simd_output(simd_acc_t acc, const conv_requant_t &requant, int m)
+{
+  // Sign extension from data_out_t width
+  const int shift = 8 * sizeof(simd_acc_t) - 2 * DATA_WL;
+  simd_acc_t full = (simd_acc_t) ((simd_uacc_t) acc << shift) >> shift;
+
+  if(requant.enabled())
+    return requant.apply(data_out_t(full), m);
+  return data_in_t(full >> (data_in_t::width - 1));
+}
+
+const char *simd_isa()
+{
+#if defined(SIMD_NEON)
+  return "neon";
+#elif defined(SIMD_X86)
+  if(has_avx2())
+    return "avx2";
+#ifdef __SSE2__
+  return "sse2";
+#else
+  return "scalar";
+#endif
+#else
+  return "scalar";
+#endif
+}
+
+int convolution_simd(
+  const conv_shape_t &shape,
+  const data_in_t *input,
+  const data_in_t *weights,
+  data_in_t *output,
+  bool *failed,
+  bool doabft,
+  perf_counter *intern,
+  perf_counter *abft_sw,
+  const conv_requant_t &requant
+)
+{
+  int i;
+
+  // No ABFT on this backend (see inc/conv_simd.h)
+  (void) doabft;
+  (void) abft_sw;
+
+  if(intern)
+    intern->start();
+
+#if DATA_WL > 32
+  errx(1, "convolution_simd(): DATA_WL > 32 is not supported");
+#endif
+  static const simd_mac_t mac = simd_mac();
+  int b, to0, tb, blocks, ti, j, row, col;
+  int n = shape.n, m = shape.m, k = shape.k;
+  int r = shape.r, c = shape.c, rr = shape.rr(), cc = shape.cc();
+  size_t input_size = (size_t) BATCHES * n * rr * cc;
+  size_t weights_size = (size_t) BATCHES * n * m * k * k;
+  size_t x;
+  std::vector<simd_in_t> input_native(input_size), weights_native(weights_size);
+  std::vector<simd_in_t> line(c);
+  std::vector<simd_acc_t> acc((size_t) SIMD_BLOCK_M * c);
+
+  for(x = 0; x < input_size; x++)
+    input_native[x] = input[x].to_int();
+  for(x = 0; x < weights_size; x++)
+    weights_native[x] = weights[x].to_int();
+
+  for(b = 0; b < BATCHES; b++)
+  {
+    for(to0 = 0; to0 < m; to0 += SIMD_BLOCK_M)
+    {
+      blocks = MIN(SIMD_BLOCK_M, m - to0);
+
+      for(row = 0; row < r; row++)
+      {
+        std::fill(acc.begin(), acc.end(), 0);
+
+        for(ti = 0; ti < n; ti++)
+        {
+          for(i = 0; i < k; i++)
+          {
+            for(j = 0; j < k; j++)
+            {
+              const simd_in_t *in = &input_native[((size_t) (b * n + ti) * rr + S * row + i) * cc + j];
+
+              // Strided input row is packed to be contiguous
+              if(S != 1)
+              {
+                for(col = 0; col < c; col++)
+                  line[col] = in[S * col];
+                in = line.data();
+              }
+
+              for(tb = 0; tb < blocks; tb++)
+                mac(
+                  &acc[(size_t) tb * c],
+                  in,
+                  weights_native[(((size_t) (b * n + ti) * m + to0 + tb) * k + i) * k + j],
+                  c
+                );
+            } // j
+          } // i
+        } // ti
+
+        for(tb = 0; tb < blocks; tb++)
+          for(col = 0; col < c; col++)
+            output[((size_t) (b * m + to0 + tb) * r + row) * c + col] =
+              simd_output(acc[(size_t) tb * c + col], requant, to0 + tb);
+      } // row
+    } // to0
+  } // b
+
+  if(intern)
+    intern->stop();
+
+  for(i = 0; i < shape.tiles(); i++)
+    failed[i] = false;
+
+  return 0;
+} // convolution_simd()
+
+int convolution_simd(
+  data_in_t input[BATCHES][N][RR][CC],
+  data_in_t weights[BATCHES][N][M][K][K],
+  data_in_t output[BATCHES][M][R][C],
+  bool failed[TILES],
+  bool doabft,
+  perf_counter *intern,
+  perf_counter *abft_sw
+)
+{
+  return convolution_simd(
+    max_shape,
+    &input[0][0][0][0],
+    &weights[0][0][0][0][0],
+    &output[0][0][0][0],
+    failed,
+    doabft,
+    intern,
+    abft_sw
+  );
+} // convolution_simd()
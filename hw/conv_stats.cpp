@@ -0,0 +1,134 @@
+#include "conv_stats.h"
+#include "convolution.h"
+
+static const char *phase_names[PHASES] = {
+  "alloc", "pack", "compute", "abft", "gather", "scatter", "free"
+};
+
+const char *conv_phase_name(int p)
+{
+  return phase_names[p];
+}
+
+conv_stats_t::conv_stats_t()
+{
+  reset();
+}
+
+void conv_stats_t::reset()
+{
+  int p;
+
+  for(p = 0; p < PHASES; p++)
+    phase[p].reset();
+  calls = tiles = failed = corrected = macs = packed = transferred = 0;
+}
+
+void conv_stats_t::add(const conv_stats_t &other)
+{
+  int p;
+
+  for(p = 0; p < PHASES; p++)
+  {
+    phase[p].tot += other.phase[p].tot;
+    phase[p].calls += other.phase[p].calls;
+  }
+  calls += other.calls;
+  tiles += other.tiles;
+  failed += other.failed;
+  corrected += other.corrected;
+  macs += other.macs;
+  packed += other.packed;
+  transferred += other.transferred;
+}
+
+void conv_stats_t::count(const conv_shape_t &shape, int failedcount, bool accelerator, bool residual)
+{
+  calls++;
+  tiles += shape.tiles();
+  failed += failedcount;
+  macs += (uint64_t) BATCHES * shape.m * shape.n * shape.r * shape.c * shape.k * shape.k;
+
+  if(accelerator)
+  {
+    transfer_volume_t volume = transfer_volume(
+      shape.n, shape.m, shape.r, shape.c,
+      WEIGHTS_REUSE_DEFAULT, INPUT_ZERO_COPY_DEFAULT, residual
+    );
+    packed += volume.packed;
+    transferred += volume.total();
+  }
+}
+
+uint64_t conv_stats_t::cycles() const
+{
+  uint64_t total = 0;
+  int p;
+
+  // Software checksums are computed during the hardware call
+  for(p = 0; p < PHASES; p++)
+    if(p != PHASE_ABFT)
+      total += phase[p].tot;
+  return total;
+}
+
+double conv_stats_t::seconds(int p) const
+{
+  return (double) phase[p].tot / sds_clock_frequency();
+}
+
+double conv_stats_t::seconds() const
+{
+  return (double) cycles() / sds_clock_frequency();
+}
+
+double conv_stats_t::gmacs() const
+{
+  return (cycles() == 0) ? 0. : macs / seconds() / 1e9;
+}
+
+double conv_stats_t::hw_gmacs() const
+{
+  return (phase[PHASE_COMPUTE].tot == 0) ? 0. : macs / seconds(PHASE_COMPUTE) / 1e9;
+}
+
+void conv_stats_t::print_json(std::ostream &os) const
+{
+  int p;
+
+  os << "{\"calls\": " << calls
+    << ", \"tiles\": " << tiles
+    << ", \"failed\": " << failed
+    << ", \"corrected\": " << corrected
+    << ", \"macs\": " << macs
+    << ", \"packed\": " << packed
+    << ", \"transferred\": " << transferred
+    << ", \"cycles\": {";
+  for(p = 0; p < PHASES; p++)
+    os << (p ? ", " : "") << '"' << phase_names[p] << "\": " << phase[p].tot;
+  os << "}, \"seconds\": " << seconds()
+    << ", \"gmacs\": " << gmacs()
+    << ", \"hw_gmacs\": " << hw_gmacs()
+    << '}';
+}
+
+void conv_stats_t::print_csv_header(std::ostream &os)
+{
+  int p;
+
+  os << "calls,tiles,failed,corrected,macs,packed,transferred";
+  for(p = 0; p < PHASES; p++)
+    os << ',' << phase_names[p] << "_cycles";
+  os << ",seconds,gmacs,hw_gmacs";
+}
+
+void conv_stats_t::print_csv(std::ostream &os) const
+{
+  int p;
+
+  os << calls << ',' << tiles << ',' << failed << ',' << corrected << ',' << macs << ','
+    << packed << ',' << transferred;
+  for(p = 0; p < PHASES; p++)
+    os << ',' << phase[p].tot;
+  os << ',' << seconds() << ',' << gmacs() << ',' << hw_gmacs();
+}
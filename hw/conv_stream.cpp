@@ -0,0 +1,413 @@
+#include "conv_stream.h"
+
+// Input/weight tiles of one image in buffers (images have the synthesized
+// shape)
+#define IMAGE_INPUT_TILES (TILES * TILES_N)
+#ifdef WEIGHTS_REUSE
+#define IMAGE_WEIGHTS_TILES (WEIGHTS_TILES * TILES_N)
+#else
+#define IMAGE_WEIGHTS_TILES (TILES * TILES_N)
+#endif
+
+ConvStream::ConvStream(int _capacity)
+  : capacity(_capacity)
+  , pushed(0)
+  , computed(0)
+  , popped(0)
+  , calls(0)
+  , desc(NULL)
+#ifdef INPUT_ZERO_COPY
+  , input_buffer(NULL)
+#else
+  , input_tile(NULL)
+#endif
+  , weights_tile(NULL)
+#ifdef WEIGHTS_REUSE
+  , weights_index(NULL)
+#endif
+  , output_tile(NULL)
+#ifdef ENABLE_HARDWARE_ABFT
+  , failed_tile(NULL)
+#ifdef FINE_ABFT
+  , region_tile(NULL)
+#endif
+#else
+  , incs(NULL)
+#endif
+#ifdef EPILOGUE
+  , bias_tile(NULL)
+  , residual_tile(NULL)
+#ifndef ENABLE_HARDWARE_ABFT
+  , outcs_tile(NULL)
+#endif
+#endif
+#ifdef REQUANT
+  , mult_tile(NULL)
+  , shift_tile(NULL)
+#endif
+#ifdef PROFILING
+  , profile_hw(NULL)
+#endif
+{
+  if(capacity < 1)
+    errx(-2, "stream capacity must be at least 1");
+  // Descriptors, failed bits and regions of one hardware call are bounded
+  if(capacity * BATCHES > STREAM_BATCHES)
+    errx(-2, "stream capacity must be at most %d (STREAM_BATCHES / BATCHES)", STREAM_BATCHES / BATCHES);
+}
+
+ConvStream::~ConvStream()
+{
+  teardown();
+}
+
+void ConvStream::init()
+{
+  if(ready())
+    return;
+
+  desc = (tile_desc_t *) sds_alloc(
+    capacity * TILES *
+    sizeof(tile_desc_t)
+  );
+#ifdef INPUT_ZERO_COPY
+  input_buffer =
+    (data_in_t (*) [N][RR][CC]) sds_alloc(
+    capacity * BATCHES * N * RR * CC *
+    sizeof(data_in_t)
+  );
+#else
+  input_tile =
+    (data_in_t (*) [Tn][Trr][Tcc]) sds_alloc(
+    capacity * IMAGE_INPUT_TILES * Tn * Trr * Tcc *
+    sizeof(data_in_t)
+  );
+#endif
+  weights_tile =
+    (data_in_t (*) [Tn][Tm][K][K]) sds_alloc(
+    capacity * IMAGE_WEIGHTS_TILES * Tn * Tm * K * K *
+    sizeof(data_in_t)
+  );
+  output_tile =
+    (data_in_t (*) [Tm][Tr][Tc]) sds_alloc(
+    capacity * TILES * Tm * Tr * Tc *
+    sizeof(data_in_t)
+  );
+#ifdef ENABLE_HARDWARE_ABFT
+  failed_tile = (ap_uint<FAILED_BITS> *) sds_alloc(
+    UPPERDIV(capacity * TILES, FAILED_BITS) *
+    sizeof(ap_uint<FAILED_BITS>)
+  );
+#ifdef FINE_ABFT
+  region_tile = (abft_region_t *) sds_alloc(capacity * TILES * sizeof(abft_region_t));
+#endif
+#else
+  incs = new data_in_t[capacity][TILES];
+#endif
+#ifdef WEIGHTS_REUSE
+  weights_index = new int[capacity][TILES];
+#endif
+#ifdef EPILOGUE
+  bias_tile = (data_in_t (*) [Tm]) sds_alloc(capacity * TILES * Tm * sizeof(data_in_t));
+  residual_tile =
+    (data_in_t (*) [Tm / Um][Tr][Tc][Um]) sds_alloc(
+    capacity * TILES * Tm * Tr * Tc *
+    sizeof(data_in_t)
+  );
+#ifndef ENABLE_HARDWARE_ABFT
+  outcs_tile = (data_in_t *) sds_alloc(capacity * TILES * sizeof(data_in_t));
+#endif
+#endif
+#ifdef REQUANT
+  mult_tile = (data_in_t (*) [Tm]) sds_alloc(capacity * TILES * Tm * sizeof(data_in_t));
+  shift_tile = (shift_t (*) [Tm]) sds_alloc(capacity * TILES * Tm * sizeof(shift_t));
+#endif
+#ifdef PROFILING
+  profile_hw = (hw_profile_t *) sds_alloc(ACTORS * sizeof(hw_profile_t));
+#endif
+
+  if(!ready())
+    err(-2, "memory allocation error");
+
+#ifdef REQUANT
+  for(int image = 0; image < capacity; image++)
+    prepare_requant_tiles(max_shape, no_requant, mult_tile + image * TILES, shift_tile + image * TILES);
+#endif
+
+  pushed = computed = popped = 0;
+}
+
+void ConvStream::teardown()
+{
+  if(desc != NULL)
+    sds_free(desc);
+#ifdef INPUT_ZERO_COPY
+  if(input_buffer != NULL)
+    sds_free(input_buffer);
+  input_buffer = NULL;
+#else
+  if(input_tile != NULL)
+    sds_free(input_tile);
+  input_tile = NULL;
+#endif
+  if(weights_tile != NULL)
+    sds_free(weights_tile);
+  if(output_tile != NULL)
+    sds_free(output_tile);
+#ifdef ENABLE_HARDWARE_ABFT
+  if(failed_tile != NULL)
+    sds_free(failed_tile);
+  failed_tile = NULL;
+#ifdef FINE_ABFT
+  if(region_tile != NULL)
+    sds_free(region_tile);
+  region_tile = NULL;
+#endif
+#else
+  delete[] incs;
+  incs = NULL;
+#endif
+#ifdef WEIGHTS_REUSE
+  delete[] weights_index;
+  weights_index = NULL;
+#endif
+#ifdef EPILOGUE
+  if(bias_tile != NULL)
+    sds_free(bias_tile);
+  if(residual_tile != NULL)
+    sds_free(residual_tile);
+  bias_tile = NULL;
+  residual_tile = NULL;
+#ifndef ENABLE_HARDWARE_ABFT
+  if(outcs_tile != NULL)
+    sds_free(outcs_tile);
+  outcs_tile = NULL;
+#endif
+#endif
+#ifdef REQUANT
+  if(mult_tile != NULL)
+    sds_free(mult_tile);
+  if(shift_tile != NULL)
+    sds_free(shift_tile);
+  mult_tile = NULL;
+  shift_tile = NULL;
+#endif
+#ifdef PROFILING
+  if(profile_hw != NULL)
+    sds_free(profile_hw);
+  profile_hw = NULL;
+#endif
+
+  desc = NULL;
+  weights_tile = NULL;
+  output_tile = NULL;
+}
+
+bool ConvStream::ready() const
+{
+  return
+    (desc != NULL) &&
+#ifdef INPUT_ZERO_COPY
+    (input_buffer != NULL) &&
+#else
+    (input_tile != NULL) &&
+#endif
+    (weights_tile != NULL) &&
+#ifdef WEIGHTS_REUSE
+    (weights_index != NULL) &&
+#endif
+#ifdef ENABLE_HARDWARE_ABFT
+    (failed_tile != NULL) &&
+#ifdef FINE_ABFT
+    (region_tile != NULL) &&
+#endif
+#else
+    (incs != NULL) &&
+#endif
+#ifdef EPILOGUE
+    (bias_tile != NULL) &&
+    (residual_tile != NULL) &&
+#ifndef ENABLE_HARDWARE_ABFT
+    (outcs_tile != NULL) &&
+#endif
+#endif
+#ifdef REQUANT
+    (mult_tile != NULL) &&
+    (shift_tile != NULL) &&
+#endif
+#ifdef PROFILING
+    (profile_hw != NULL) &&
+#endif
+    (output_tile != NULL);
+}
+
+void ConvStream::push(
+  data_in_t input[BATCHES][N][RR][CC],
+  data_in_t weights[BATCHES][N][M][K][K]
+)
+{
+  int image = pushed;
+
+  if(!ready())
+    errx(-2, "stream used before init()");
+  if(full())
+    errx(-2, "push() on a full stream");
+
+  prepare_tiles(
+    max_shape,
+    &input[0][0][0][0],
+    &weights[0][0][0][0][0],
+#ifdef INPUT_ZERO_COPY
+    input_buffer + image * BATCHES,
+#else
+    input_tile + image * IMAGE_INPUT_TILES,
+#endif
+    weights_tile + image * IMAGE_WEIGHTS_TILES
+#ifdef WEIGHTS_REUSE
+    , weights_index[image]
+#endif
+  );
+
+  prepare_descriptors(max_shape, image, desc + image * TILES);
+
+  pushed++;
+}
+
+void ConvStream::flush(perf_counter *intern)
+{
+  int image;
+
+  if(!ready())
+    errx(-2, "stream used before init()");
+  if(available() > 0)
+    errx(-2, "flush() before all results are retrieved");
+  if(pushed == 0)
+    return;
+
+  // Accelerator stops after this tile
+  desc[pushed * TILES - 1].last = true;
+
+  if(intern != NULL)
+    intern->start();
+
+  hw_toplevel_stream(
+    TILES_N,
+    desc,
+#ifdef INPUT_ZERO_COPY
+    input_buffer,
+#else
+    input_tile,
+#endif
+    weights_tile,
+#ifdef EPILOGUE
+    0,
+    bias_tile,
+    residual_tile,
+#endif
+#ifdef REQUANT
+    REQUANT_SHIFT,
+    mult_tile,
+    shift_tile,
+#endif
+    output_tile
+#ifdef ENABLE_HARDWARE_ABFT
+    , failed_tile
+#elif defined(EPILOGUE)
+    , outcs_tile
+#endif
+#ifdef FINE_ABFT
+    , region_tile
+#endif
+#ifdef PROFILING
+    , profile_hw
+#endif
+  );
+
+  if(intern != NULL)
+    intern->stop();
+
+  desc[pushed * TILES - 1].last = false;
+
+#ifndef ENABLE_HARDWARE_ABFT
+  for(image = 0; image < pushed; image++)
+  {
+    sw_incs(
+      max_shape,
+#ifdef INPUT_ZERO_COPY
+      input_buffer + image * BATCHES,
+#else
+      input_tile + image * IMAGE_INPUT_TILES,
+#endif
+      weights_tile + image * IMAGE_WEIGHTS_TILES,
+#ifdef WEIGHTS_REUSE
+      weights_index[image],
+#endif
+      incs[image]
+    );
+  }
+#else
+  (void) image;
+#endif
+
+  computed = pushed;
+  popped = 0;
+  pushed = 0;
+  calls++;
+}
+
+int ConvStream::pop(
+  data_in_t output[BATCHES][M][R][C],
+  bool failed[TILES]
+)
+{
+  int image = popped;
+  int failedcount;
+
+  if(available() == 0)
+    errx(-2, "pop() without computed results (missing flush()?)");
+
+  failedcount = failed_tiles(
+    max_shape,
+#ifdef ENABLE_HARDWARE_ABFT
+    failed_tile, image * TILES,
+#elif defined(EPILOGUE)
+    incs[image], outcs_tile + image * TILES,
+#else
+    incs[image], output_tile + image * TILES,
+#endif
+    failed
+  );
+
+  manage_output_tiles(max_shape, output_tile + image * TILES, &output[0][0][0][0]);
+
+  popped++;
+
+  return failedcount;
+}
+
+bool ConvStream::full() const
+{
+  return pushed == capacity;
+}
+
+int ConvStream::pending() const
+{
+  return pushed;
+}
+
+int ConvStream::available() const
+{
+  return computed - popped;
+}
+
+int ConvStream::hardware_calls() const
+{
+  return calls;
+}
+
+#ifdef PROFILING
+const hw_profile_t *ConvStream::profile() const
+{
+  return profile_hw;
+}
+#endif
@@ -1,13 +1,46 @@
 #include "convolution.h"
+#include "conv_simd.h"
 #include <iostream>
+#include <algorithm> // copy
+
+static conv_backend_t backend = CONV_BACKEND_HARDWARE;
 
 void prepare_input_tile(
   int ti, int row, int col,
   data_in_t input[N][RR][CC],
   data_in_t input_tile[Tn][Trr][Tcc]
 )
+{
+  prepare_input_tile(max_shape, ti, row, col, &input[0][0][0], input_tile);
+}
+
+void prepare_weights_tile(
+  int to, int ti,
+  data_in_t weights[N][M][K][K],
+  data_in_t weights_tile[Tn][Tm][K][K]
+)
+{
+  prepare_weights_tile(max_shape, to, ti, &weights[0][0][0][0], weights_tile);
+}
+
+void manage_output_tile(
+  int to, int row, int col,
+  data_in_t output_tile[Tm][Tr][Tc],
+  data_in_t output[M][R][C]
+)
+{
+  manage_output_tile(max_shape, to, row, col, output_tile, &output[0][0][0]);
+}
+
+void prepare_input_tile(
+  const conv_shape_t &shape,
+  int ti, int row, int col,
+  const data_in_t *input,
+  data_in_t input_tile[Tn][Trr][Tcc]
+)
 {
   int iti, ir, ic;
+  int rr = shape.rr(), cc = shape.cc();
 
   for(iti = 0; iti < Tn; iti++)
   {
@@ -16,10 +49,11 @@ void prepare_input_tile(
       for(ic = 0; ic < Tcc; ic++)
       {
         // padding
-        if((iti >= N - ti) || (ir >= RR - S * row) || (ic >= CC - S * col))
+        if((iti >= shape.n - ti) || (ir >= rr - S * row) || (ic >= cc - S * col))
           input_tile[iti][ir][ic] = 0;
         else
-          input_tile[iti][ir][ic] = input[ti + iti][S * row + ir][S * col + ic];
+          input_tile[iti][ir][ic] =
+            input[((ti + iti) * rr + S * row + ir) * cc + S * col + ic];
       }
     }
   }
@@ -27,12 +61,14 @@ void prepare_input_tile(
 
 
 void prepare_weights_tile(
+  const conv_shape_t &shape,
   int to, int ti,
-  data_in_t weights[N][M][K][K],
+  const data_in_t *weights,
   data_in_t weights_tile[Tn][Tm][K][K]
 )
 {
   int ito, iti, ir, ic;
+  int k = shape.k;
 
   for(iti = 0; iti < Tn; iti++)
   {
@@ -42,11 +78,12 @@ void prepare_weights_tile(
       {
         for(ic = 0; ic < K; ic++)
         {
-          // padding
-          if((ito >= M - to) || (iti >= N - ti))
+          // padding (including smaller kernels)
+          if((ito >= shape.m - to) || (iti >= shape.n - ti) || (ir >= k) || (ic >= k))
             weights_tile[iti][ito][ir][ic] = 0;
           else
-            weights_tile[iti][ito][ir][ic] = weights[ti + iti][to + ito][ir][ic];
+            weights_tile[iti][ito][ir][ic] =
+              weights[(((ti + iti) * shape.m + to + ito) * k + ir) * k + ic];
         }
       }
     }
@@ -54,117 +91,840 @@ void prepare_weights_tile(
 }
 
 
+// Output tile in output[m][rows][cols] at (pad, pad). pool: the tile holds
+// 2x2 max-pooled outputs at its top-left (see hw_epilogue())
+static void manage_output_tile(
+  const conv_shape_t &shape,
+  int to, int row, int col,
+  data_in_t output_tile[Tm][Tr][Tc],
+  data_in_t *output,
+  int rows, int cols, int pad,
+  bool pool
+)
+{
+  int ito, ir, ic;
+  int step = pool ? 2 : 1;
+  int tr = MIN(Tr, shape.r - row) / step, tc = MIN(Tc, shape.c - col) / step;
+
+  row /= step;
+  col /= step;
+  for(ito = 0; ito < MIN(Tm, shape.m - to); ito++)
+  {
+    for(ir = 0; ir < tr; ir++)
+    {
+      for(ic = 0; ic < tc; ic++)
+      {
+        output[((to + ito) * rows + pad + row + ir) * cols + pad + col + ic] =
+          output_tile[ito][ir][ic];
+      }
+    }
+  }
+}
+
 void manage_output_tile(
+  const conv_shape_t &shape,
   int to, int row, int col,
   data_in_t output_tile[Tm][Tr][Tc],
-  data_in_t output[M][R][C]
+  data_in_t *output
+)
+{
+  manage_output_tile(shape, to, row, col, output_tile, output, shape.r, shape.c, 0, false);
+}
+
+void prepare_tiles(
+  const conv_shape_t &shape,
+  const data_in_t *input,
+  const data_in_t *weights,
+#ifdef INPUT_ZERO_COPY
+  data_in_t input_buffer[BATCHES][N][RR][CC],
+#else
+  data_in_t input_tile[TILES * TILES_N][Tn][Trr][Tcc],
+#endif
+#ifdef WEIGHTS_REUSE
+  data_in_t weights_tile[WEIGHTS_TILES * TILES_N][Tn][Tm][K][K],
+  int weights_index[TILES]
+#else
+  data_in_t weights_tile[TILES * TILES_N][Tn][Tm][K][K]
+#endif
+)
+{
+  // Tile loops indexes
+  int b, row, col, to, ti, tile;
+  int to1, ti1; // to = to1 * Tm
+  int tiles_n = shape.tiles_n();
+#ifndef INPUT_ZERO_COPY
+  size_t input_batch = (size_t) shape.n * shape.rr() * shape.cc();
+#endif
+  size_t weights_batch = (size_t) shape.n * shape.m * shape.k * shape.k;
+
+#ifdef INPUT_ZERO_COPY
+  // Accelerator reads tiles from input: only needs to be in pinned memory,
+  // with the synthesized layout (elements out of the shape only meet zero
+  // weights or discarded outputs)
+  if(shape == max_shape)
+  {
+    if(input != &input_buffer[0][0][0][0])
+      memcpy(input_buffer, input, BATCHES * N * RR * CC * sizeof(data_in_t));
+  }
+  else
+  {
+    for(b = 0; b < BATCHES; b++)
+      for(ti = 0; ti < shape.n; ti++)
+        for(row = 0; row < shape.rr(); row++)
+          std::copy(
+            input + ((b * shape.n + ti) * shape.rr() + row) * shape.cc(),
+            input + ((b * shape.n + ti) * shape.rr() + row + 1) * shape.cc(),
+            input_buffer[b][ti][row]
+          );
+  }
+#endif
+
+  tile = 0;
+  for(b = 0; b < BATCHES; b++)
+  {
+    for(to = 0, to1 = 0; to < shape.m; to += Tm, to1++)
+    {
+      for(row = 0; row < shape.r; row += Tr)
+      {
+        for(col = 0; col < shape.c; col += Tc)
+        {
+          for(ti = 0, ti1 = 0; ti < shape.n; ti += Tn, ti1++)
+          {
+#ifndef INPUT_ZERO_COPY
+            prepare_input_tile(
+              shape,
+              ti, row, col,
+              input + b * input_batch,
+              input_tile[tile * tiles_n + ti1]
+            );
+#endif
+
+#ifdef WEIGHTS_REUSE
+            // Weight tiles only depend on b/to: packed for the first row/col,
+            // then reused by the accelerator (see weights_index)
+            if((row == 0) && (col == 0))
+            {
+              prepare_weights_tile(
+                shape,
+                to, ti,
+                weights + b * weights_batch,
+                weights_tile[(b * shape.tiles_m() + to1) * tiles_n + ti1]
+              );
+            }
+#else
+            // Note that we could only send TILES_M * TILES_N weights tiles
+            // by interchanging loops row/col and ti in conv_compute_tile.
+            // But in this case we would need to receive more output tiles
+            // (TILES_N more). TILES_R and TILES_C are likely to be 1 so this
+            // solution is better (see WEIGHTS_REUSE option for the alternative)
+            prepare_weights_tile(
+              shape,
+              to, ti,
+              weights + b * weights_batch,
+              weights_tile[tile * tiles_n + ti1]
+            );
+#endif
+          } // ti
+
+#ifdef WEIGHTS_REUSE
+          weights_index[tile] = b * shape.tiles_m() + to1;
+#endif
+          tile++;
+        } // col
+      } // row
+    } // to
+  } // b
+} // prepare_tiles()
+
+void prepare_descriptors(
+  const conv_shape_t &shape,
+  int image,
+  tile_desc_t desc[TILES]
+)
+{
+  int b, row, col, to1, tile;
+  int tiles_n = shape.tiles_n();
+
+  tile = 0;
+  for(b = 0; b < BATCHES; b++)
+  {
+    for(to1 = 0; to1 < shape.tiles_m(); to1++)
+    {
+      for(row = 0; row < shape.r; row += Tr)
+      {
+        for(col = 0; col < shape.c; col += Tc)
+        {
+#ifdef INPUT_ZERO_COPY
+          desc[tile].input = image * BATCHES + b;
+#else
+          desc[tile].input = image * TILES * TILES_N + tile * tiles_n;
+#endif
+#ifdef WEIGHTS_REUSE
+          desc[tile].weights =
+            image * WEIGHTS_TILES * TILES_N + (b * shape.tiles_m() + to1) * tiles_n;
+#else
+          desc[tile].weights = image * TILES * TILES_N + tile * tiles_n;
+#endif
+          desc[tile].row = row;
+          desc[tile].col = col;
+          desc[tile].reload = (row == 0) && (col == 0);
+          desc[tile].last = false;
+          tile++;
+        } // col
+      } // row
+    } // to
+  } // b
+} // prepare_descriptors()
+
+void manage_output_tiles(
+  const conv_shape_t &shape,
+  data_in_t output_tile[TILES][Tm][Tr][Tc],
+  data_in_t *output
+)
+{
+  manage_output_tiles(shape, output_tile, output, shape.r, shape.c, 0);
+}
+
+void manage_output_tiles(
+  const conv_shape_t &shape,
+  data_in_t output_tile[TILES][Tm][Tr][Tc],
+  data_in_t *output,
+  int rows, int cols, int pad,
+  bool pool
+)
+{
+  int b, row, col, to, tile;
+  size_t output_batch = (size_t) shape.m * rows * cols;
+
+  tile = 0;
+  for(b = 0; b < BATCHES; b++)
+  {
+    for(to = 0; to < shape.m; to += Tm)
+    {
+      for(row = 0; row < shape.r; row += Tr)
+      {
+        for(col = 0; col < shape.c; col += Tc)
+        {
+          manage_output_tile(
+            shape,
+            to, row, col,
+            output_tile[tile],
+            output + b * output_batch,
+            rows, cols, pad,
+            pool
+          );
+          tile++;
+        } // col
+      } // row
+    } // to
+  } // b
+} // manage_output_tiles()
+
+void conv_epilogue(
+  const conv_shape_t &shape,
+  const conv_epilogue_t &epilogue,
+  const data_in_t *output,
+  data_in_t *result,
+  int rows, int cols, int pad
+)
+{
+  int b, m, r, c;
+  size_t map;
+
+  for(b = 0; b < BATCHES; b++)
+  {
+    for(m = 0; m < shape.m; m++)
+    {
+      map = (size_t) (b * shape.m + m) * shape.r * shape.c;
+
+      // Epilogue of one output before pooling
+      auto value = [&](int y, int x) {
+        data_in_t v = output[map + y * shape.c + x];
+        if(epilogue.bias)
+          v += epilogue.bias[m];
+        if(epilogue.residual)
+          v += epilogue.residual[map + y * shape.c + x];
+        if(epilogue.relu && v.sign())
+          v = 0;
+        return v;
+      };
+
+      for(r = 0; r < epilogue.rows(shape); r++)
+      {
+        for(c = 0; c < epilogue.cols(shape); c++)
+        {
+          data_in_t v;
+
+          if(epilogue.pool)
+          {
+            // Max of the 2x2 window
+            data_in_t top = value(2 * r, 2 * c), bottom = value(2 * r + 1, 2 * c);
+            data_in_t top_right = value(2 * r, 2 * c + 1), bottom_right = value(2 * r + 1, 2 * c + 1);
+            top = MAX(top, top_right);
+            bottom = MAX(bottom, bottom_right);
+            v = MAX(top, bottom);
+          }
+          else
+            v = value(r, c);
+          result[((size_t) (b * shape.m + m) * rows + pad + r) * cols + pad + c] = v;
+        }
+      }
+    }
+  }
+} // conv_epilogue()
+
+void conv_epilogue(
+  const conv_shape_t &shape,
+  const conv_epilogue_t &epilogue,
+  const data_in_t *output,
+  data_in_t *result
+)
+{
+  conv_epilogue(shape, epilogue, output, result, epilogue.rows(shape), epilogue.cols(shape), 0);
+}
+
+bool conv_epilogue_fusable(const conv_shape_t &shape, const conv_epilogue_t &epilogue)
+{
+#ifdef EPILOGUE
+  return !epilogue.pool ||
+    (((shape.tiles_r() == 1) || (Tr % 2 == 0)) && ((shape.tiles_c() == 1) || (Tc % 2 == 0)));
+#else
+  (void) shape;
+  (void) epilogue;
+  return false;
+#endif
+}
+
+#ifdef EPILOGUE
+epilogue_t prepare_epilogue_tiles(
+  const conv_shape_t &shape,
+  const conv_epilogue_t &epilogue,
+  data_in_t bias_tile[TILES][Tm],
+  data_in_t residual_tile[TILES][Tm / Um][Tr][Tc][Um]
+)
+{
+  int b, row, col, to, tile;
+  int ito, ir, ic;
+  epilogue_t flags = 0;
+
+  if(epilogue.bias)
+    flags |= EPILOGUE_BIAS;
+  if(epilogue.residual)
+    flags |= EPILOGUE_RESIDUAL;
+  if(epilogue.relu)
+    flags |= EPILOGUE_RELU;
+  if(epilogue.pool)
+    flags |= EPILOGUE_POOL;
+
+  if(!epilogue.bias && !epilogue.residual)
+    return flags;
+
+  // Out of the shape: outputs are discarded
+  tile = 0;
+  for(b = 0; b < BATCHES; b++)
+  {
+    for(to = 0; to < shape.m; to += Tm)
+    {
+      for(row = 0; row < shape.r; row += Tr)
+      {
+        for(col = 0; col < shape.c; col += Tc)
+        {
+          for(ito = 0; ito < Tm; ito++)
+          {
+            bool inside = (to + ito < shape.m);
+
+            if(epilogue.bias)
+              bias_tile[tile][ito] = inside ? epilogue.bias[to + ito] : data_in_t(0);
+
+            if(!epilogue.residual)
+              continue;
+            for(ir = 0; ir < Tr; ir++)
+            {
+              for(ic = 0; ic < Tc; ic++)
+              {
+                residual_tile[tile][ito / Um][ir][ic][ito % Um] =
+                  (inside && (row + ir < shape.r) && (col + ic < shape.c)) ?
+                    epilogue.residual[(((size_t) b * shape.m + to + ito) * shape.r + row + ir) * shape.c + col + ic] :
+                    data_in_t(0);
+              }
+            }
+          }
+          tile++;
+        } // col
+      } // row
+    } // to
+  } // b
+
+  return flags;
+} // prepare_epilogue_tiles()
+#endif
+
+int conv_abft_shift(const conv_shape_t &shape, const conv_requant_t &requant)
+{
+  int m, mult, shift, abft_shift;
+
+  if(!requant.enabled())
+    return REQUANT_SHIFT;
+
+  // Checksums are data_in_t bits of data_out_t sums
+  abft_shift = data_in_t::width;
+  for(m = 0; m < shape.m; m++)
+  {
+    mult = requant.mult ? abs(requant.mult[m].to_int()) : 1;
+    if(mult == 0)
+      continue;
+    shift = (requant.shift ? requant.shift[m] : REQUANT_SHIFT) - ceillog2(mult);
+    abft_shift = MIN(abft_shift, MAX(shift, 0));
+  }
+  return abft_shift;
+} // conv_abft_shift()
+
+#ifdef REQUANT
+void prepare_requant_tiles(
+  const conv_shape_t &shape,
+  const conv_requant_t &requant,
+  data_in_t mult_tile[TILES][Tm],
+  shift_t shift_tile[TILES][Tm]
 )
 {
-  int ito, ir, ic;
+  int tile, to, ito;
+
+  // Tiles are in b, to, row, col order: maps out of the shape are zeros
+  for(tile = 0; tile < shape.tiles(); tile++)
+  {
+    to = Tm * ((tile / (shape.tiles_r() * shape.tiles_c())) % shape.tiles_m());
+    for(ito = 0; ito < Tm; ito++)
+    {
+      bool inside = (to + ito < shape.m);
+      mult_tile[tile][ito] = (inside && requant.mult) ? requant.mult[to + ito] : data_in_t(1);
+      shift_tile[tile][ito] = (inside && requant.shift) ? requant.shift[to + ito] : REQUANT_SHIFT;
+    }
+  }
+} // prepare_requant_tiles()
+#endif
+
+int failed_tiles(
+  const conv_shape_t &shape,
+#ifdef ENABLE_HARDWARE_ABFT
+  ap_uint<FAILED_BITS> failed_tile[],
+  int first,
+#elif defined(EPILOGUE)
+  data_in_t incs[TILES],
+  data_in_t outcs_tile[TILES],
+#else
+  data_in_t incs[TILES],
+  data_in_t output_tile[TILES][Tm][Tr][Tc],
+#endif
+  bool failed[TILES]
+)
+{
+  int tile, failedcount = 0;
+
+#ifdef ENABLE_HARDWARE_ABFT
+  for(tile = 0; tile < shape.tiles(); tile++)
+  {
+    failed[tile] = (failed_tile[(first + tile) / FAILED_BITS][(first + tile) % FAILED_BITS] != 0);
+    if(failed[tile])
+      failedcount++;
+  }
+#elif defined(EPILOGUE)
+  // Output checksums are taken by the accelerator before the epilogue
+  for(tile = 0; tile < shape.tiles(); tile++)
+  {
+    failed[tile] = (incs[tile] != outcs_tile[tile]);
+    if(failed[tile])
+      failedcount++;
+  }
+#else
+  data_out_t outcs;
+  int ito, ir, ic;
+
+  for(tile = 0; tile < shape.tiles(); tile++)
+  {
+    outcs = 0;
+
+    for(ito = 0; ito < Tm; ito++)
+    {
+      for(ir = 0; ir < Tr; ir++)
+      {
+        for(ic = 0; ic < Tc; ic++)
+        {
+          outcs += output_tile[tile][ito][ir][ic];
+        }
+      }
+    }
+    failed[tile] = (incs[tile] != data_in_t(outcs));
+    if(failed[tile])
+      failedcount++;
+  }
+#endif
+
+  return failedcount;
+} // failed_tiles()
+
+ConvSession::ConvSession()
+  : shape(max_shape)
+#ifdef INPUT_ZERO_COPY
+  , input_buffer(NULL)
+#else
+  , input_tile(NULL)
+#endif
+  , weights_tile(NULL)
+  , output_tile(NULL)
+#ifdef STREAMING
+  , desc(NULL)
+#endif
+  , epilogue(no_epilogue)
+  , fused(false)
+#ifdef EPILOGUE
+  , epilogue_hw(0)
+  , bias_tile(NULL)
+  , residual_tile(NULL)
+#endif
+  , epilogue_output(NULL)
+  , requant(no_requant)
+  , correction(false)
+#ifdef REQUANT
+  , abft_shift(REQUANT_SHIFT)
+  , mult_tile(NULL)
+  , shift_tile(NULL)
+#endif
+{}
+
+ConvSession::~ConvSession()
+{
+  teardown();
+}
+
+void ConvSession::init()
+{
+  if(ready())
+    return;
+
+  stats.phase[PHASE_ALLOC].start();
+
+#ifdef INPUT_ZERO_COPY
+  input_buffer =
+    (data_in_t (*) [N][RR][CC]) sds_alloc(
+    BATCHES * N * RR * CC *
+    sizeof(data_in_t)
+  );
+#else
+  input_tile =
+    (data_in_t (*) [Tn][Trr][Tcc]) sds_alloc(
+    TILES * TILES_N * Tn * Trr * Tcc *
+    sizeof(data_in_t)
+  );
+#endif
+  weights_tile =
+    (data_in_t (*) [Tn][Tm][K][K]) sds_alloc(
+#ifdef WEIGHTS_REUSE
+    WEIGHTS_TILES * TILES_N * Tn * Tm * K * K *
+#else
+    TILES * TILES_N * Tn * Tm * K * K *
+#endif
+    sizeof(data_in_t)
+  );
+  output_tile =
+    (data_in_t (*) [Tm][Tr][Tc]) sds_alloc(
+    TILES * Tm * Tr * Tc *
+    sizeof(data_in_t)
+  );
+#ifdef STREAMING
+  desc = (tile_desc_t *) sds_alloc(TILES * sizeof(tile_desc_t));
+#endif
+#ifdef EPILOGUE
+  bias_tile = (data_in_t (*) [Tm]) sds_alloc(TILES * Tm * sizeof(data_in_t));
+  residual_tile =
+    (data_in_t (*) [Tm / Um][Tr][Tc][Um]) sds_alloc(
+    TILES * Tm * Tr * Tc *
+    sizeof(data_in_t)
+  );
+#endif
+#ifdef REQUANT
+  mult_tile = (data_in_t (*) [Tm]) sds_alloc(TILES * Tm * sizeof(data_in_t));
+  shift_tile = (shift_t (*) [Tm]) sds_alloc(TILES * Tm * sizeof(shift_t));
+#endif
+
+  if(!ready())
+    err(-2, "memory allocation error");
+
+#ifdef INPUT_ZERO_COPY
+  // Smaller shapes do not overwrite the whole buffer
+  memset(input_buffer, 0, BATCHES * N * RR * CC * sizeof(data_in_t));
+#endif
+#ifdef PROFILING
+  for(int a = 0; a < ACTORS; a++)
+    profile_hw[a].iterations = profile_hw[a].stalls = 0;
+#endif
+
+  stats.phase[PHASE_ALLOC].stop();
+}
+
+void ConvSession::teardown()
+{
+  bool allocated = ready();
+
+  if(allocated)
+    stats.phase[PHASE_FREE].start();
+
+#ifdef INPUT_ZERO_COPY
+  if(input_buffer != NULL)
+    sds_free(input_buffer);
+#else
+  if(input_tile != NULL)
+    sds_free(input_tile);
+#endif
+  if(weights_tile != NULL)
+    sds_free(weights_tile);
+  if(output_tile != NULL)
+    sds_free(output_tile);
+#ifdef STREAMING
+  if(desc != NULL)
+    sds_free(desc);
+  desc = NULL;
+#endif
+#ifdef EPILOGUE
+  if(bias_tile != NULL)
+    sds_free(bias_tile);
+  if(residual_tile != NULL)
+    sds_free(residual_tile);
+  bias_tile = NULL;
+  residual_tile = NULL;
+#endif
+  delete[] epilogue_output;
+  epilogue_output = NULL;
+#ifdef REQUANT
+  if(mult_tile != NULL)
+    sds_free(mult_tile);
+  if(shift_tile != NULL)
+    sds_free(shift_tile);
+  mult_tile = NULL;
+  shift_tile = NULL;
+#endif
+
+#ifdef INPUT_ZERO_COPY
+  input_buffer = NULL;
+#else
+  input_tile = NULL;
+#endif
+  weights_tile = NULL;
+  output_tile = NULL;
+
+  if(allocated)
+    stats.phase[PHASE_FREE].stop();
+}
+
+#ifdef INPUT_ZERO_COPY
+data_in_t (*ConvSession::pinned_input())[N][RR][CC]
+{
+  return input_buffer;
+}
+
+#endif
+bool ConvSession::ready() const
+{
+  return
+#ifdef INPUT_ZERO_COPY
+    (input_buffer != NULL) &&
+#else
+    (input_tile != NULL) &&
+#endif
+    (weights_tile != NULL) &&
+#ifdef STREAMING
+    (desc != NULL) &&
+#endif
+#ifdef EPILOGUE
+    (bias_tile != NULL) &&
+    (residual_tile != NULL) &&
+#endif
+#ifdef REQUANT
+    (mult_tile != NULL) &&
+    (shift_tile != NULL) &&
+#endif
+    (output_tile != NULL);
+}
+
+void ConvSession::set_epilogue(const conv_epilogue_t &_epilogue)
+{
+  epilogue = _epilogue;
+}
+
+const conv_epilogue_t &ConvSession::get_epilogue() const
+{
+  return epilogue;
+}
+
+void ConvSession::set_requant(const conv_requant_t &_requant)
+{
+#ifndef REQUANT
+  if(_requant.enabled())
+    errx(-2, "requantization needs the REQUANT option");
+#endif
+  requant = _requant;
+}
+
+const conv_requant_t &ConvSession::get_requant() const
+{
+  return requant;
+}
+
+void ConvSession::set_correction(bool _correction)
+{
+#ifndef FINE_ABFT
+  if(_correction)
+    errx(-2, "ABFT correction needs the FINE_ABFT option");
+#endif
+  correction = _correction;
+}
+
+#ifdef FINE_ABFT
+// Index of the only bit set, -1 if none or several
+template<int W>
+static int single_bit(const ap_uint<W> &bits)
+{
+  int i, index = -1;
+
+  for(i = 0; i < W; i++)
+  {
+    if(bits[i])
+    {
+      if(index >= 0)
+        return -1;
+      index = i;
+    }
+  }
+  return index;
+}
+
+// Single-error correction (see set_correction()): the Tm / Um candidate
+// outputs are recomputed from the tile buffers of the last call, like the
+// accelerator. Returns corrected tiles (cleared in failed)
+int ConvSession::correct(bool *failed)
+{
+  data_in_t (*itile)[Trr][Tcc];
+#ifdef INPUT_ZERO_COPY
+  data_in_t input_tile[Tn][Trr][Tcc];
+  int b, row, col;
+#endif
+  data_out_t acc;
+  int tile, lane, ir, ic, ito, ti1, iti, i, j, corrected = 0;
+  int tiles_n = shape.tiles_n();
 
-  for(ito = 0; ito < Tm; ito++)
+  for(tile = 0; tile < shape.tiles(); tile++)
   {
-    for(ir = 0; ir < MIN(Tr, R - row); ir++)
+    if(!failed[tile])
+      continue;
+
+    lane = single_bit(region_tile[tile].lanes);
+    ir = single_bit(region_tile[tile].rows);
+    ic = single_bit(region_tile[tile].cols);
+    if((lane < 0) || (ir < 0) || (ic < 0))
+      continue;
+
+#ifdef WEIGHTS_REUSE
+    int wtile = weights_index[tile];
+#else
+    int wtile = tile;
+#endif
+
+    for(ito = lane; ito < Tm; ito += Um)
     {
-      for(ic = 0; ic < MIN(Tc, C - col); ic++)
+      acc = 0;
+      for(ti1 = 0; ti1 < tiles_n; ti1++)
       {
-        output[to + ito][row + ir][col + ic] =
-          output_tile[ito][ir][ic];
+#ifdef INPUT_ZERO_COPY
+        b = tile / (shape.tiles_m() * shape.tiles_r() * shape.tiles_c());
+        row = Tr * ((tile / shape.tiles_c()) % shape.tiles_r());
+        col = Tc * (tile % shape.tiles_c());
+        prepare_input_tile(ti1 * Tn, row, col, input_buffer[b], input_tile);
+        itile = input_tile;
+#else
+        itile = input_tile[tile * tiles_n + ti1];
+#endif
+        for(iti = 0; iti < Tn; iti++)
+          for(i = 0; i < K; i++)
+            for(j = 0; j < K; j++)
+              acc += weights_tile[wtile * tiles_n + ti1][iti][ito][i][j] *
+                itile[iti][S * ir + i][S * ic + j];
       }
+
+#ifdef REQUANT
+      output_tile[tile][ito][ir][ic] = data_in_t((requant_acc_t(acc) * mult_tile[tile][ito]) >> shift_tile[tile][ito]);
+#else
+      output_tile[tile][ito][ir][ic] = data_in_t(acc >> REQUANT_SHIFT);
+#endif
     }
+
+    failed[tile] = false;
+    corrected++;
   }
-}
 
-int convolution(
-  data_in_t input[BATCHES][N][RR][CC],
-  data_in_t weights[BATCHES][N][M][K][K],
-  data_in_t output[BATCHES][M][R][C],
-  bool failed[TILES],
-  bool doabft,
-  perf_counter *intern,
-  perf_counter *abft_sw
+  return corrected;
+} // ConvSession::correct()
+#endif
+
+void ConvSession::prepare(
+  const conv_shape_t &_shape,
+  const data_in_t *input,
+  const data_in_t *weights
 )
 {
-  // Tile loops indexes
-  int b, row, col, to, ti, tile;
-  int row1, col1, to1, ti1; // row = row1 * Tr
+  if(!ready())
+    errx(-2, "session used before init()");
+  if(!shape_fits(_shape))
+    errx(-2, "layer shape does not fit in the accelerator");
 
-  // Tiles (allocated on heap)
-  data_in_t (*input_tile)[TILES_N][Tn][Trr][Tcc];
-  data_in_t (*weights_tile)[TILES_N][Tn][Tm][K][K];
-  data_in_t (*output_tile)[Tm][Tr][Tc];
+  shape = _shape;
 
-  int failedcount = 0;
+  stats.phase[PHASE_PACK].start();
 
-  // ABFT
-#ifdef ENABLE_HARDWARE_ABFT
-  ap_uint<FAILED_BITS> failed_tile[FAILED_SIZE];
+  prepare_tiles(
+    shape,
+    input,
+    weights,
+#ifdef INPUT_ZERO_COPY
+    input_buffer,
 #else
-  data_in_t incs[TILES];
-  data_out_t outcs;
-  int ito, ir, ic;
+    input_tile,
+#endif
+    weights_tile
+#ifdef WEIGHTS_REUSE
+    , weights_index
 #endif
-
-  input_tile =
-    (data_in_t (*) [TILES_N][Tn][Trr][Tcc]) sds_alloc(
-    TILES * TILES_N * Tn * Trr * Tcc *
-    sizeof(data_in_t)
-  );
-  weights_tile =
-    (data_in_t (*) [TILES_N][Tn][Tm][K][K]) sds_alloc(
-    TILES * TILES_N * Tn * Tm * K * K *
-    sizeof(data_in_t)
-  );
-  output_tile =
-    (data_in_t (*) [Tm][Tr][Tc]) sds_alloc(
-    TILES * Tm * Tr * Tc *
-    sizeof(data_in_t)
   );
 
-  if((input_tile == NULL) ||
-    (weights_tile == NULL) ||
-    (output_tile == NULL))
-  {
-    err(-2, "memory allocation error");
-  }
+#ifdef STREAMING
+  prepare_descriptors(shape, 0, desc);
+  desc[shape.tiles() - 1].last = true;
+#endif
 
-  // Prepare data
-  tile = 0;
-  for(b = 0; b < BATCHES; b++)
+  // Otherwise, finish() runs the epilogue on the host
+  fused = epilogue.enabled() && conv_epilogue_fusable(shape, epilogue);
+#ifdef EPILOGUE
+  epilogue_hw = fused ? prepare_epilogue_tiles(shape, epilogue, bias_tile, residual_tile) : epilogue_t(0);
+#endif
+#ifdef REQUANT
+  if(requant.shift)
   {
-    for(to = 0, to1 = 0; to < M; to += Tm, to1++)
-    {
-      for(row = 0, row1 = 0; row < R; row += Tr, row1++)
-      {
-        for(col = 0, col1 = 0; col < C; col += Tc, col1++)
-        {
-          for(ti = 0, ti1 = 0; ti < N; ti += Tn, ti1++)
-          {
-            prepare_input_tile(
-              ti, row, col,
-              input[b],
-              input_tile[tile][ti1]
-            );
-
-            // Note that we could only send TILES_M * TILES_N weights tiles
-            // by interchanging loops row/col and ti in conv_compute_tile.
-            // But in this case we would need to receive more output tiles
-            // (TILES_N more). TILES_R and TILES_C are likely to be 1 so this
-            // solution is better
-            prepare_weights_tile(
-              to, ti,
-              weights[b],
-              weights_tile[tile][ti1]
-            );
-          } // ti
-
-          tile++;
-        } // col
-      } // row
-    } // to
-  } // b
+    for(int m = 0; m < shape.m; m++)
+      if((requant.shift[m] < 0) || (requant.shift[m] > REQUANT_SHIFT_MAX))
+        errx(-2, "requantization shift of map %d out of [0, %d]", m, REQUANT_SHIFT_MAX);
+  }
+  prepare_requant_tiles(shape, requant, mult_tile, shift_tile);
+  abft_shift = conv_abft_shift(shape, requant);
+#endif
 
+  stats.phase[PHASE_PACK].stop();
+} // ConvSession::prepare()
 
+void ConvSession::compute(
+  bool doabft,
+  perf_counter *intern,
+  perf_counter *abft_sw
+)
+{
+  stats.phase[PHASE_COMPUTE].start();
   if(intern != NULL)
     intern->start();
 
@@ -172,30 +932,106 @@ int convolution(
 #ifndef ENABLE_HARDWARE_ABFT
 #pragma SDS async(1)
 #endif
+#ifdef STREAMING
+  hw_toplevel_stream(
+    shape.tiles_n(),
+    desc,
+#ifdef INPUT_ZERO_COPY
+    input_buffer,
+#else
+    input_tile,
+#endif
+    weights_tile,
+#ifdef EPILOGUE
+    epilogue_hw,
+    bias_tile,
+    residual_tile,
+#endif
+#ifdef REQUANT
+    abft_shift,
+    mult_tile,
+    shift_tile,
+#endif
+    output_tile
+#ifdef ENABLE_HARDWARE_ABFT
+    , failed_tile
+#elif defined(EPILOGUE)
+    , outcs_tile
+#endif
+#ifdef FINE_ABFT
+    , region_tile
+#endif
+#ifdef PROFILING
+    , profile_hw
+#endif
+  );
+#else
   hw_toplevel(
+    shape.tiles_m(), shape.tiles_n(), shape.tiles_r(), shape.tiles_c(),
+#ifdef INPUT_ZERO_COPY
+    input_buffer,
+#else
     input_tile,
+#endif
     weights_tile,
+#ifdef WEIGHTS_REUSE
+    weights_index,
+#endif
+#ifdef EPILOGUE
+    epilogue_hw,
+    bias_tile,
+    residual_tile,
+#endif
+#ifdef REQUANT
+    abft_shift,
+    mult_tile,
+    shift_tile,
+#endif
     output_tile
 #ifdef ENABLE_HARDWARE_ABFT
     , failed_tile
+#elif defined(EPILOGUE)
+    , outcs_tile
+#endif
+#ifdef FINE_ABFT
+    , region_tile
+#endif
+#ifdef PROFILING
+    , profile_hw
 #endif
   );
+#endif
 
 #ifdef ENABLE_HARDWARE_ABFT
   if(intern != NULL)
     intern->stop();
+  stats.phase[PHASE_COMPUTE].stop();
+
+  (void) doabft;
+  (void) abft_sw;
 #else
   if(doabft)
   {
     if(abft_sw != NULL)
       abft_sw->start();
+    stats.phase[PHASE_ABFT].start();
 
     sw_incs(
+      shape,
+#ifdef INPUT_ZERO_COPY
+      input_buffer,
+#else
       input_tile,
+#endif
       weights_tile,
-      incs
+#ifdef WEIGHTS_REUSE
+      weights_index,
+#endif
+      incs,
+      requant
     );
 
+    stats.phase[PHASE_ABFT].stop();
     if(abft_sw != NULL)
       abft_sw->stop();
   }
@@ -204,74 +1040,236 @@ int convolution(
 #pragma SDS wait(1)
   if(intern != NULL)
     intern->stop();
+  stats.phase[PHASE_COMPUTE].stop();
 
 #endif
+} // ConvSession::compute()
+
+int ConvSession::finish(
+  data_in_t *output,
+  bool *failed,
+  bool doabft
+)
+{
+  return finish(output, epilogue.rows(shape), epilogue.cols(shape), 0, failed, doabft);
+}
+
+int ConvSession::finish(
+  data_in_t *output,
+  int rows, int cols, int pad,
+  bool *failed,
+  bool doabft
+)
+{
+  int failedcount = 0, correctedcount = 0;
 
   if(doabft)
   {
+    stats.phase[PHASE_GATHER].start();
+    failedcount = failed_tiles(
+      shape,
 #ifdef ENABLE_HARDWARE_ABFT
-    for(tile = 0; tile < TILES; tile++)
-    {
-      failed[tile] = (failed_tile[tile / FAILED_BITS][tile % FAILED_BITS] != 0);
-      if(failed[tile])
-        failedcount++;
-    }
+      failed_tile, 0,
+#elif defined(EPILOGUE)
+      incs, outcs_tile,
 #else
-    for(tile = 0; tile < TILES; tile++)
+      incs, output_tile,
+#endif
+      failed
+    );
+#ifdef FINE_ABFT
+    // Output tiles already hold epilogue outputs if it is fused
+    if(correction && !fused)
     {
-      outcs = 0;
-
-      for(ito = 0; ito < Tm; ito++)
-      {
-        for(ir = 0; ir < Tr; ir++)
-        {
-          for(ic = 0; ic < Tc; ic++)
-          {
-            outcs += output_tile[tile][ito][ir][ic];
-          }
-        }
-      }
-      failed[tile] = (incs[tile] != data_in_t(outcs));
-      if(failed[tile])
-        failedcount++;
+      correctedcount = correct(failed);
+      failedcount -= correctedcount;
     }
 #endif
+    stats.phase[PHASE_GATHER].stop();
   }
 
   // manage output tile
-  tile = 0;
-  for(b = 0; b < BATCHES; b++)
+  stats.phase[PHASE_SCATTER].start();
+  if(fused || !epilogue.enabled())
+    manage_output_tiles(shape, output_tile, output, rows, cols, pad, fused && epilogue.pool);
+  else
   {
-    for(to = 0, to1 = 0; to < M; to += Tm, to1++)
-    {
-      for(row = 0, row1 = 0; row < R; row += Tr, row1++)
-      {
-        for(col = 0, col1 = 0; col < C; col += Tc, col1++)
-        {
-          manage_output_tile(
-            to, row, col,
-            output_tile[tile],
-            output[b]
-          );
-          tile++;
-        } // col
-      } // row
-    } // to
-  } // b
+    if(epilogue_output == NULL)
+      epilogue_output = new data_in_t[(size_t) BATCHES * M * R * C];
+    manage_output_tiles(shape, output_tile, epilogue_output, shape.r, shape.c, 0);
+    conv_epilogue(shape, epilogue, epilogue_output, output, rows, cols, pad);
+  }
+  stats.phase[PHASE_SCATTER].stop();
+
+#ifdef EPILOGUE
+  stats.count(shape, failedcount, true, (epilogue_hw & EPILOGUE_RESIDUAL) != 0);
+#else
+  stats.count(shape, failedcount);
+#endif
+  stats.corrected += correctedcount;
+
+  return failedcount;
+} // ConvSession::finish()
+
+int ConvSession::run(
+  const conv_shape_t &_shape,
+  const data_in_t *input,
+  const data_in_t *weights,
+  data_in_t *output,
+  bool *failed,
+  bool doabft,
+  perf_counter *intern,
+  perf_counter *abft_sw
+)
+{
+  prepare(_shape, input, weights);
+  compute(doabft, intern, abft_sw);
+  return finish(output, failed, doabft);
+} // ConvSession::run()
+
+#ifdef PROFILING
+const hw_profile_t *ConvSession::profile() const
+{
+  return profile_hw;
+}
+#endif
+
+#ifdef FINE_ABFT
+const abft_region_t *ConvSession::failed_regions() const
+{
+  return region_tile;
+}
+#endif
 
-  sds_free(input_tile);
-  sds_free(weights_tile);
-  sds_free(output_tile);
+int ConvSession::run(
+  data_in_t input[BATCHES][N][RR][CC],
+  data_in_t weights[BATCHES][N][M][K][K],
+  data_in_t output[BATCHES][M][R][C],
+  bool failed[TILES],
+  bool doabft,
+  perf_counter *intern,
+  perf_counter *abft_sw
+)
+{
+  return run(
+    max_shape,
+    &input[0][0][0][0],
+    &weights[0][0][0][0][0],
+    &output[0][0][0][0],
+    failed,
+    doabft,
+    intern,
+    abft_sw
+  );
+} // ConvSession::run()
+
+void set_conv_backend(conv_backend_t _backend)
+{
+  backend = _backend;
+}
+
+conv_backend_t get_conv_backend()
+{
+  return backend;
+}
+
+int convolution(
+  const conv_shape_t &shape,
+  const data_in_t *input,
+  const data_in_t *weights,
+  data_in_t *output,
+  bool *failed,
+  bool doabft,
+  perf_counter *intern,
+  perf_counter *abft_sw,
+  conv_stats_t *stats
+)
+{
+  // One-shot session: tile buffers are allocated and freed for this call only
+  ConvSession session;
+  int failedcount;
+
+  if(backend == CONV_BACKEND_SIMD)
+  {
+    session.stats.phase[PHASE_COMPUTE].start();
+    failedcount = convolution_simd(
+      shape,
+      input,
+      weights,
+      output,
+      failed,
+      doabft,
+      intern,
+      abft_sw
+    );
+    session.stats.phase[PHASE_COMPUTE].stop();
+    session.stats.count(shape, failedcount, false);
+
+    if(stats != NULL)
+      stats->add(session.stats);
+    return failedcount;
+  }
+
+  session.init();
+  failedcount = session.run(
+    shape,
+    input,
+    weights,
+    output,
+    failed,
+    doabft,
+    intern,
+    abft_sw
+  );
+  session.teardown();
+
+  if(stats != NULL)
+    stats->add(session.stats);
 
   return failedcount;
 } // convolution()
 
+int convolution(
+  data_in_t input[BATCHES][N][RR][CC],
+  data_in_t weights[BATCHES][N][M][K][K],
+  data_in_t output[BATCHES][M][R][C],
+  bool failed[TILES],
+  bool doabft,
+  perf_counter *intern,
+  perf_counter *abft_sw,
+  conv_stats_t *stats
+)
+{
+  return convolution(
+    max_shape,
+    &input[0][0][0][0],
+    &weights[0][0][0][0][0],
+    &output[0][0][0][0],
+    failed,
+    doabft,
+    intern,
+    abft_sw,
+    stats
+  );
+} // convolution()
+
 #ifndef ENABLE_HARDWARE_ABFT
 
 void sw_incs(
-  data_in_t input_tile[TILES][TILES_N][Tn][Trr][Tcc],
-  data_in_t weights_tile[TILES][TILES_N][Tn][Tm][K][K],
-  data_in_t incs[TILES]
+  const conv_shape_t &shape,
+#ifdef INPUT_ZERO_COPY
+  data_in_t input[BATCHES][N][RR][CC],
+#else
+  data_in_t input_tile[TILES * TILES_N][Tn][Trr][Tcc],
+#endif
+#ifdef WEIGHTS_REUSE
+  data_in_t weights_tile[WEIGHTS_TILES * TILES_N][Tn][Tm][K][K],
+  int weights_index[TILES],
+#else
+  data_in_t weights_tile[TILES * TILES_N][Tn][Tm][K][K],
+#endif
+  data_in_t incs[TILES],
+  const conv_requant_t &requant
 )
 {
   // Note: we cannot perform an accurate output checksum with accelerator's output (in data_in_t format, not data_out_t).
@@ -279,12 +1277,27 @@ void sw_incs(
 
   data_out_t tmp[Tm][Tr][Tc];
   data_out_t incs_tmp;
+  data_in_t (*itile)[Trr][Tcc];
+#ifdef INPUT_ZERO_COPY
+  // Input tiles are not packed: pack the current one here
+  data_in_t input_tile[Tn][Trr][Tcc];
+  int b, row, col;
+#endif
 
   // Loop indexes
   int i, j, ir, ic, ito, iti, ti1, tile;
+  int tiles_n = shape.tiles_n();
 
-  for(tile = 0; tile < TILES; tile++)
+  for(tile = 0; tile < shape.tiles(); tile++)
   {
+#ifdef WEIGHTS_REUSE
+    int wtile = weights_index[tile];
+#else
+    int wtile = tile;
+#endif
+    // First output map of the tile (tiles are in b, to, row, col order)
+    int to = Tm * ((tile / (shape.tiles_r() * shape.tiles_c())) % shape.tiles_m());
+
     incs_tmp = 0;
     for(ir = 0; ir < Tr; ir++)
     {
@@ -297,8 +1310,19 @@ void sw_incs(
       }
     }
 
-    for(ti1 = 0; ti1 < TILES_N; ti1++)
+    for(ti1 = 0; ti1 < tiles_n; ti1++)
     {
+#ifdef INPUT_ZERO_COPY
+      // Input is in the synthesized layout
+      b = tile / (shape.tiles_m() * shape.tiles_r() * shape.tiles_c());
+      row = Tr * ((tile / shape.tiles_c()) % shape.tiles_r());
+      col = Tc * (tile % shape.tiles_c());
+      prepare_input_tile(ti1 * Tn, row, col, input[b], input_tile);
+      itile = input_tile;
+#else
+      itile = input_tile[tile * tiles_n + ti1];
+#endif
+
       for(ir = 0; ir < Tr; ir++)
       {
         for(ic = 0; ic < Tc; ic++)
@@ -312,8 +1336,8 @@ void sw_incs(
                 for(iti = 0; iti < Tn; iti++)
                 {
                   tmp[ito][ir][ic] +=
-                    weights_tile[tile][ti1][iti][ito][i][j] *
-                    input_tile[tile][ti1][iti][S * ir + i][S * ic + j];
+                    weights_tile[wtile * tiles_n + ti1][iti][ito][i][j] *
+                    itile[iti][S * ir + i][S * ic + j];
                 } // iti
               } // j
             } // i
@@ -328,7 +1352,9 @@ void sw_incs(
       {
         for(ito = 0; ito < Tm; ito++)
         {
-          incs_tmp += (tmp[ito][ir][ic] >> (data_in_t::width - 1));
+          incs_tmp += (to + ito < shape.m) ?
+            requant.apply(tmp[ito][ir][ic], to + ito) :
+            no_requant.apply(tmp[ito][ir][ic], 0);
         }
       }
     }
@@ -486,6 +1512,109 @@ void print_convolution_constants()
   ;
 }
 
+#ifdef PROFILING
+void print_profile(const hw_profile_t profile[ACTORS])
+{
+  static const char *actors[ACTORS] = {
+    "recv_input", "recv_weights", "incs", "conv", "outcs", "epilogue", "send_output"
+  };
+  static const char *fifos[FIFOS] = {
+    "section", "kernel", "row_section", "col_section", "output_fullp", "output", "epilogue"
+  };
+  unsigned int slowest = 1;
+  int a;
+
+  for(a = 0; a < ACTORS; a++)
+    slowest = MAX(slowest, (unsigned int) profile[a].iterations);
+
+  std::cerr << "actor iterations stalls load" << std::endl;
+  for(a = 0; a < ACTORS; a++)
+    std::cerr << actors[a] << " "
+      << (unsigned int) profile[a].iterations << " "
+      << (unsigned int) profile[a].stalls << " "
+      << (float) profile[a].iterations / slowest << std::endl;
+
+#ifndef __SYNTHESIS__
+  std::cerr << "fifo max_occupancy" << std::endl;
+  for(a = 0; a < FIFOS; a++)
+    std::cerr << fifos[a] << " " << hw_fifo_max[a] << std::endl;
+#else
+  (void) fifos;
+#endif
+}
+#endif
+
+transfer_volume_t transfer_volume(
+  int n, int m, int r, int c,
+  bool weights_reuse, bool input_zero_copy,
+  bool residual
+)
+{
+  transfer_volume_t volume;
+  size_t tiles_n = UPPERDIV(n, Tn);
+  size_t tiles_m = UPPERDIV(m, Tm);
+  size_t tiles = BATCHES * tiles_m * UPPERDIV(r, Tr) * UPPERDIV(c, Tc);
+  int rr = (r - 1) * S + K, cc = (c - 1) * S + K;
+  int row, col;
+
+  if(input_zero_copy)
+  {
+    // Only valid (non-padding) elements of each tile are read, and host
+    // just copies the input to pinned memory
+    volume.input = 0;
+    for(row = 0; row < r; row += Tr)
+      for(col = 0; col < c; col += Tc)
+        volume.input += MIN(Trr, rr - S * row) * MIN(Tcc, cc - S * col);
+    volume.input *= BATCHES * tiles_m * n * sizeof(data_in_t);
+    volume.packed = BATCHES * n * rr * cc * sizeof(data_in_t);
+  }
+  else
+  {
+    volume.input = tiles * tiles_n * Tn * Trr * Tcc * sizeof(data_in_t);
+    volume.packed = volume.input;
+  }
+
+  if(weights_reuse)
+  {
+    volume.weights = BATCHES * tiles_m * tiles_n * Tn * Tm * K * K * sizeof(data_in_t);
+    volume.packed += volume.weights;
+    volume.weights += tiles * sizeof(int); // weights_index
+  }
+  else
+  {
+    volume.weights = tiles * tiles_n * Tn * Tm * K * K * sizeof(data_in_t);
+    volume.packed += volume.weights;
+  }
+
+  volume.output = tiles * Tm * Tr * Tc * sizeof(data_in_t);
+
+  volume.side = 0;
+#ifdef ENABLE_HARDWARE_ABFT
+  volume.side += UPPERDIV(tiles, FAILED_BITS) * sizeof(ap_uint<FAILED_BITS>);
+#ifdef FINE_ABFT
+  volume.side += tiles * sizeof(abft_region_t);
+#endif
+#elif defined(EPILOGUE)
+  volume.side += tiles * sizeof(data_in_t); // outcs_tile
+#endif
+#ifdef EPILOGUE
+  volume.side += tiles * Tm * sizeof(data_in_t); // bias_tile
+  if(residual)
+  {
+    volume.side += tiles * Tm * Tr * Tc * sizeof(data_in_t);
+    volume.packed += tiles * Tm * Tr * Tc * sizeof(data_in_t);
+  }
+#else
+  (void) residual;
+#endif
+#ifdef REQUANT
+  volume.side += tiles * Tm * (sizeof(data_in_t) + sizeof(shift_t));
+  volume.packed += tiles * Tm * (sizeof(data_in_t) + sizeof(shift_t));
+#endif
+
+  return volume;
+}
+
 bool compatibility_check(int m, int n, int r, int c, int k, int s, int b)
 {
   return
@@ -497,3 +1626,13 @@ bool compatibility_check(int m, int n, int r, int c, int k, int s, int b)
     (S == s) &&
     (BATCHES == b);
 }
+
+bool shape_fits(const conv_shape_t &shape)
+{
+  return
+    (0 < shape.m) && (shape.m <= M) &&
+    (0 < shape.n) && (shape.n <= N) &&
+    (0 < shape.r) && (shape.r <= R) &&
+    (0 < shape.c) && (shape.c <= C) &&
+    (0 < shape.k) && (shape.k <= K);
+}
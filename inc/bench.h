@@ -0,0 +1,38 @@
+#ifndef __BENCH_H
+#define __BENCH_H
+
+#include "convolution.h"
+
+#include <ostream>
+#include <vector>
+
+// Result of one benchmark point: images computed one after another by a
+// session at one frequency, with or without ABFT
+struct bench_result_t
+{
+  float frequency;     // MHz
+  int images;
+  bool doabft;
+  double p50, p90, p99; // latency of one image (ms)
+  double images_per_s;
+  double gops;          // 2 operations per multiply-accumulate
+  double failure_rate;  // failed tiles / tiles
+};
+
+// Run one point on session (init() done, clock already set to frequency)
+// Inputs are random, generated before timing
+bench_result_t bench_point(
+  ConvSession &session,
+  float frequency,
+  int images,
+  bool doabft
+);
+
+// p-th percentile (0 to 100, nearest rank) of values, sorted in place
+double percentile(std::vector<double> &values, double p);
+
+// One CSV line per point
+void print_bench_header(std::ostream &os);
+void print_bench(std::ostream &os, const bench_result_t &result);
+
+#endif // __BENCH_H
@@ -9,12 +9,18 @@
 #include <cmath>      // ceil, floor
 #include <vector>
 #include <algorithm>  // std::sort
+#include <cstdio>     // FILE
+#include <chrono>     // lock latency
+#include <stdint.h>
 #include "options.sw.h"
 #include "ap_int.h"
 
 // Clocking wizard configuration base address
 #define BASEADDR  0x43C00000
 
+// Default settings table cache file (in working directory)
+#define CLKWIZ_CACHE "clkwiz_settings.bin"
+
 // Note: all frequencies are in MHz
 
 // Frequency bounds for MMCM mode (ds191) + margin for PFDMIN
@@ -36,13 +42,71 @@
 #define CLKFBOUT_FRAC    16
 #define CLKOUT0_FRAC     8
 
-// Configuration settings parameters
+// Default bound of lock polling (us)
+#define LOCK_TIMEOUT 10000
+
+// Register access of the clocking wizard
+// This default one has no hardware: writes are dropped, MMCM is always locked
+class ClkwizRegs
+{
+  public:
+    virtual ~ClkwizRegs() {}
+    virtual void write(int addr, ap_uint<32> value) {}
+    virtual ap_uint<32> read(int addr) { return (addr == SR) ? (1 << LOCKED) : 0; }
+};
+
+// Registers mapped from /dev/mem at BASEADDR
+class DevMemRegs : public ClkwizRegs
+{
+  private:
+    void *mem;
+
+  public:
+    DevMemRegs();
+    virtual ~DevMemRegs();
+    virtual void write(int addr, ap_uint<32> value);
+    virtual ap_uint<32> read(int addr);
+};
+
+// Simulated register file (e.g for tests): writes are stored and counted, and
+// the MMCM unlocks for delay us on each reload (negative: never locks again)
+class MockClkwizRegs : public ClkwizRegs
+{
+  private:
+    ap_uint<32> regs[1024];
+    int count[1024];
+    long delay;
+    std::chrono::steady_clock::time_point locked_at;
+
+  public:
+    MockClkwizRegs(long _delay = 0);
+    void setDelay(long _delay);
+    int writes(int addr) const; // writes to a register since construction
+    virtual void write(int addr, ap_uint<32> value);
+    virtual ap_uint<32> read(int addr);
+};
+
+// Histogram of lock latencies (ns): bucket 0 is under 1 us, bucket i holds
+// [2^(i-1), 2^i) us (last one: everything above)
+#define LATENCY_BUCKETS 16
+struct LatencyHistogram
+{
+  uint64_t bucket[LATENCY_BUCKETS];
+  uint64_t count, total, min, max;
+  LatencyHistogram();
+  void reset();
+  void add(uint64_t ns);
+  uint64_t mean() const;
+};
+
+// Configuration settings parameters (value type, stored in flat tables)
 struct Settings
 {
-  const ap_ufixed<11, 8> clkfbout;
-  const ap_uint<8> divclk_divide;
-  const ap_ufixed<11, 8> clkout0_divide;
-  const float out;
+  ap_ufixed<11, 8> clkfbout;
+  ap_uint<8> divclk_divide;
+  ap_ufixed<11, 8> clkout0_divide;
+  float out;
+  Settings() : out(0.f) {}
   Settings(ap_ufixed<11, 8> _clkfbout, ap_uint<8> _divclk_divide, ap_ufixed<11, 8> _clkout0_divide, float _out);
   float getPFD() const;
   float getVCO() const;
@@ -52,36 +116,72 @@ struct Settings
 class Clkwiz
 {
   private:
-    void *mem;
+    ClkwizRegs *regs;
+    bool own_regs;
 
     void memWrite(int addr, ap_uint<32> value);
     ap_uint<32> memRead(int addr);
 
-    std::vector<Settings*> settings;
-    void findSettings();
+    std::vector<Settings> settings; // sorted by frequency
+    std::vector<int> nearest;       // settings index nearest to minfreq + i * step
+    void findSettings(const char *cache);
+    void indexSettings();
 
     float minfreq;
     float maxfreq;
     float step;
-    std::vector<Settings*>::iterator state; // current settings
+    std::vector<Settings>::iterator state; // current settings
+
+    // Last register values written (only changed ones are written again)
+    bool written;
+    ap_uint<32> cr0, clkout0;
+
+    long timeout;        // lock polling bound (us)
+    int timeouts;        // reconfigurations which did not lock in time
+    LatencyHistogram latency;
 
     bool isLocked();
+    bool waitLocked();
     void reset();
-    void configure(const Settings& settings);
+    bool configure(const Settings& settings);
 
   public:
-    Clkwiz(float _minfreq, float _maxfreq, float _step);
+    // cache: file where the settings table is saved, and loaded by next
+    // instances with the same parameters (NULL: computed each time)
+    // regs: register backend, not owned (NULL: /dev/mem with ENABLE_CLKWIZ,
+    // no hardware otherwise)
+    Clkwiz(float _minfreq, float _maxfreq, float _step, const char *cache = NULL, ClkwizRegs *_regs = NULL);
     virtual ~Clkwiz();
 
+    // Configuration methods return 0 if the MMCM did not lock (settings and
+    // index() are then unchanged)
     float restart();  // configure with the first frequency (and return it)
     float next();     // configure with the next frequency (and return it) /!\ test end() before
     float previous(); // configure with the previous frequency (and return it) /!\ test against settings.begin() before
     bool end() const; // test if we passed the end
     int count() const;// return number of possible clocks
+    float select(int index);         // configure with the index-th frequency (and return it)
+    int index() const;               // index of current frequency
+    float frequency(int index) const;// index-th frequency (no configuration)
+    float setFrequency(float freq);  // configure with the nearest frequency, in O(1) (and return it)
+
+    // Reconfiguration instrumentation: latency from reload to lock of each
+    // switch, and switches which did not lock before timeout
+    const LatencyHistogram &lockLatency() const;
+    int timeoutCount() const;
+    void setTimeout(long us);
+
+    // Settings table: one legal settings by step from minfreq to maxfreq
+    static std::vector<Settings> generate(float minfreq, float maxfreq, float step);
+    // Save or load a table for these parameters (false on failure/mismatch)
+    // stub: table of the stub wizard, only loaded when stub is given too
+    // (other tables are checked against MMCM bounds on load)
+    static bool saveSettings(const char *path, const std::vector<Settings> &settings, float minfreq, float maxfreq, float step, bool stub = false);
+    static bool loadSettings(const char *path, std::vector<Settings> &settings, float minfreq, float maxfreq, float step, bool stub = false);
 };
 
 // Helper functions
-bool settings_cmp(Settings* a, Settings* b);
+bool settings_cmp(const Settings &a, const Settings &b);
 float ceil8(float value); // ceil to multiple of .125
 float floor8(float value); // floor to multiple of .125
 void extract_int_frac(ap_ufixed<11, 8> fix, ap_uint<8> *integer, ap_uint<10> *frac);
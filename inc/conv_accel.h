@@ -20,74 +20,508 @@ typedef ap_int<data_in_t::width + ceillog2(Tm)> kernel_t;
 
 #define TILES (BATCHES * TILES_M * TILES_R * TILES_C)
 
+// Distinct weight tiles (output tiles only differing by rows/columns share weights)
+#define WEIGHTS_TILES (BATCHES * TILES_M)
+
 // Tradeoff between big array/bit wordlength
 #define FAILED_BITS 32
 #define FAILED_SIZE (UPPERDIV(TILES, 32))
 
+// Input-checksum sections: rows (resp. columns) of an input tile are grouped
+// by the kernel rows they are multiplied with. With a tile of t outputs,
+// stride s and kernel size k (length (t - 1) * s + k), there are k - 1 top
+// rows, s classes of rows (modulo s) and k - 1 bottom rows
+#define SECTIONS (2 * (K - 1) + S)
+
+// Section of row y
+static inline int hw_section(int y, int s, int k, int t)
+{
+#pragma HLS INLINE
+  int length = (t - 1) * s + k;
+  if(y < k - 1)
+    return y;
+  else if(y <= length - k)
+    return k - 1 + (y + s - 1) % s;
+  else
+    return y - length + 2 * k - 2 + s;
+}
+
+// Row y is the first (resp. last) one of its section
+static inline bool hw_section_first(int y, int s, int k, int t)
+{
+#pragma HLS INLINE
+  return (y < k - 1 + s) || (y > (t - 1) * s);
+}
+static inline bool hw_section_last(int y, int s, int k, int t)
+{
+#pragma HLS INLINE
+  return (y < k - 1) || (y > (t - 2) * s);
+}
+
+// Rows of section sec are multiplied by kernel row i
+static inline bool hw_section_has(int sec, int i, int s, int k, int t)
+{
+#pragma HLS INLINE
+  int y;
+  if(sec < k - 1)
+    y = sec;
+  else if(sec < k - 1 + s)
+    return (i + s - 1) % s == sec - (k - 1);
+  else
+    y = sec + (t - 1) * s - k + 2 - s;
+  return (y >= i) && ((y - i) % s == 0) && ((y - i) / s < t);
+}
+
+// Streaming top-level: tiles of several calls (up to STREAM_BATCHES batches)
+// are processed in one hardware call, following descriptors until the last
+// one. Arrays of the call (descriptors, failed bits, regions) are sized for
+// this bound
+#define STREAM_TILES (STREAM_BATCHES * TILES_M * TILES_R * TILES_C)
+#define STREAM_FAILED_SIZE (UPPERDIV(STREAM_TILES, 32))
+
+// Streaming top-level: descriptor of one output tile
+struct tile_desc_t
+{
+  int input;    // first input tile index (INPUT_ZERO_COPY: input batch index)
+  int weights;  // first weights tile index
+  int row, col; // output tile position (INPUT_ZERO_COPY only)
+  bool reload;  // weights differ from previous tile (WEIGHTS_REUSE only)
+  bool last;    // last tile of the stream
+};
+
+#ifdef EPILOGUE
+// Epilogue stages (bits of epilogue_t), applied in this order to outputs of
+// an output tile, after the ABFT output checksum. Arithmetic wraps like
+// data_in_t. The 2x2 max-pool keeps the top-left [Tr / 2][Tc / 2] of an
+// output tile (then zeros): pooling windows must not cross tiles
+#define EPILOGUE_BIAS     1 // per output map
+#define EPILOGUE_RESIDUAL 2 // elementwise add
+#define EPILOGUE_RELU     4
+#define EPILOGUE_POOL     8
+typedef ap_uint<4> epilogue_t;
+#endif
+
+// Requantization: output of map m is data_in_t((acc * mult[m]) >> shift[m])
+// from its full-precision accumulator acc, wrapping like data_in_t. The fixed
+// rescale (without REQUANT option, or by default) is mult 1 and shift
+// REQUANT_SHIFT
+#define REQUANT_SHIFT (DATA_WL - 1)
+typedef ap_uint<8> shift_t;
+typedef ap_int<data_out_t::width + data_in_t::width> requant_acc_t;
+#define REQUANT_SHIFT_MAX (requant_acc_t::width - 1)
+
+// hw_outcs() is in the dataflow for the output checksum (ENABLE_HARDWARE_ABFT)
+// and/or requantization (REQUANT): hw_conv() sends it full-precision outputs
+#if defined(ENABLE_HARDWARE_ABFT) || defined(REQUANT)
+#define HW_OUTCS
+#endif
+
+// Fine-grained ABFT only refines hardware ABFT
+#if defined(FINE_ABFT) && !defined(ENABLE_HARDWARE_ABFT)
+#undef FINE_ABFT
+#endif
+
+#ifdef FINE_ABFT
+// Fine-grained ABFT: besides the tile checksum, an output tile has one checksum
+// per lane (output maps ito with ito % Um == lane, i.e an output FIFO of
+// hw_conv()), one per output row and one per output column, each with its own
+// decomposition of the input checksum. A bit is set for each failed one:
+// faulty outputs are in failed lanes x rows x columns. A single faulty output
+// is thus located among the Tm / Um maps of its lane
+struct abft_region_t
+{
+  ap_uint<Um> lanes;
+  ap_uint<Tr> rows;
+  ap_uint<Tc> cols;
+
+  // Outputs to recompute (all of them along a dimension without failure)
+  int outputs() const
+  {
+    int l = 0, r = 0, c = 0;
+    for(int i = 0; i < Um; i++)
+      l += lanes[i];
+    for(int i = 0; i < Tr; i++)
+      r += rows[i];
+    for(int i = 0; i < Tc; i++)
+      c += cols[i];
+    return (l ? l : Um) * (Tm / Um) * (r ? r : Tr) * (c ? c : Tc);
+  }
+};
+#endif
+
+#if defined(ENABLE_HARDWARE_ABFT) && !defined(__SYNTHESIS__)
+// C simulation fault injection: hw_outcs() adds delta to the full-precision
+// output (map m, row r, column c) of output tile `tile` (index in the top-level
+// call), as a timing error in hw_conv() would. Entries with a null delta are
+// unused (all by default)
+#define HW_FAULTS 4
+struct hw_fault_t
+{
+  int tile, m, r, c;
+  data_out_t delta;
+};
+extern hw_fault_t hw_faults[HW_FAULTS];
+#endif
+
+#ifdef PROFILING
+// Profiling: dataflow actors of hw_dataflow()
+enum hw_actor_t
+{
+  ACTOR_RECV_INPUT,
+  ACTOR_RECV_WEIGHTS,
+  ACTOR_INCS,  // ENABLE_HARDWARE_ABFT only
+  ACTOR_CONV,
+  ACTOR_OUTCS, // HW_OUTCS only
+  ACTOR_EPILOGUE, // EPILOGUE only
+  ACTOR_SEND_OUTPUT,
+  ACTORS
+};
+
+// Counters of one actor during a top-level call.
+// iterations: of its pipelined loops, i.e cycles at II=1 (same in C simulation)
+// stalls: FIFO accesses finding it empty (read) or full (write), always 0 in C
+// simulation where actors run one after another
+struct hw_profile_t
+{
+  ap_uint<32> iterations;
+  ap_uint<32> stalls;
+};
+
+// Dataflow FIFOs. In C simulation, hw_fifo_max holds their max occupancy
+// during the last top-level call: the depth needed for actors not to block
+enum hw_fifo_t
+{
+  FIFO_SECTION,      // hw_recv_input -> hw_incs
+  FIFO_KERNEL,       // hw_recv_weights -> hw_incs
+  FIFO_ROW_SECTION,  // hw_recv_input -> hw_incs (FINE_ABFT only, max of all)
+  FIFO_COL_SECTION,  // hw_recv_input -> hw_incs (FINE_ABFT only, max of all)
+  FIFO_OUTPUT_FULLP, // hw_conv -> hw_outcs (HW_OUTCS only)
+  FIFO_OUTPUT,       // hw_conv or hw_outcs -> hw_epilogue or hw_send_output
+  FIFO_EPILOGUE,     // hw_epilogue -> hw_send_output
+  FIFOS
+};
+#ifndef __SYNTHESIS__
+extern unsigned int hw_fifo_max[FIFOS];
+#endif
+#endif
+
+// Runtime layer shape: each dimension up to the synthesized one (N, M, R, C
+// and K are maxima). Stride S and BATCHES are fixed. A smaller kernel is
+// zero-padded to K x K, so the accelerator computes the same number of MACs.
+// Tensors of a runtime shape are dense row-major arrays:
+// input[BATCHES][n][rr][cc], weights[BATCHES][n][m][k][k], output[BATCHES][m][r][c]
+struct conv_shape_t
+{
+  int n, m, r, c, k;
+
+  int rr() const { return (r - 1) * S + k; }
+  int cc() const { return (c - 1) * S + k; }
+  int tiles_n() const { return UPPERDIV(n, Tn); }
+  int tiles_m() const { return UPPERDIV(m, Tm); }
+  int tiles_r() const { return UPPERDIV(r, Tr); }
+  int tiles_c() const { return UPPERDIV(c, Tc); }
+  int tiles() const { return BATCHES * tiles_m() * tiles_r() * tiles_c(); }
+  bool operator==(const conv_shape_t &other) const
+  {
+    return (n == other.n) && (m == other.m) && (r == other.r) &&
+      (c == other.c) && (k == other.k);
+  }
+};
+
+// Synthesized shape (compile-time dimensions)
+const conv_shape_t max_shape = {N, M, R, C, K};
+
+// Requantization of a layer (see requant_acc_t): runs in the accelerator with
+// REQUANT option, and in golden_convolution()
+struct conv_requant_t
+{
+  const int *shift;      // [m] up to REQUANT_SHIFT_MAX, NULL: REQUANT_SHIFT
+  const data_in_t *mult; // [m], NULL: 1
+
+  bool enabled() const { return shift || mult; }
+  data_in_t apply(const data_out_t &acc, int m) const
+  {
+    requant_acc_t product = requant_acc_t(acc) * requant_acc_t(mult ? mult[m] : data_in_t(1));
+    return data_in_t(product >> (shift ? shift[m] : REQUANT_SHIFT));
+  }
+};
+const conv_requant_t no_requant = {NULL, NULL};
+
 // Accelerator top-level: computes a convolution tile & abft
+// Layer shape is given at runtime in tiles (up to the synthesized one): the
+// tiles_n input tiles of each output tile are consecutive
 void hw_toplevel(
+  // Runtime shape
+  int tiles_m, int tiles_n, int tiles_r, int tiles_c,
+
   // Inputs
-  data_in_t input_tile[TILES][TILES_N][Tn][Trr][Tcc],
-  data_in_t weights_tile[TILES][TILES_N][Tn][Tm][K][K],
+#ifdef INPUT_ZERO_COPY
+  // Whole input, tiles are read directly (no host packing)
+  data_in_t input[BATCHES][N][RR][CC],
+#else
+  data_in_t input_tile[TILES * TILES_N][Tn][Trr][Tcc],
+#endif
+#ifdef WEIGHTS_REUSE
+  // Each weight tile is sent once, weights_index gives the one of each output tile
+  // (non-decreasing: output tiles sharing weights are consecutive)
+  data_in_t weights_tile[WEIGHTS_TILES * TILES_N][Tn][Tm][K][K],
+  int weights_index[TILES],
+#else
+  data_in_t weights_tile[TILES * TILES_N][Tn][Tm][K][K],
+#endif
+#ifdef EPILOGUE
+  // Epilogue (see epilogue_t): bias and residual of each output tile
+  epilogue_t epilogue,
+  data_in_t bias_tile[TILES][Tm],
+  data_in_t residual_tile[TILES][Tm / Um][Tr][Tc][Um],
+#endif
+#ifdef REQUANT
+  // Requantization of each output tile, and shift of the ABFT checksums
+  // (see conv_abft_shift())
+  shift_t abft_shift,
+  data_in_t mult_tile[TILES][Tm],
+  shift_t shift_tile[TILES][Tm],
+#endif
 
   // Outputs
   data_in_t output_tile[TILES][Tm][Tr][Tc]
 
 #ifdef ENABLE_HARDWARE_ABFT
   , ap_uint<FAILED_BITS> failed[FAILED_SIZE]
+#elif defined(EPILOGUE)
+  // Output checksums (before the epilogue) for software ABFT
+  , data_in_t outcs_tile[TILES]
+#endif
+#ifdef FINE_ABFT
+  // Failed lanes, rows and columns of each output tile
+  , abft_region_t region[TILES]
+#endif
+#ifdef PROFILING
+  , hw_profile_t profile[ACTORS]
+#endif
+);
+
+// Accelerator streaming top-level: computes the output tiles given by
+// descriptors (until the last one) & abft. Selected with STREAMING option
+void hw_toplevel_stream(
+  // Runtime shape: input tiles per output tile
+  int tiles_n,
+
+  // Inputs
+  tile_desc_t desc[STREAM_TILES],
+#ifdef INPUT_ZERO_COPY
+  data_in_t input[STREAM_BATCHES][N][RR][CC],
+#else
+  data_in_t input_tile[STREAM_TILES * TILES_N][Tn][Trr][Tcc],
+#endif
+  data_in_t weights_tile[STREAM_TILES * TILES_N][Tn][Tm][K][K],
+#ifdef EPILOGUE
+  // Epilogue (see epilogue_t): bias and residual of each output tile
+  epilogue_t epilogue,
+  data_in_t bias_tile[STREAM_TILES][Tm],
+  data_in_t residual_tile[STREAM_TILES][Tm / Um][Tr][Tc][Um],
+#endif
+#ifdef REQUANT
+  // Requantization of each output tile, and shift of the ABFT checksums
+  shift_t abft_shift,
+  data_in_t mult_tile[STREAM_TILES][Tm],
+  shift_t shift_tile[STREAM_TILES][Tm],
+#endif
+
+  // Outputs
+  data_in_t output_tile[STREAM_TILES][Tm][Tr][Tc]
+
+#ifdef ENABLE_HARDWARE_ABFT
+  , ap_uint<FAILED_BITS> failed[STREAM_FAILED_SIZE]
+#elif defined(EPILOGUE)
+  , data_in_t outcs_tile[STREAM_TILES]
+#endif
+#ifdef FINE_ABFT
+  , abft_region_t region[STREAM_TILES]
+#endif
+#ifdef PROFILING
+  , hw_profile_t profile[ACTORS]
+#endif
+);
+
+// Dataflow region of both top-levels: one input tile of one output tile
+// Tile arrays have the bound of the caller (TILES or STREAM_TILES), as in
+// hw_epilogue() and hw_compare_cs()
+template<int TILES_HW>
+void hw_dataflow(
+  bool start, bool end, bool last,
+  ap_uint<1> pingpong,
+  int tile,
+#ifdef INPUT_ZERO_COPY
+  int ti, int row, int col,
+  data_in_t input[N][RR][CC],
+#else
+  data_in_t input_tile[Tn][Trr][Tcc],
+#endif
+#ifdef WEIGHTS_REUSE
+  bool reload, int ti1,
+#endif
+  data_in_t weights_tile[Tn][Tm][K][K],
+#ifdef EPILOGUE
+  epilogue_t epilogue,
+  data_in_t bias_tile[Tm],
+  data_in_t residual_tile[Tm / Um][Tr][Tc][Um],
+#endif
+#ifdef REQUANT
+  shift_t abft_shift,
+  data_in_t mult_tile[Tm],
+  shift_t shift_tile[Tm],
+#endif
+  data_in_t output_tile[Tm][Tr][Tc]
+#ifdef ENABLE_HARDWARE_ABFT
+  , ap_uint<FAILED_BITS> failed[UPPERDIV(TILES_HW, 32)]
+#elif defined(EPILOGUE)
+  , data_in_t outcs_tile[TILES_HW]
+#endif
+#ifdef FINE_ABFT
+  , abft_region_t region[TILES_HW]
+#endif
+#ifdef PROFILING
+  , hw_profile_t profile[ACTORS]
 #endif
 );
 
 // Dataflow actors
 void hw_recv_input(
+#ifdef INPUT_ZERO_COPY
+  int ti, int row, int col,
+  data_in_t input_whole[N][RR][CC],
+#else
   data_in_t input_tile[Tn][Trr][Tcc],
+#endif
   data_in_t input_tile_hw[Tn][Trr][Tcc]
 #ifdef ENABLE_HARDWARE_ABFT
   , hls::stream<section_t>& section_fifo
 #endif
+#ifdef FINE_ABFT
+  , hls::stream<section_t> row_section_fifo[SECTIONS]
+  , hls::stream<section_t> col_section_fifo[SECTIONS]
+#endif
+#ifdef PROFILING
+  , hw_profile_t &profile
+#endif
 );
 void hw_recv_weights(
+#ifdef WEIGHTS_REUSE
+  bool reload, int ti1,
+#endif
   data_in_t weights_tile[Tn][Tm][K][K],
   data_in_t weights_tile_hw[Tn][Tm][K][K]
 #ifdef ENABLE_HARDWARE_ABFT
   , hls::stream<kernel_t>& kernel_fifo
 #endif
+#ifdef PROFILING
+  , hw_profile_t &profile
+#endif
 );
 void hw_send_output(
   bool end,
+#ifdef EPILOGUE
+  bool pool,
+#endif
   hls::stream<data_in_t> output_fifo[Um],
   data_in_t output_tile[Tm][Tr][Tc]
+#ifdef PROFILING
+  , hw_profile_t &profile
+#endif
 );
 void hw_conv(
   bool start, bool end,
   ap_uint<1> pingpong,
   data_in_t input_tile_hw[Tn][Trr][Tcc],
   data_in_t weights_tile_hw[Tn][Tm][K][K],
-#ifdef ENABLE_HARDWARE_ABFT
+#ifdef HW_OUTCS
   hls::stream<data_out_t> output_fifo_fullp[Um]
 #else
   hls::stream<data_in_t> output_fifo[Um]
 #endif
+#ifdef PROFILING
+  , hw_profile_t &profile
+#endif
+);
+#ifdef EPILOGUE
+template<int TILES_HW>
+void hw_epilogue(
+  bool end,
+  int tile,
+  epilogue_t epilogue,
+  data_in_t bias_tile[Tm],
+  data_in_t residual_tile[Tm / Um][Tr][Tc][Um],
+  hls::stream<data_in_t> output_fifo[Um],
+  hls::stream<data_in_t> epilogue_fifo[Um]
+#ifndef ENABLE_HARDWARE_ABFT
+  , data_in_t outcs_tile[TILES_HW]
+#endif
+#ifdef PROFILING
+  , hw_profile_t &profile
+#endif
+);
+#endif
+#ifdef HW_OUTCS
+void hw_outcs(
+  bool end,
+  int tile,
+#ifdef REQUANT
+  shift_t abft_shift,
+  data_in_t mult_tile[Tm],
+  shift_t shift_tile[Tm],
+#endif
+  hls::stream<data_out_t> output_fifo_fullp[Um],
+  hls::stream<data_in_t> output_fifo[Um]
+#ifdef ENABLE_HARDWARE_ABFT
+  , data_in_t *outcs
+#endif
+#ifdef FINE_ABFT
+  , data_in_t outcs_lane[Um]
+  , data_in_t outcs_row[Tr]
+  , data_in_t outcs_col[Tc]
+#endif
+#ifdef PROFILING
+  , hw_profile_t &profile
+#endif
 );
+#endif
 #ifdef ENABLE_HARDWARE_ABFT
 void hw_incs(
   bool start, bool end,
+#ifdef REQUANT
+  shift_t abft_shift,
+#endif
   hls::stream<section_t>& section_fifo,
   hls::stream<kernel_t>& kernel_fifo,
+#ifdef FINE_ABFT
+  hls::stream<section_t> row_section_fifo[SECTIONS],
+  hls::stream<section_t> col_section_fifo[SECTIONS],
+  data_in_t incs_lane[Um],
+  data_in_t incs_row[Tr],
+  data_in_t incs_col[Tc],
+#endif
   data_in_t *incs
+#ifdef PROFILING
+  , hw_profile_t &profile
+#endif
 );
-void hw_outcs(
-  bool end,
-  hls::stream<data_out_t> output_fifo_fullp[Um],
-  hls::stream<data_in_t> output_fifo[Um],
-  data_in_t *outcs
-);
+template<int TILES_HW>
 void hw_compare_cs(
-  bool end,
+  bool end, bool last,
   data_in_t incs,
   data_in_t outcs,
-  ap_uint<ceillog2(TILES)> tile,
-  ap_uint<FAILED_BITS> failed[FAILED_SIZE]
+#ifdef FINE_ABFT
+  data_in_t incs_lane[Um],
+  data_in_t outcs_lane[Um],
+  data_in_t incs_row[Tr],
+  data_in_t outcs_row[Tr],
+  data_in_t incs_col[Tc],
+  data_in_t outcs_col[Tc],
+  abft_region_t region[TILES_HW],
+#endif
+  int tile,
+  ap_uint<FAILED_BITS> failed[UPPERDIV(TILES_HW, 32)]
 );
 #endif
 
@@ -0,0 +1,65 @@
+#ifndef __CONV_HYBRID_H
+#define __CONV_HYBRID_H
+
+#include "convolution.h"
+#include "conv_simd.h"
+
+#include <vector>
+
+// CPU + accelerator work splitting of one layer. Output tiles are split along
+// output maps, in units of Tm maps (one output tile per batch, row and column
+// tile): the accelerator computes the first units while a host thread
+// computes the last ones with convolution_simd().
+// The CPU share is static, or adaptive: per-unit cost is measured on each side
+// on each call, and the split is rebalanced so that both finish together.
+class ConvHybrid
+{
+  private:
+    ConvSession session;
+    double cpu_fraction; // CPU share of output tiles for next call
+    bool adaptive;
+    double hw_cost;      // measured time per unit (0: not measured yet)
+    double cpu_cost;
+
+    // Weights and outputs of each part
+    std::vector<data_in_t> weights_hw, weights_cpu, output_hw, output_cpu;
+    bool failed_hw[TILES];
+
+    // Session is owned: no copy
+    ConvHybrid(const ConvHybrid&) = delete;
+    ConvHybrid& operator=(const ConvHybrid&) = delete;
+
+  public:
+    // Time spent by each side, and end-to-end
+    perf_counter hw, cpu, total;
+
+    ConvHybrid(double _cpu_fraction = 0.5, bool _adaptive = true);
+    virtual ~ConvHybrid();
+
+    void init();       // allocate accelerator session (no-op if done)
+    void teardown();   // free accelerator session
+    bool ready() const;// test if init() is done
+
+    // Same as convolution(): failed tiles are only reported for the
+    // accelerator part (no ABFT on the CPU)
+    int run(
+      data_in_t input[BATCHES][N][RR][CC],
+      data_in_t weights[BATCHES][N][M][K][K],
+      data_in_t output[BATCHES][M][R][C],
+      bool failed[TILES],
+      bool doabft = true
+    );
+    int run(
+      const conv_shape_t &shape,
+      const data_in_t *input,
+      const data_in_t *weights,
+      data_in_t *output,
+      bool *failed,
+      bool doabft = true
+    );
+
+    double fraction() const;                  // CPU share for next call
+    int split(const conv_shape_t &shape) const;// output maps of the accelerator
+};
+
+#endif // __CONV_HYBRID_H
@@ -0,0 +1,64 @@
+#ifndef __CONV_NETWORK_H
+#define __CONV_NETWORK_H
+
+#include "convolution.h"
+
+#include <vector>
+
+// One convolution layer of a network
+struct conv_layer_t
+{
+  conv_shape_t shape;
+  int pad;                  // zeros around each input map (rows and columns)
+  const data_in_t *weights; // [BATCHES][n][m][k][k]
+  conv_epilogue_t epilogue; // none if omitted
+  conv_requant_t requant;   // fixed rescale if omitted (see set_requant())
+};
+
+// Chain of layers on one session: activations stay in pinned (sds_alloc)
+// buffers, and each layer scatters its output tiles directly in the
+// zero-padded input layout of the next one, so there is no host copy nor
+// re-padding between layers. Layer i+1 must read the whole output of layer i
+// (after its epilogue): n = m of layer i, rr() = epilogue rows + 2 * pad and
+// cc() = epilogue cols + 2 * pad.
+class ConvNetwork
+{
+  private:
+    std::vector<conv_layer_t> layers;
+    std::vector<data_in_t *> activation; // padded input of layers 1..
+    std::vector<int> failedcount;        // of each layer, last run()
+    bool *tile_failed;                   // scratch, TILES
+    ConvSession session;
+
+    // Buffers are owned: no copy
+    ConvNetwork(const ConvNetwork&) = delete;
+    ConvNetwork& operator=(const ConvNetwork&) = delete;
+
+  public:
+    // End-to-end time of run() calls, and of each layer
+    perf_counter total;
+    std::vector<perf_counter> layer_time;
+
+    ConvNetwork(const std::vector<conv_layer_t> &_layers);
+    virtual ~ConvNetwork();
+
+    void init();       // allocate session and activations (no-op if done)
+    void teardown();   // free them (also done by destructor)
+    bool ready() const;
+
+    // input: padded input of the first layer [BATCHES][n][rr][cc]
+    // output: of the last layer [BATCHES][m][rows][cols] (after epilogue)
+    // Returns number of failed tiles of all layers
+    int run(
+      const data_in_t *input,
+      data_in_t *output,
+      bool doabft = true
+    );
+
+    int size() const;               // layers
+    int failed(int layer) const;    // failed tiles of a layer, last run()
+    const data_in_t *activations(int layer) const; // padded input of layer >= 1
+    ConvSession &conv_session();
+};
+
+#endif // __CONV_NETWORK_H
@@ -0,0 +1,74 @@
+#ifndef __CONV_PIPELINE_H
+#define __CONV_PIPELINE_H
+
+#include "convolution.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Asynchronous submit/wait interface over several sessions (slots).
+// Hardware calls are done in order by a host worker thread, so the caller
+// packs the next image and scatters the previous one while the accelerator
+// computes: with 2 slots, submit(k+1) and wait(k-1) overlap compute(k).
+// Results are retrieved by wait() in submission order.
+class ConvPipeline
+{
+  private:
+    // One in-flight convolution() call
+    struct slot_t
+    {
+      ConvSession session;
+      data_in_t *output;
+      bool *failed;
+      bool doabft;
+      bool done;
+    };
+
+    int slots;     // max in-flight calls
+    int submitted; // total submit() calls
+    int waited;    // total wait() calls
+    int computed;  // total hardware calls (worker)
+    bool stop;     // worker exit request
+    slot_t *slot;
+
+    std::thread worker;
+    std::mutex lock;
+    std::condition_variable changed;
+
+    void work();
+
+    // Slots and worker are owned: no copy
+    ConvPipeline(const ConvPipeline&) = delete;
+    ConvPipeline& operator=(const ConvPipeline&) = delete;
+
+  public:
+    // Time spent in each stage (compute is measured by the worker thread)
+    perf_counter pack, compute, scatter;
+
+    ConvPipeline(int _slots = 2);
+    virtual ~ConvPipeline();
+
+    void init();       // allocate slots and start worker (no-op if done)
+    void teardown();   // wait all calls, stop worker and free slots
+    bool ready() const;// test if init() is done
+
+    // Pack inputs in a free slot and queue its hardware call
+    // output and failed are written by the matching wait()
+    void submit(
+      data_in_t input[BATCHES][N][RR][CC],
+      data_in_t weights[BATCHES][N][M][K][K],
+      data_in_t output[BATCHES][M][R][C],
+      bool failed[TILES],
+      bool doabft = true
+    );
+
+    // Wait for the oldest submitted call and scatter its outputs
+    // Returns number of failed tiles
+    int wait();
+
+    bool full() const;      // test if submit() is possible
+    int in_flight() const;  // calls submitted, not waited yet
+};
+
+#endif // __CONV_PIPELINE_H
@@ -0,0 +1,41 @@
+#ifndef __CONV_SIMD_H
+#define __CONV_SIMD_H
+
+#include "convolution.h"
+
+// Vectorized software convolution, same interface as convolution() (used by
+// it with CONV_BACKEND_SIMD). Fixed-point 16x16 -> 32 bits multiply-accumulate
+// (NEON, AVX2 or SSE2, detected when first called), same rescaling as the
+// accelerator: results are bit-exact with golden_convolution().
+// Any shape with the synthesized stride is accepted (even larger than the
+// synthesized one). There is no ABFT: doabft and abft_sw are ignored, failed
+// tiles are all cleared and it returns 0.
+// If DATA_WL > 16, computation is scalar (up to DATA_WL = 32).
+// Outputs are requantized like the accelerator with the REQUANT option (see
+// conv_requant_t).
+int convolution_simd(
+  const conv_shape_t &shape,
+  const data_in_t *input,
+  const data_in_t *weights,
+  data_in_t *output,
+  bool *failed,
+  bool doabft = true,
+  perf_counter *intern = NULL,
+  perf_counter *abft_sw = NULL,
+  const conv_requant_t &requant = no_requant
+);
+int convolution_simd(
+  data_in_t input[BATCHES][N][RR][CC],
+  data_in_t weights[BATCHES][N][M][K][K],
+  data_in_t output[BATCHES][M][R][C],
+  bool failed[TILES],
+  bool doabft = true,
+  perf_counter *intern = NULL,
+  perf_counter *abft_sw = NULL
+);
+
+// Instruction set used by convolution_simd() ("avx2", "sse2", "neon" or
+// "scalar")
+const char *simd_isa();
+
+#endif // __CONV_SIMD_H
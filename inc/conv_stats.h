@@ -0,0 +1,60 @@
+#ifndef __CONV_STATS_H
+#define __CONV_STATS_H
+
+#include "conv_accel.h"
+#include "tools.h"
+
+#include <ostream>
+
+// Host phases of a convolution() call
+enum conv_phase_t
+{
+  PHASE_ALLOC,   // tile buffers allocation (ConvSession::init())
+  PHASE_PACK,    // inputs and weights packed in tile buffers
+  PHASE_COMPUTE, // hardware call (or software convolution with SIMD backend)
+  PHASE_ABFT,    // software input-checksums (without ENABLE_HARDWARE_ABFT),
+                 // overlapped with compute
+  PHASE_GATHER,  // failed tiles from checksums
+  PHASE_SCATTER, // output tiles copied to output
+  PHASE_FREE,    // tile buffers release (ConvSession::teardown())
+  PHASES
+};
+
+// Host-side statistics, accumulated over calls (see ConvSession::stats)
+// Cycles are the ones of perf_counter (sds_clock_counter())
+struct conv_stats_t
+{
+  perf_counter phase[PHASES];
+  uint64_t calls;
+  uint64_t tiles;       // output tiles computed
+  uint64_t failed;      // output tiles detected as failed by ABFT
+  uint64_t corrected;   // failed ones corrected in place (not in failed, see
+                        // ConvSession::set_correction())
+  uint64_t macs;        // multiply-accumulates of the layers (no padding)
+  uint64_t packed;      // bytes written by the host in tile buffers
+  uint64_t transferred; // bytes read and written by the accelerator
+
+  conv_stats_t();
+  void reset();
+  void add(const conv_stats_t &other);
+
+  // Account one call of the given shape: bytes are only counted for the
+  // accelerator (see transfer_volume())
+  void count(const conv_shape_t &shape, int failedcount, bool accelerator = true, bool residual = false);
+
+  uint64_t cycles() const; // all phases (but overlapped abft)
+  double seconds(int p) const;
+  double seconds() const;
+  double gmacs() const;    // GMAC/s over all phases
+  double hw_gmacs() const; // GMAC/s over compute phase only
+
+  // Dump as one JSON object, or one CSV line (see print_csv_header())
+  void print_json(std::ostream &os) const;
+  void print_csv(std::ostream &os) const;
+  static void print_csv_header(std::ostream &os);
+};
+
+// Name of a phase in dumps
+const char *conv_phase_name(int p);
+
+#endif // __CONV_STATS_H
@@ -0,0 +1,101 @@
+#ifndef __CONV_STREAM_H
+#define __CONV_STREAM_H
+
+#include "convolution.h"
+
+// Batched calls on the streaming accelerator top-level.
+// Inputs of several convolution() calls (images) are packed one after another
+// with push(), then computed by only one hardware call with flush(): the
+// accelerator pipeline is not drained between images of a batch. Results are
+// then retrieved in the same order with pop().
+// push() and pop() do not overlap the hardware call: flush() blocks, and the
+// accelerator drains between batches (use a ConvPipeline to overlap host work
+// with hardware calls).
+// Hardware only runs hw_toplevel_stream with STREAMING option (otherwise it
+// is executed by software).
+class ConvStream
+{
+  private:
+    int capacity; // max images per hardware call
+    int pushed;   // images packed for next hardware call
+    int computed; // images computed by last hardware call
+    int popped;   // images of last hardware call already retrieved
+    int calls;    // hardware calls
+
+    tile_desc_t *desc;
+#ifdef INPUT_ZERO_COPY
+    data_in_t (*input_buffer)[N][RR][CC];
+#else
+    data_in_t (*input_tile)[Tn][Trr][Tcc];
+#endif
+    data_in_t (*weights_tile)[Tn][Tm][K][K];
+#ifdef WEIGHTS_REUSE
+    int (*weights_index)[TILES];
+#endif
+    data_in_t (*output_tile)[Tm][Tr][Tc];
+#ifdef ENABLE_HARDWARE_ABFT
+    ap_uint<FAILED_BITS> *failed_tile;
+#ifdef FINE_ABFT
+    abft_region_t *region_tile; // written by hardware, not retrieved
+#endif
+#else
+    data_in_t (*incs)[TILES];
+#endif
+#ifdef EPILOGUE
+    // Streams run without epilogue: flags are 0 and bias/residual unused
+    data_in_t (*bias_tile)[Tm];
+    data_in_t (*residual_tile)[Tm / Um][Tr][Tc][Um];
+#ifndef ENABLE_HARDWARE_ABFT
+    data_in_t *outcs_tile;
+#endif
+#endif
+#ifdef REQUANT
+    // Streams run with the fixed rescale
+    data_in_t (*mult_tile)[Tm];
+    shift_t (*shift_tile)[Tm];
+#endif
+#ifdef PROFILING
+    hw_profile_t *profile_hw;
+#endif
+
+    // Buffers are owned: no copy
+    ConvStream(const ConvStream&) = delete;
+    ConvStream& operator=(const ConvStream&) = delete;
+
+  public:
+    ConvStream(int _capacity); // up to STREAM_BATCHES / BATCHES images
+    virtual ~ConvStream();
+
+    void init();       // allocate buffers (no-op if already done)
+    void teardown();   // free buffers (also done by destructor)
+    bool ready() const;// test if buffers are allocated
+
+    // Pack inputs of one image for next hardware call
+    void push(
+      data_in_t input[BATCHES][N][RR][CC],
+      data_in_t weights[BATCHES][N][M][K][K]
+    );
+
+    // Compute all pushed images with one blocking hardware call
+    // Results of previous call must all be retrieved before
+    void flush(perf_counter *intern = NULL);
+
+    // Retrieve results of the next computed image
+    // Returns number of failed tiles (this image)
+    int pop(
+      data_in_t output[BATCHES][M][R][C],
+      bool failed[TILES]
+    );
+
+    bool full() const;      // test if push() is possible
+    int pending() const;    // images pushed, not computed yet
+    int available() const;  // images computed, not retrieved yet
+    int hardware_calls() const;
+
+#ifdef PROFILING
+    // Accelerator counters of the last hardware call (all its images)
+    const hw_profile_t *profile() const;
+#endif
+};
+
+#endif // __CONV_STREAM_H
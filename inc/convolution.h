@@ -2,6 +2,7 @@
 #define __CONVOLUTION_H
 
 #include "conv_accel.h"
+#include "conv_stats.h"
 #include "tools.h"
 #include "options.sw.h"
 #include "golden_convolution.h"
@@ -20,6 +21,7 @@ extern "C" {
 // If ENABLE_HARDWARE_ABFT is defined, hardware will still compute ABFT.
 // Useful to measure convolution speedup.
 // perf_counter arguments are exposed for speedup measurement
+// stats, if given, accumulates host phases of the call (see conv_stats_t)
 // Returns number of failed tiles
 int convolution(
   data_in_t input[BATCHES][N][RR][CC],
@@ -28,10 +30,223 @@ int convolution(
   bool failed[TILES],
   bool doabft = true,
   perf_counter *intern = NULL,
-  perf_counter *abft_sw = NULL
+  perf_counter *abft_sw = NULL,
+  conv_stats_t *stats = NULL
 );
 
-// Copy functions
+// Same with a runtime layer shape (see shape_fits())
+// failed has shape.tiles() elements
+int convolution(
+  const conv_shape_t &shape,
+  const data_in_t *input,
+  const data_in_t *weights,
+  data_in_t *output,
+  bool *failed,
+  bool doabft = true,
+  perf_counter *intern = NULL,
+  perf_counter *abft_sw = NULL,
+  conv_stats_t *stats = NULL
+);
+
+// Layer epilogue after the convolution: per-map bias, elementwise residual
+// add, ReLU then 2x2 max-pool (in this order, wrapping like data_in_t).
+// With EPILOGUE option it runs in the accelerator (ABFT still checks the
+// convolution outputs), otherwise on the host after outputs are scattered
+struct conv_epilogue_t
+{
+  const data_in_t *bias;     // [m], NULL: none
+  const data_in_t *residual; // [BATCHES][m][r][c], NULL: none
+  bool relu;
+  bool pool;                 // outputs are [BATCHES][m][r / 2][c / 2]
+
+  bool enabled() const { return bias || residual || relu || pool; }
+  int rows(const conv_shape_t &shape) const { return pool ? shape.r / 2 : shape.r; }
+  int cols(const conv_shape_t &shape) const { return pool ? shape.c / 2 : shape.c; }
+};
+const conv_epilogue_t no_epilogue = {NULL, NULL, false, false};
+
+// Epilogue on the host: output [BATCHES][m][r][c] of a convolution to result
+// [BATCHES][m][rows][cols] (each map at (pad, pad), borders untouched)
+void conv_epilogue(
+  const conv_shape_t &shape,
+  const conv_epilogue_t &epilogue,
+  const data_in_t *output,
+  data_in_t *result,
+  int rows, int cols, int pad
+);
+void conv_epilogue(
+  const conv_shape_t &shape,
+  const conv_epilogue_t &epilogue,
+  const data_in_t *output,
+  data_in_t *result
+);
+
+// The accelerator epilogue only pools windows inside output tiles
+bool conv_epilogue_fusable(const conv_shape_t &shape, const conv_epilogue_t &epilogue);
+
+// Backend computing convolution(): the accelerator, or the vectorized software
+// convolution_simd() (see conv_simd.h), e.g when the fabric is busy or for a
+// layer that does not fit in the synthesized shape. Default is hardware.
+enum conv_backend_t
+{
+  CONV_BACKEND_HARDWARE,
+  CONV_BACKEND_SIMD
+};
+void set_conv_backend(conv_backend_t backend);
+conv_backend_t get_conv_backend();
+
+// Accelerator session: owns the pinned (sds_alloc) tile buffers and reuses
+// them across calls, avoiding allocations and page pinning on each call.
+// convolution() is a one-shot session (init, run, teardown).
+class ConvSession
+{
+  private:
+    conv_shape_t shape; // of the last prepare()
+#ifdef INPUT_ZERO_COPY
+    data_in_t (*input_buffer)[N][RR][CC];
+#else
+    data_in_t (*input_tile)[Tn][Trr][Tcc];
+#endif
+    data_in_t (*weights_tile)[Tn][Tm][K][K];
+    data_in_t (*output_tile)[Tm][Tr][Tc];
+#ifdef WEIGHTS_REUSE
+    int weights_index[TILES];
+#endif
+#ifdef STREAMING
+    tile_desc_t *desc;
+#endif
+#ifdef ENABLE_HARDWARE_ABFT
+    ap_uint<FAILED_BITS> failed_tile[FAILED_SIZE];
+#ifdef FINE_ABFT
+    abft_region_t region_tile[TILES];
+#endif
+#else
+    data_in_t incs[TILES];
+#endif
+#ifdef PROFILING
+    hw_profile_t profile_hw[ACTORS];
+#endif
+    conv_epilogue_t epilogue; // of next calls
+    bool fused;               // epilogue of the last prepare() in hardware
+#ifdef EPILOGUE
+    epilogue_t epilogue_hw;
+    data_in_t (*bias_tile)[Tm];
+    data_in_t (*residual_tile)[Tm / Um][Tr][Tc][Um];
+#ifndef ENABLE_HARDWARE_ABFT
+    data_in_t outcs_tile[TILES];
+#endif
+#endif
+    data_in_t *epilogue_output; // host epilogue input (not fused)
+    conv_requant_t requant;     // of next calls
+    bool correction;            // of next calls
+#ifdef REQUANT
+    shift_t abft_shift;
+    data_in_t (*mult_tile)[Tm];
+    shift_t (*shift_tile)[Tm];
+#endif
+
+#ifdef FINE_ABFT
+    int correct(bool *failed);
+#endif
+
+    // Buffers are owned: no copy
+    ConvSession(const ConvSession&) = delete;
+    ConvSession& operator=(const ConvSession&) = delete;
+
+  public:
+    // Host phases of all calls since construction (or last reset()),
+    // including allocations by init() and teardown()
+    conv_stats_t stats;
+
+    ConvSession();
+    virtual ~ConvSession();
+
+    void init();       // allocate tile buffers (no-op if already done)
+    void teardown();   // free tile buffers (also done by destructor)
+    bool ready() const;// test if tile buffers are allocated
+
+#ifdef INPUT_ZERO_COPY
+    // Pinned input buffer read by the accelerator: run() copies input there,
+    // unless input is this buffer (then, there is no host copy at all)
+    data_in_t (*pinned_input())[N][RR][CC];
+#endif
+
+    // Epilogue of next calls (none by default): outputs of run() and
+    // finish() are then [BATCHES][m][epilogue.rows(shape)][epilogue.cols(shape)]
+    void set_epilogue(const conv_epilogue_t &_epilogue);
+    const conv_epilogue_t &get_epilogue() const;
+
+    // Requantization of next calls (fixed rescale by default), only with the
+    // REQUANT option
+    void set_requant(const conv_requant_t &_requant);
+    const conv_requant_t &get_requant() const;
+
+    // Single-error correction of next calls (off by default), only with the
+    // FINE_ABFT option: a failed tile with one failed lane, row and column has
+    // its faulty output recomputed in place by finish() (Tm / Um outputs
+    // instead of the whole tile), and is not reported as failed anymore.
+    // Tiles with several faults, or a fused epilogue, stay failed
+    void set_correction(bool _correction);
+
+    // Same as convolution(), init() must be called before
+    int run(
+      data_in_t input[BATCHES][N][RR][CC],
+      data_in_t weights[BATCHES][N][M][K][K],
+      data_in_t output[BATCHES][M][R][C],
+      bool failed[TILES],
+      bool doabft = true,
+      perf_counter *intern = NULL,
+      perf_counter *abft_sw = NULL
+    );
+    int run(
+      const conv_shape_t &shape,
+      const data_in_t *input,
+      const data_in_t *weights,
+      data_in_t *output,
+      bool *failed,
+      bool doabft = true,
+      perf_counter *intern = NULL,
+      perf_counter *abft_sw = NULL
+    );
+
+    // Phases of run(), to overlap several sessions (see ConvPipeline):
+    // pack inputs in tile buffers, hardware call, then scatter outputs
+    void prepare(
+      const conv_shape_t &shape,
+      const data_in_t *input,
+      const data_in_t *weights
+    );
+    void compute(
+      bool doabft = true,
+      perf_counter *intern = NULL,
+      perf_counter *abft_sw = NULL
+    );
+    int finish(
+      data_in_t *output,
+      bool *failed,
+      bool doabft = true
+    );
+    // Same, outputs written in a padded layout (see manage_output_tiles())
+    int finish(
+      data_in_t *output,
+      int rows, int cols, int pad,
+      bool *failed,
+      bool doabft = true
+    );
+
+#ifdef PROFILING
+    // Accelerator counters of the last hardware call (see hw_profile_t)
+    const hw_profile_t *profile() const;
+#endif
+#ifdef FINE_ABFT
+    // Failed lanes, rows and columns of each output tile of the last hardware
+    // call
+    // (only meaningful for failed tiles)
+    const abft_region_t *failed_regions() const;
+#endif
+};
+
+// Copy functions (one batch of input/weights/output)
 void prepare_input_tile(
   int ti, int row, int col,
   data_in_t input[N][RR][CC],
@@ -48,16 +263,177 @@ void manage_output_tile(
   data_in_t output[M][R][C]
 );
 
+// Same with a runtime layer shape
+void prepare_input_tile(
+  const conv_shape_t &shape,
+  int ti, int row, int col,
+  const data_in_t *input,
+  data_in_t input_tile[Tn][Trr][Tcc]
+);
+void prepare_weights_tile(
+  const conv_shape_t &shape,
+  int to, int ti,
+  const data_in_t *weights,
+  data_in_t weights_tile[Tn][Tm][K][K]
+);
+void manage_output_tile(
+  const conv_shape_t &shape,
+  int to, int row, int col,
+  data_in_t output_tile[Tm][Tr][Tc],
+  data_in_t *output
+);
+
+// Same for all tiles of one call (tiles_n consecutive input tiles per output
+// tile, see hw_toplevel())
+void prepare_tiles(
+  const conv_shape_t &shape,
+  const data_in_t *input,
+  const data_in_t *weights,
+#ifdef INPUT_ZERO_COPY
+  data_in_t input_buffer[BATCHES][N][RR][CC],
+#else
+  data_in_t input_tile[TILES * TILES_N][Tn][Trr][Tcc],
+#endif
+#ifdef WEIGHTS_REUSE
+  data_in_t weights_tile[WEIGHTS_TILES * TILES_N][Tn][Tm][K][K],
+  int weights_index[TILES]
+#else
+  data_in_t weights_tile[TILES * TILES_N][Tn][Tm][K][K]
+#endif
+);
+void manage_output_tiles(
+  const conv_shape_t &shape,
+  data_in_t output_tile[TILES][Tm][Tr][Tc],
+  data_in_t *output
+);
+
+// Same, written in the zero-padded input layout of a next layer:
+// output[BATCHES][m][rows][cols], each map at (pad, pad). Borders are left
+// untouched (see ConvNetwork). pool: tiles hold pooled outputs (EPILOGUE)
+void manage_output_tiles(
+  const conv_shape_t &shape,
+  data_in_t output_tile[TILES][Tm][Tr][Tc],
+  data_in_t *output,
+  int rows, int cols, int pad,
+  bool pool = false
+);
+
+#ifdef EPILOGUE
+// Epilogue flags, bias and residual of all output tiles of one call
+// (residual in the order of the accelerator outputs)
+epilogue_t prepare_epilogue_tiles(
+  const conv_shape_t &shape,
+  const conv_epilogue_t &epilogue,
+  data_in_t bias_tile[TILES][Tm],
+  data_in_t residual_tile[TILES][Tm / Um][Tr][Tc][Um]
+);
+#endif
+
+// Shift of the ABFT checksums for a requantization: the accelerator compares
+// bits of the full-precision checksums from the lowest one reaching an output
+// (REQUANT_SHIFT for the fixed rescale), so that coverage does not depend on
+// the output scale
+int conv_abft_shift(const conv_shape_t &shape, const conv_requant_t &requant);
+
+#ifdef REQUANT
+// Multiplier and shift of the output maps of all output tiles of one call
+void prepare_requant_tiles(
+  const conv_shape_t &shape,
+  const conv_requant_t &requant,
+  data_in_t mult_tile[TILES][Tm],
+  shift_t shift_tile[TILES][Tm]
+);
+#endif
+
+// Streaming descriptors for the tiles of one call, whose buffers are the
+// image-th ones in a stream (last flag is not set)
+void prepare_descriptors(
+  const conv_shape_t &shape,
+  int image,
+  tile_desc_t desc[TILES]
+);
+
+// Failed tiles of one call (from first tile in failed_tile bits, or by
+// comparing software input-checksums with output tiles), returns their number
+int failed_tiles(
+  const conv_shape_t &shape,
+#ifdef ENABLE_HARDWARE_ABFT
+  ap_uint<FAILED_BITS> failed_tile[],
+  int first,
+#elif defined(EPILOGUE)
+  data_in_t incs[TILES],
+  data_in_t outcs_tile[TILES], // from the accelerator (before the epilogue)
+#else
+  data_in_t incs[TILES],
+  data_in_t output_tile[TILES][Tm][Tr][Tc],
+#endif
+  bool failed[TILES]
+);
+
 void sw_incs(
-  data_in_t input_tile[TILES][TILES_N][Tn][Trr][Tcc],
-  data_in_t weights_tile[TILES][TILES_N][Tn][Tm][K][K],
-  data_in_t incs[TILES]
+  const conv_shape_t &shape,
+#ifdef INPUT_ZERO_COPY
+  data_in_t input[BATCHES][N][RR][CC],
+#else
+  data_in_t input_tile[TILES * TILES_N][Tn][Trr][Tcc],
+#endif
+#ifdef WEIGHTS_REUSE
+  data_in_t weights_tile[WEIGHTS_TILES * TILES_N][Tn][Tm][K][K],
+  int weights_index[TILES],
+#else
+  data_in_t weights_tile[TILES * TILES_N][Tn][Tm][K][K],
+#endif
+  data_in_t incs[TILES],
+  const conv_requant_t &requant = no_requant // of the outputs summed by incs
+);
+
+// Bytes read (input, weights) and written (output) by the accelerator in one
+// call, for a n -> m feature maps, r x c output convolution.
+// side: per-tile buffers of the build options (ABFT failed bits, regions and
+// checksums, epilogue bias and residual, requantization)
+// packed: bytes written by the host to prepare input, weights, residual and
+// requantization
+struct transfer_volume_t
+{
+  size_t input;
+  size_t weights;
+  size_t output;
+  size_t side;
+  size_t packed;
+  size_t total() const { return input + weights + output + side; }
+};
+
+// Defaults: current build configuration
+#ifdef WEIGHTS_REUSE
+#define WEIGHTS_REUSE_DEFAULT true
+#else
+#define WEIGHTS_REUSE_DEFAULT false
+#endif
+#ifdef INPUT_ZERO_COPY
+#define INPUT_ZERO_COPY_DEFAULT true
+#else
+#define INPUT_ZERO_COPY_DEFAULT false
+#endif
+transfer_volume_t transfer_volume(
+  int n = N, int m = M, int r = R, int c = C,
+  bool weights_reuse = WEIGHTS_REUSE_DEFAULT,
+  bool input_zero_copy = INPUT_ZERO_COPY_DEFAULT,
+  bool residual = false // fused epilogue with a residual
 );
 
 // Print preprocessors constants
 void print_convolution_constants();
 
+#ifdef PROFILING
+// Print counters of a hardware call per actor, with their share of the
+// slowest one (the dataflow bottleneck), and FIFO occupancy in C simulation
+void print_profile(const hw_profile_t profile[ACTORS]);
+#endif
+
 // Check for compatibility between executable and shared lib
 bool compatibility_check(int m, int n, int r, int c, int k, int s, int b);
 
+// Check that a runtime layer shape fits in the synthesized one
+bool shape_fits(const conv_shape_t &shape);
+
 #endif // __CONVOLUTION_H
@@ -9,4 +9,24 @@ void golden_convolution(
   data_in_t output[BATCHES][M][R][C]
 );
 
+// Same with a runtime layer shape, and requantization of outputs (see
+// conv_requant_t)
+// Native arithmetic, parallelized on all CPUs (bit-identical to the naive one)
+void golden_convolution(
+  const conv_shape_t &shape,
+  const data_in_t *input,
+  const data_in_t *weights,
+  data_in_t *output,
+  const conv_requant_t &requant = no_requant
+);
+
+// Naive reference (ap_int arithmetic, one thread)
+void golden_convolution_naive(
+  const conv_shape_t &shape,
+  const data_in_t *input,
+  const data_in_t *weights,
+  data_in_t *output,
+  const conv_requant_t &requant = no_requant
+);
+
 #endif // __GOLDEN_CONVOLUTION_H
@@ -0,0 +1,81 @@
+#ifndef __GOVERNOR_H
+#define __GOVERNOR_H
+
+#include "convolution.h"
+#include "clkwiz.h"
+
+#include <deque>
+
+// Overclocking governor: closes the loop between ABFT failed tiles and the
+// clocking wizard, to run at the highest frequency keeping the failed-tile
+// rate under a budget.
+// - the rate is measured on a sliding window of the last calls (cleared on
+//   each frequency change)
+// - over budget: step down to the previous settings
+// - under budget / 2 (hysteresis band) during `hold` full windows: step up
+//   (to a frequency which already failed, the wait starts at twice as many
+//   windows and doubles on each new failure there)
+// - one call with at least `panic` failed-tile rate: fall back to SAFE_CLK
+// - a switch which does not lock keeps the current frequency (and counts as
+//   a failure of the higher one)
+class Governor
+{
+  private:
+    Clkwiz &clkwiz;
+    int tiles;       // tiles per call
+    float budget;    // max failed-tile rate
+    int window;      // calls in the sliding window
+    int hold;        // full windows under budget / 2 before stepping up
+    float panic;     // failed-tile rate of one call to fall back
+
+    std::deque<int> history; // failed tiles of last calls
+    int failures;    // sum of history
+    int calm;        // windows under budget / 2 at current frequency
+    int safe;        // index of the safe settings
+    int ceiling;     // lowest index which went over budget (count(): none)
+    int backoff;     // windows to hold before stepping up to ceiling
+    int steps;       // frequency changes
+    int fallbacks;   // fallbacks to safe settings
+
+    float step(int index);
+    void failed_at(int index);
+
+  public:
+    Governor(
+      Clkwiz &_clkwiz,
+      int _tiles = TILES,
+      float _budget = 0.01,
+      int _window = 16,
+      int _hold = 2,
+      float _panic = 0.5
+    );
+
+    float start();                   // configure safe frequency (and return it)
+    float update(int failedcount);   // account one call (returns frequency)
+
+    // session.run() at the governed frequency, then update()
+    int run(
+      ConvSession &session,
+      data_in_t input[BATCHES][N][RR][CC],
+      data_in_t weights[BATCHES][N][M][K][K],
+      data_in_t output[BATCHES][M][R][C],
+      bool failed[TILES],
+      bool doabft = true
+    );
+    int run(
+      ConvSession &session,
+      const conv_shape_t &shape,
+      const data_in_t *input,
+      const data_in_t *weights,
+      data_in_t *output,
+      bool *failed,
+      bool doabft = true
+    );
+
+    float frequency() const;  // current frequency
+    float rate() const;       // failed-tile rate in the window
+    int changes() const;      // frequency changes since start()
+    int fallback_count() const;
+};
+
+#endif // __GOVERNOR_H
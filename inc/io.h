@@ -3,9 +3,74 @@
 
 #include "convolution.h"
 
+// Uniform random inputs and weights, a new image on each call: generator
+// below seeded by rand() (reproducible with srand())
 void fill_random(
   data_in_t input[BATCHES][N][RR][CC],
   data_in_t weights[BATCHES][N][M][K][K]
 );
 
+// Same with a runtime layer shape
+void fill_random(
+  const conv_shape_t &shape,
+  data_in_t *input,
+  data_in_t *weights
+);
+
+// Data distributions: timing errors depend on data toggling, so uniform bits
+// are a worst case. Values are fixed-point fractions of the full scale
+// 2^(DATA_WL - 1), as seen by the accelerator
+enum fill_dist_t
+{
+  FILL_UNIFORM,  // uniform bits (full range)
+  FILL_GAUSSIAN, // weights: normal, mean 0, standard deviation sigma
+  FILL_RELU,     // activations: normal after ReLU, zero with probability sparsity
+  FILL_IMAGE     // pixels: 8-bit values in [0, 1)
+};
+
+struct fill_params_t
+{
+  fill_dist_t input, weights;
+  float sigma;    // standard deviation (fraction of full scale)
+  float sparsity; // FILL_RELU: fraction of zeros (after quantization)
+};
+const fill_params_t fill_uniform = {FILL_UNIFORM, FILL_UNIFORM, .25f, .5f};
+
+// Counter-based generator (Philox4x32-10): each element only depends on
+// (seed, image, tensor, index), so an image is reproducible on its own and
+// filled in parallel blocks (on all CPUs)
+void fill_random(
+  const conv_shape_t &shape,
+  data_in_t *input,
+  data_in_t *weights,
+  uint64_t seed,
+  uint32_t image,
+  const fill_params_t &params = fill_uniform
+);
+void fill_random(
+  data_in_t input[BATCHES][N][RR][CC],
+  data_in_t weights[BATCHES][N][M][K][K],
+  uint64_t seed,
+  uint32_t image,
+  const fill_params_t &params = fill_uniform
+);
+
+// One tensor (tensor: stream identifier, 0 for inputs and 1 for weights)
+void fill_tensor(
+  data_in_t *data,
+  size_t size,
+  fill_dist_t dist,
+  uint64_t seed,
+  uint32_t image,
+  uint32_t tensor,
+  const fill_params_t &params = fill_uniform
+);
+
+// Parameters by name: "uniform" (fill_uniform), "relu" (sparse activations)
+// or "image" (pixels), both with gaussian weights. Returns false if unknown
+bool fill_preset(const char *name, fill_params_t *params);
+
+// Philox4x32-10 block: 4 random words from a 128-bit counter and 64-bit key
+void philox4x32(const uint32_t ctr[4], const uint32_t key[2], uint32_t out[4]);
+
 #endif // __IO_H
@@ -0,0 +1,100 @@
+#ifndef __RECOVERY_H
+#define __RECOVERY_H
+
+#include "convolution.h"
+#include "conv_simd.h"
+#include "clkwiz.h"
+
+#include <vector>
+
+// Backend recomputing failed tiles
+enum recovery_t
+{
+  RECOVERY_ACCELERATOR, // same session (at a safer frequency if a Clkwiz is given)
+  RECOVERY_CPU          // convolution_simd()
+#ifdef FINE_ABFT
+  , RECOVERY_REGION     // only outputs of failed regions (see abft_region_t) of
+                        // the last session call, on the CPU
+#endif
+};
+
+// Selective re-execution of ABFT-failed tiles: instead of running the whole
+// layer again, failed output tiles are packed in a compact sub-batch (one tile
+// per batch, up to BATCHES tiles per call) with a {n, Tm, Tr, Tc, k} shape,
+// recomputed, and patched into output.
+// The requantization of the session (see set_requant()) is applied in all
+// modes: tiles of a sub-batch then share their output maps.
+// Sessions with an epilogue (see set_epilogue()) are not supported: outputs
+// hold biased, ReLU or pooled values that recomputed tiles cannot patch.
+class ConvRecovery
+{
+  private:
+    ConvSession &session;
+    recovery_t mode;
+    Clkwiz *clkwiz;
+    int safe;    // clkwiz settings index for recovery
+    int retries; // recovery rounds on the accelerator
+
+    // Sub-batch tensors
+    std::vector<data_in_t> input, weights, output;
+    bool failed[TILES];
+    int tiles[BATCHES]; // layer tile of each batch (-1: unused)
+
+    // Requantization of the sub-batch maps
+    std::vector<int> shift;
+    std::vector<data_in_t> mult;
+    conv_requant_t requant;
+
+    void pack(const conv_shape_t &shape, const conv_shape_t &sub, const data_in_t *layer_input, const data_in_t *layer_weights);
+    void patch(const conv_shape_t &shape, const conv_shape_t &sub, data_in_t *layer_output);
+    void offset_requant(const conv_shape_t &shape, const conv_shape_t &sub, const conv_requant_t &layer, int to);
+#ifdef FINE_ABFT
+    void recompute(const conv_shape_t &shape, int tile, const abft_region_t &region,
+      const data_in_t *layer_input, const data_in_t *layer_weights, data_in_t *layer_output);
+#endif
+
+  public:
+    // Time spent recovering, recomputed tiles (and their outputs) and
+    // sub-batch calls
+    perf_counter time;
+    int recomputed;
+    long outputs;
+    int calls;
+
+    ConvRecovery(
+      ConvSession &_session,
+      recovery_t _mode = RECOVERY_ACCELERATOR,
+      Clkwiz *_clkwiz = NULL,
+      int _safe = 0,
+      int _retries = 2
+    );
+
+    // Recompute tiles set in failed, patch them in output and clear them in
+    // failed (on success). Returns number of tiles still failed.
+    int recover(
+      const conv_shape_t &shape,
+      const data_in_t *input,
+      const data_in_t *weights,
+      data_in_t *output,
+      bool *failed
+    );
+
+    // session.run() then recover()
+    int run(
+      const conv_shape_t &shape,
+      const data_in_t *input,
+      const data_in_t *weights,
+      data_in_t *output,
+      bool *failed,
+      bool doabft = true
+    );
+    int run(
+      data_in_t input[BATCHES][N][RR][CC],
+      data_in_t weights[BATCHES][N][M][K][K],
+      data_in_t output[BATCHES][M][R][C],
+      bool failed[TILES],
+      bool doabft = true
+    );
+};
+
+#endif // __RECOVERY_H
@@ -0,0 +1,128 @@
+#ifndef __TENSOR_H
+#define __TENSOR_H
+
+#include "convolution.h"
+
+// Binary tensor files: a header, then images of one tensor of a layer. Each
+// image is a dense row-major array in the layout of a runtime shape (see
+// conv_shape_t), so it is converted in one linear pass:
+// input[BATCHES][n][rr][cc], weights[BATCHES][n][m][k][k] or
+// output[BATCHES][m][r][c]. Elements are integers of wl bits (fixed-point
+// as seen by the accelerator) stored in 1, 2, 4 or 8 bytes (host endianness).
+enum tensor_kind_t
+{
+  TENSOR_INPUT,
+  TENSOR_WEIGHTS,
+  TENSOR_OUTPUT
+};
+
+struct tensor_header_t
+{
+  uint32_t magic;   // TENSOR_MAGIC
+  uint32_t kind;    // tensor_kind_t (layout)
+  uint32_t wl;      // word length (bits)
+  uint32_t bytes;   // bytes per element
+  uint32_t batches, s;
+  uint32_t n, m, r, c, k;
+  uint32_t images;
+};
+#define TENSOR_MAGIC 0x52534e54 // "TNSR"
+
+// Elements of one image
+size_t tensor_size(tensor_kind_t kind, const conv_shape_t &shape);
+
+// Tensor of a layer in aligned heap memory, instead of multi-megabyte arrays
+// on the stack, or in pinned memory (sds_alloc) the accelerator can DMA from.
+// Elements are zeroed, in the layout of tensor files
+#define TENSOR_ALIGN 64 // bytes (cache line, and vector loads of conv_simd)
+class Tensor
+{
+  private:
+    tensor_kind_t _kind;
+    conv_shape_t _shape;
+    size_t count;
+    bool pinned;
+    data_in_t *buffer;
+
+    Tensor(const Tensor&) = delete;
+    Tensor& operator=(const Tensor&) = delete;
+
+  public:
+    Tensor(tensor_kind_t kind, const conv_shape_t &shape = max_shape, bool _pinned = false);
+    virtual ~Tensor();
+
+    tensor_kind_t kind() const;
+    conv_shape_t shape() const;
+    size_t size() const;  // elements
+    size_t bytes() const;
+
+    data_in_t *data();
+    const data_in_t *data() const;
+
+    // Views as arrays of the synthesized shape (max_shape only)
+    data_in_t (*input())[N][RR][CC];
+    data_in_t (*weights())[N][M][K][K];
+    data_in_t (*output())[M][R][C];
+};
+
+// convolution() of tensors of the same shape (failed has shape.tiles() elements)
+int convolution(
+  const Tensor &input,
+  const Tensor &weights,
+  Tensor &output,
+  bool *failed,
+  bool doabft = true,
+  conv_stats_t *stats = NULL
+);
+
+// Reads images of a file mapped in memory: pages are only loaded when an
+// image is read, and released after, so datasets larger than RAM are
+// streamed image by image. The file must match the build (BATCHES, S,
+// DATA_WL) and its shape fit in the synthesized one.
+class TensorReader
+{
+  private:
+    tensor_header_t header;
+    int fd;
+    const char *map;  // whole file
+    size_t length;    // of map
+
+    // Owns the mapping: no copy
+    TensorReader(const TensorReader&) = delete;
+    TensorReader& operator=(const TensorReader&) = delete;
+
+  public:
+    TensorReader(const char *path);
+    virtual ~TensorReader();
+
+    tensor_kind_t kind() const;
+    conv_shape_t shape() const;
+    int images() const;
+    size_t size() const; // elements of one image
+
+    // Convert an image to data (size() elements)
+    void read(int image, data_in_t *data);
+    void read(int image, Tensor &tensor);
+};
+
+// Appends images to a new file (the header is updated on each write)
+class TensorWriter
+{
+  private:
+    tensor_header_t header;
+    FILE *file;
+
+    TensorWriter(const TensorWriter&) = delete;
+    TensorWriter& operator=(const TensorWriter&) = delete;
+
+  public:
+    TensorWriter(const char *path, tensor_kind_t kind, const conv_shape_t &shape);
+    virtual ~TensorWriter();
+
+    int images() const;
+    size_t size() const;
+
+    void write(const data_in_t *data);
+};
+
+#endif // __TENSOR_H
@@ -9,9 +9,38 @@ option(ENABLE_HARDWARE_ABFT "Set to ON to build accelerator with ABFT" ON)
 
 option(NODSP "Do not use DSP for convolution kernel" OFF)
 
+# Send each weight tile once per layer instead of once per output tile
+# (costs an on-chip cache of N * Tm * K * K weights)
+option(WEIGHTS_REUSE "Set to ON to reuse weight tiles across spatial tiles" OFF)
+
+# Accelerator reads input tiles directly from the whole (pinned) input and
+# generates padding, instead of receiving tiles packed by the host
+option(INPUT_ZERO_COPY "Set to ON to read input tiles without host packing" OFF)
+
+# Put the streaming top-level (runtime number of tiles, following descriptors)
+# in hardware instead of the fixed TILES one
+option(STREAMING "Set to ON to use the streaming accelerator top-level" OFF)
+set(STREAM_BATCHES 16 CACHE STRING "Streaming: max batches per hardware call (array sizes)")
+
+# Per-actor counters in the accelerator dataflow (pipelined iterations, FIFO
+# stalls), read back with failed tiles; C simulation also records FIFO occupancy
+option(PROFILING "Set to ON to build accelerator with profiling counters" OFF)
+
+# Epilogue actor between convolution and output (per-channel bias, residual
+# add, ReLU, 2x2 max-pool), enabled at runtime (see conv_epilogue_t)
+option(EPILOGUE "Set to ON to fuse layer epilogues in the accelerator" OFF)
+
+# Per output map shift and multiplier of outputs set at runtime (see
+# conv_requant_t), instead of the fixed >> (DATA_WL - 1)
+option(REQUANT "Set to ON to requantize outputs per map in the accelerator" OFF)
+
+# Hardware ABFT also checks each lane (output maps modulo Um), output row and
+# output column of a tile, so that failures are localised (see abft_region_t)
+option(FINE_ABFT "Set to ON to localise hardware ABFT failures in output tiles" OFF)
+
 # Clocking wizard input clock (AXI clock)
 set(INPUT_CLK 100.f CACHE STRING "Clocking wizard iput clock (MHz)")
-set(SAFE_CLK 100.f CACHE STRING "Static safe frequency (MHz) - only used for speedup measurements")
+set(SAFE_CLK 100.f CACHE STRING "Static safe frequency (MHz) - used for speedup measurements and as governor fallback")
 
 # Datamover and accelerator clock IDs
 set(DMCLKID 0 CACHE STRING "Data mover clock ID")
@@ -47,7 +76,7 @@ set(M 128 CACHE STRING "Convolution output feature maps")
 set(R 13 CACHE STRING "Convolution output rows")
 set(C 13 CACHE STRING "Convolution output columns")
 set(K 3 CACHE STRING "Convolution kernel size")
-set(S 1 CACHE STRING "Convolution stride. /!\ Keep S=1. Non-strided convolution and checksums are not fully implemented!")
+set(S 1 CACHE STRING "Convolution stride. /!\ ABFT needs (Tr - 1) * S + K >= 2 * (K - 1) + S (same with Tc)")
 set(DATA_WL 16 CACHE STRING "Convolution data word length for i/o (doubled for internal results)")
 
 # Enable 8 bits mode
@@ -0,0 +1,84 @@
+#include "bench.h"
+#include "io.h"
+
+#include <algorithm>
+#include <cmath>
+
+bench_result_t bench_point(
+  ConvSession &session,
+  float frequency,
+  int images,
+  bool doabft
+)
+{
+  bench_result_t result;
+  std::vector<double> latency(images);
+  data_in_t (*input)[N][RR][CC] = new data_in_t[BATCHES][N][RR][CC];
+  data_in_t (*weights)[N][M][K][K] = new data_in_t[BATCHES][N][M][K][K];
+  data_in_t (*output)[M][R][C] = new data_in_t[BATCHES][M][R][C];
+  bool failed[TILES];
+  perf_counter image;
+  double total = 0.;
+  int img;
+
+  fill_random(input, weights);
+  session.stats.reset();
+
+  for(img = 0; img < images; img++)
+  {
+    image.reset();
+    image.start();
+    session.run(input, weights, output, failed, doabft);
+    image.stop();
+
+    latency[img] = (double) image.tot / sds_clock_frequency();
+    total += latency[img];
+  }
+
+  result.frequency = frequency;
+  result.images = images;
+  result.doabft = doabft;
+  result.p50 = percentile(latency, 50) * 1e3;
+  result.p90 = percentile(latency, 90) * 1e3;
+  result.p99 = percentile(latency, 99) * 1e3;
+  result.images_per_s = (total > 0.) ? images / total : 0.;
+  result.gops = (total > 0.) ? 2. * session.stats.macs / total / 1e9 : 0.;
+  result.failure_rate = (session.stats.tiles > 0) ?
+    (double) session.stats.failed / session.stats.tiles : 0.;
+
+  delete[] input;
+  delete[] weights;
+  delete[] output;
+
+  return result;
+}
+
+double percentile(std::vector<double> &values, double p)
+{
+  int rank;
+
+  if(values.empty())
+    return 0.;
+
+  std::sort(values.begin(), values.end());
+  rank = (int) std::ceil(p / 100. * values.size()) - 1;
+  return values[MIN(MAX(rank, 0), (int) values.size() - 1)];
+}
+
+void print_bench_header(std::ostream &os)
+{
+  os << "frequency,images,abft,p50_ms,p90_ms,p99_ms,images_per_s,gops,failure_rate" << std::endl;
+}
+
+void print_bench(std::ostream &os, const bench_result_t &result)
+{
+  os << result.frequency << ','
+    << result.images << ','
+    << (result.doabft ? 1 : 0) << ','
+    << result.p50 << ','
+    << result.p90 << ','
+    << result.p99 << ','
+    << result.images_per_s << ','
+    << result.gops << ','
+    << result.failure_rate << std::endl;
+}
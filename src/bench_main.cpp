@@ -0,0 +1,67 @@
+#include <iostream>
+#include "convolution.h"
+#include "clkwiz.h"
+#include "bench.h"
+#include <err.h>
+
+int main(int argc, char **argv)
+{
+  float minfreq, maxfreq, step, goal, freq;
+  std::vector<int> imgs;
+  int i, abft;
+
+  Clkwiz *clkwiz;
+  ConvSession session;
+
+  // Runtime check compatibility with library
+  if(!compatibility_check(M, N, R, C, K, S, BATCHES))
+    errx(1, "executable incompatible with shared library\n");
+
+  if(argc < 5)
+    errx(0, "usage: %s minfreq maxfreq step nbimgs [nbimgs...]\n"
+      "each frequency from minfreq to maxfreq is measured with each number of\n"
+      "images, with and without ABFT (one CSV line per point on stdout)\n",
+      argv[0]
+    );
+  int arg_channel = 1;
+  minfreq = atof(argv[arg_channel++]);
+  maxfreq = atof(argv[arg_channel++]);
+  step = atof(argv[arg_channel++]);
+  while(arg_channel < argc)
+    imgs.push_back(atoi(argv[arg_channel++]));
+
+  if((step <= 0) || (minfreq > maxfreq))
+    errx(1, "invalid frequency range\n");
+
+  print_convolution_constants();
+
+  // Range includes SAFE_CLK, restored at the end
+  clkwiz = new Clkwiz(
+    MIN(MIN(INPUT_CLK, SAFE_CLK), minfreq) - 1,
+    MAX(MAX(INPUT_CLK, SAFE_CLK), maxfreq) + 1,
+    .01, CLKWIZ_CACHE
+  );
+
+  // Tile buffers are allocated once for all points (and warmed up)
+  session.init();
+  bench_point(session, 0, 1, true);
+
+  print_bench_header(std::cout);
+
+  for(goal = minfreq; goal <= maxfreq + step / 2; goal += step)
+  {
+    freq = clkwiz->setFrequency(goal);
+    std::cerr << "frequency: " << freq << " (goal: " << goal << ')' << std::endl;
+
+    for(i = 0; i < (int) imgs.size(); i++)
+      for(abft = 1; abft >= 0; abft--)
+        print_bench(std::cout, bench_point(session, freq, imgs[i], abft));
+  }
+
+  clkwiz->setFrequency(SAFE_CLK);
+
+  session.teardown();
+  delete clkwiz;
+
+  return 0;
+}
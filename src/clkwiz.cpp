@@ -22,25 +22,8 @@ float Settings::getFrequency() const
   return getVCO() / ((float)clkout0_divide);
 }
 
-void Clkwiz::memWrite(int addr, ap_uint<32> value)
+DevMemRegs::DevMemRegs()
 {
-#ifdef ENABLE_CLKWIZ
-  // Note: divide addr by 4 because memory is byte-adressed but we have a 32 bits "array"
-  ((volatile ap_uint<32>*) mem)[addr >> 2] = value;
-#endif // ENABLE_CLKWIZ
-}
-
-ap_uint<32> Clkwiz::memRead(int addr)
-{
-  return ((volatile ap_uint<32>*) mem)[addr >> 2];
-}
-
-Clkwiz::Clkwiz(float _minfreq, float _maxfreq, float _step)
-  : minfreq(_minfreq)
-  , maxfreq(_maxfreq)
-  , step(_step)
-{
-#ifdef ENABLE_CLKWIZ
   int memfd;
 
   // Map memory to confgure the wizard
@@ -54,38 +37,150 @@ Clkwiz::Clkwiz(float _minfreq, float _maxfreq, float _step)
 
   if(close(memfd) != 0)
     err(2, "%s on line %d: close()", __FILE__, __LINE__ - 1);
-#endif // ENABLE_CLKWIZ
+}
 
-  // Compute overclocking settings
-  findSettings();
+DevMemRegs::~DevMemRegs()
+{
+  if(munmap(mem, 4096) != 0)
+    err(2, "%s on line %d: munmap()", __FILE__, __LINE__ - 1);
+}
 
-  state = settings.begin();
+void DevMemRegs::write(int addr, ap_uint<32> value)
+{
+  // Note: divide addr by 4 because memory is byte-adressed but we have a 32 bits "array"
+  ((volatile ap_uint<32>*) mem)[addr >> 2] = value;
 }
 
-Clkwiz::~Clkwiz()
+ap_uint<32> DevMemRegs::read(int addr)
+{
+  return ((volatile ap_uint<32>*) mem)[addr >> 2];
+}
+
+MockClkwizRegs::MockClkwizRegs(long _delay)
+  : delay(_delay)
+  , locked_at(std::chrono::steady_clock::now())
+{
+  for(int i = 0; i < 1024; i++)
+  {
+    regs[i] = 0;
+    count[i] = 0;
+  }
+}
+
+void MockClkwizRegs::setDelay(long _delay)
+{
+  delay = _delay;
+}
+
+int MockClkwizRegs::writes(int addr) const
+{
+  return count[addr >> 2];
+}
+
+void MockClkwizRegs::write(int addr, ap_uint<32> value)
 {
-  std::vector<Settings*>::iterator it;
+  regs[addr >> 2] = value;
+  count[addr >> 2]++;
+
+  // Reload: unlocked for delay
+  if(addr == CR23 && (value & 0x02))
+  {
+    if(delay < 0)
+      locked_at = std::chrono::steady_clock::time_point::max();
+    else
+      locked_at = std::chrono::steady_clock::now() + std::chrono::microseconds(delay);
+  }
+}
 
+ap_uint<32> MockClkwizRegs::read(int addr)
+{
+  if(addr == SR)
+    return (std::chrono::steady_clock::now() >= locked_at) ? (1 << LOCKED) : 0;
+  return regs[addr >> 2];
+}
+
+LatencyHistogram::LatencyHistogram()
+{
   reset();
+}
 
-#ifdef ENABLE_CLKWIZ
-  if(munmap(mem, 4096) != 0)
-    err(2, "%s on line %d: munmap()", __FILE__, __LINE__ - 1);
-#endif // ENABLE_CLKWIZ
+void LatencyHistogram::reset()
+{
+  for(int i = 0; i < LATENCY_BUCKETS; i++)
+    bucket[i] = 0;
+  count = total = max = 0;
+  min = UINT64_MAX;
+}
 
-  for(it = settings.begin(); it != settings.end(); it++)
+void LatencyHistogram::add(uint64_t ns)
+{
+  int i = 0;
+  uint64_t us = ns / 1000;
+
+  while(us > 0 && i < LATENCY_BUCKETS - 1)
   {
-    delete *it;
+    us >>= 1;
+    i++;
   }
+  bucket[i]++;
+
+  count++;
+  total += ns;
+  min = std::min(min, ns);
+  max = std::max(max, ns);
 }
 
-float Clkwiz::restart()
+uint64_t LatencyHistogram::mean() const
+{
+  return count ? total / count : 0;
+}
+
+void Clkwiz::memWrite(int addr, ap_uint<32> value)
+{
+  regs->write(addr, value);
+}
+
+ap_uint<32> Clkwiz::memRead(int addr)
+{
+  return regs->read(addr);
+}
+
+Clkwiz::Clkwiz(float _minfreq, float _maxfreq, float _step, const char *cache, ClkwizRegs *_regs)
+  : regs(_regs)
+  , own_regs(_regs == NULL)
+  , minfreq(_minfreq)
+  , maxfreq(_maxfreq)
+  , step(_step)
+  , written(false)
+  , timeout(LOCK_TIMEOUT)
+  , timeouts(0)
 {
+  if(own_regs)
+  {
+#ifdef ENABLE_CLKWIZ
+    regs = new DevMemRegs();
+#else
+    regs = new ClkwizRegs();
+#endif // ENABLE_CLKWIZ
+  }
+
+  // Compute (or load) overclocking settings
+  findSettings(cache);
+
   state = settings.begin();
+}
+
+Clkwiz::~Clkwiz()
+{
+  reset();
 
-  configure(**state);
+  if(own_regs)
+    delete regs;
+}
 
-  return settings[0]->out;
+float Clkwiz::restart()
+{
+  return select(0);
 }
 
 bool Clkwiz::end() const
@@ -98,34 +193,94 @@ int Clkwiz::count() const
   return settings.size();
 }
 
+float Clkwiz::select(int index)
+{
+  // Did not lock: current settings are kept
+  if(!configure(settings[index]))
+    return 0.f;
+
+  state = settings.begin() + index;
+
+  return state->out;
+}
+
+int Clkwiz::index() const
+{
+  return state - settings.begin();
+}
+
+float Clkwiz::frequency(int index) const
+{
+  return settings[index].out;
+}
+
+float Clkwiz::setFrequency(float freq)
+{
+  int i, index;
+
+  if(settings.empty())
+    return 0.f;
+
+  // Nearest settings of the closest step, or of its neighbours
+  i = (int) lround((freq - minfreq) / step);
+  index = nearest[std::max(0, std::min(i, (int) nearest.size() - 1))];
+  if(index > 0 && fabs(settings[index - 1].out - freq) < fabs(settings[index].out - freq))
+    index--;
+  if(index + 1 < count() && fabs(settings[index + 1].out - freq) < fabs(settings[index].out - freq))
+    index++;
+
+  return select(index);
+}
+
 float Clkwiz::next()
 {
-  state++;
-  if(!end())
-  {
-    configure(**state);
-    return (*state)->out;
-  }
+  if(settings.end() - state > 1)
+    return select(index() + 1);
+
+  state = settings.end();
   return 0.f;
 }
 
 float Clkwiz::previous()
 {
   if(settings.begin() != state)
-  {
-    state--;
-    configure(**state);
-    return (*state)->out;
-  }
+    return select(index() - 1);
   return 0.f;
 }
 
 bool Clkwiz::isLocked()
 {
-#ifdef ENABLE_CLKWIZ
   return memRead(SR) & (1 << LOCKED);
-#endif // ENABLE_CLKWIZ
-  return 0x01;
+}
+
+// Bounded polling on lock
+bool Clkwiz::waitLocked()
+{
+  std::chrono::steady_clock::time_point limit =
+    std::chrono::steady_clock::now() + std::chrono::microseconds(timeout);
+
+  while(!isLocked())
+  {
+    // Check again past the limit, in case we were preempted meanwhile
+    if(std::chrono::steady_clock::now() > limit)
+      return isLocked();
+  }
+  return true;
+}
+
+const LatencyHistogram &Clkwiz::lockLatency() const
+{
+  return latency;
+}
+
+int Clkwiz::timeoutCount() const
+{
+  return timeouts;
+}
+
+void Clkwiz::setTimeout(long us)
+{
+  timeout = us;
 }
 
 void Clkwiz::reset()
@@ -139,38 +294,77 @@ void Clkwiz::reset()
   //*
   memWrite(SRR, 0x0A);
   //*/
+
+  // Registers are back to their defaults
+  written = false;
 }
 
-void Clkwiz::configure(const Settings& settings)
+bool Clkwiz::configure(const Settings& settings)
 {
-  ap_uint<32> reg;
+  ap_uint<32> reg_cr0, reg_clkout0;
   ap_uint<8> mult;
   ap_uint<10> frac;
+  std::chrono::steady_clock::time_point start;
+  bool changed = false;
 
   /* std::cerr << settings.out << ": (" << settings.clkfbout << ", " << settings.divclk_divide << ") => 0x"; */
 
   extract_int_frac(settings.clkfbout, &mult, &frac);
-  reg = (frac, mult, settings.divclk_divide);
-  memWrite(CR0, reg);
+  reg_cr0 = (frac, mult, settings.divclk_divide);
 
-  /* std::cerr << std::hex << reg << std::dec << '\t'; */
+  /* std::cerr << std::hex << reg_cr0 << std::dec << '\t'; */
   /* std::cerr << "(" << settings.clkout0_divide << ") => 0x"; */
 
   extract_int_frac(settings.clkout0_divide, &mult, &frac);
-  reg = (frac, mult);
-  memWrite(CLKOUT0_DIVIDE, reg);
+  reg_clkout0 = (frac, mult);
 
-  /* std::cerr << std::hex << reg << std::dec << std::endl; */
+  /* std::cerr << std::hex << reg_clkout0 << std::dec << std::endl; */
 
-  // reload
-  while(!isLocked());
+  // Only write registers which changed
+  if(!written || reg_cr0 != cr0)
+  {
+    memWrite(CR0, reg_cr0);
+    changed = true;
+  }
+  if(!written || reg_clkout0 != clkout0)
+  {
+    memWrite(CLKOUT0_DIVIDE, reg_clkout0);
+    changed = true;
+  }
+
+  // Same settings: no reload
+  if(!changed)
+    return true;
+
+  // reload (on timeout, registers are unknown: all written again next time)
+  if(!waitLocked())
+  {
+    timeouts++;
+    written = false;
+    return false;
+  }
+  start = std::chrono::steady_clock::now();
   memWrite(CR23, 0x03);
-  while(!isLocked());
+  if(!waitLocked())
+  {
+    timeouts++;
+    written = false;
+    return false;
+  }
+  latency.add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - start
+  ).count());
+
+  cr0 = reg_cr0;
+  clkout0 = reg_clkout0;
+  written = true;
+
+  return true;
 }
 
-bool settings_cmp(Settings* a, Settings* b)
+bool settings_cmp(const Settings &a, const Settings &b)
 {
-  return a->out < b->out;
+  return a.out < b.out;
 }
 
 void extract_int_frac(ap_ufixed<11, 8> fix, ap_uint<8> *integer, ap_uint<10> *frac)
@@ -189,12 +383,63 @@ float floor8(float value)
   return floor(value * 8.f) / 8.f;
 }
 
-void Clkwiz::findSettings()
+void Clkwiz::findSettings(const char *cache)
 {
+  // Tables of the stub wizard are only used without ENABLE_CLKWIZ
+#ifdef ENABLE_CLKWIZ
+  const bool stub = false;
+#else
+  const bool stub = true;
+#endif
+
+  if(cache && loadSettings(cache, settings, minfreq, maxfreq, step, stub))
+  {
+    indexSettings();
+    return;
+  }
+
 #ifdef ENABLE_CLKWIZ
-  float clkfbout, divclk_divide, clkout0_divide, vco, pfd, out, goal;
-  std::vector<Settings*> tmp;
-  std::vector<Settings*>::iterator it;
+  settings = generate(minfreq, maxfreq, step);
+#else // ENABLE_CLKWIZ
+  for(int i = 0; i < int((maxfreq - minfreq + step) / step); i++)
+  {
+    settings.push_back(Settings(1, 1, 1, minfreq + step * float(i)));
+  }
+#endif //ENABLE_CLKWIZ
+
+  if(cache && !saveSettings(cache, settings, minfreq, maxfreq, step, stub))
+    warn("%s on line %d: cannot save settings to %s", __FILE__, __LINE__ - 1, cache);
+
+  indexSettings();
+}
+
+void Clkwiz::indexSettings()
+{
+  int i, index = 0;
+
+  nearest.resize(int((maxfreq - minfreq) / step) + 1);
+  if(settings.empty())
+    return;
+
+  // Settings are sorted: one sweep
+  for(i = 0; i < (int) nearest.size(); i++)
+  {
+    float goal = minfreq + step * float(i);
+
+    while(index + 1 < count() && settings[index + 1].out <= goal)
+      index++;
+    if(index + 1 < count() && settings[index + 1].out - goal < goal - settings[index].out)
+      nearest[i] = index + 1;
+    else
+      nearest[i] = index;
+  }
+}
+
+std::vector<Settings> Clkwiz::generate(float minfreq, float maxfreq, float step)
+{
+  float clkfbout, divclk_divide, clkout0_divide, vco, pfd, goal;
+  std::vector<Settings> all, settings;
+  std::vector<Settings>::iterator it;
 
   // Generate all legal solutions
   for(divclk_divide = ceil(INPUT_CLK / PFDMAX); divclk_divide <= floor(INPUT_CLK / PFDMIN); divclk_divide++)
@@ -207,34 +452,110 @@ void Clkwiz::findSettings()
 
       for(clkout0_divide = ceil8(vco / maxfreq); clkout0_divide <= floor8(vco / minfreq); clkout0_divide += .125f)
       {
-        out = vco / clkout0_divide;
-        tmp.push_back(new Settings(clkfbout, divclk_divide, clkout0_divide, out));
+        all.push_back(Settings(clkfbout, divclk_divide, clkout0_divide, vco / clkout0_divide));
       }
     }
   }
 
   // Sort them according to result frequencies
-  std::sort(tmp.begin(), tmp.end(), settings_cmp);
+  std::sort(all.begin(), all.end(), settings_cmp);
 
   // Select one solution by step
   settings.reserve(1 + (maxfreq - minfreq) / step);
   goal = minfreq;
-  for(it = tmp.begin(); it != tmp.end(); it++)
+  for(it = all.begin(); it != all.end(); it++)
   {
-    if((*it)->out >= goal)
+    if(it->out >= goal)
     {
       settings.push_back(*it);
       goal += step;
     }
-    else
-    {
-      delete *it;
-    }
   }
-#else // ENABLE_CLKWIZ
-  for(int i = 0; i < int((maxfreq - minfreq + step) / step); i++)
+
+  return settings;
+}
+
+// Settings table file: header, then one record per settings
+struct settings_header_t
+{
+  uint32_t magic;
+  float input_clk, minfreq, maxfreq, step;
+  uint32_t stub; // table of the stub wizard (not legal settings)
+  uint32_t count;
+};
+struct settings_record_t
+{
+  float clkfbout;
+  uint32_t divclk_divide;
+  float clkout0_divide;
+  float out;
+};
+#define SETTINGS_MAGIC 0x434c4b32 // "CLK2"
+
+bool Clkwiz::saveSettings(const char *path, const std::vector<Settings> &settings, float minfreq, float maxfreq, float step, bool stub)
+{
+  settings_header_t header = {SETTINGS_MAGIC, INPUT_CLK, minfreq, maxfreq, step, stub, (uint32_t) settings.size()};
+  std::vector<settings_record_t> records(settings.size());
+  FILE *file;
+  bool ok;
+
+  for(size_t i = 0; i < settings.size(); i++)
   {
-    settings.push_back(new Settings(1, 1, 1, minfreq + step * float(i)));
+    records[i].clkfbout = (float) settings[i].clkfbout;
+    records[i].divclk_divide = (uint32_t) settings[i].divclk_divide;
+    records[i].clkout0_divide = (float) settings[i].clkout0_divide;
+    records[i].out = settings[i].out;
   }
-#endif //ENABLE_CLKWIZ
+
+  file = fopen(path, "wb");
+  if(!file)
+    return false;
+  ok = (fwrite(&header, sizeof(header), 1, file) == 1) &&
+    (fwrite(records.data(), sizeof(settings_record_t), records.size(), file) == records.size());
+  return (fclose(file) == 0) && ok;
+}
+
+bool Clkwiz::loadSettings(const char *path, std::vector<Settings> &settings, float minfreq, float maxfreq, float step, bool stub)
+{
+  settings_header_t header;
+  std::vector<settings_record_t> records;
+  FILE *file;
+  bool ok;
+
+  file = fopen(path, "rb");
+  if(!file)
+    return false;
+
+  ok = (fread(&header, sizeof(header), 1, file) == 1) &&
+    (header.magic == SETTINGS_MAGIC) && (header.input_clk == INPUT_CLK) &&
+    (header.minfreq == minfreq) && (header.maxfreq == maxfreq) && (header.step == step) &&
+    (stub || !header.stub);
+  if(ok)
+  {
+    records.resize(header.count);
+    ok = (fread(records.data(), sizeof(settings_record_t), records.size(), file) == records.size());
+  }
+  fclose(file);
+  if(!ok)
+    return false;
+
+  settings.clear();
+  settings.reserve(records.size());
+  for(size_t i = 0; i < records.size(); i++)
+  {
+    Settings loaded(records[i].clkfbout, records[i].divclk_divide, records[i].clkout0_divide, records[i].out);
+
+    // Generated settings must be legal, and give their frequency
+    if(!header.stub &&
+       ((loaded.getFrequency() != loaded.out) ||
+        (loaded.getPFD() < PFDMIN) || (loaded.getPFD() > PFDMAX) ||
+        (loaded.getVCO() < VCOMIN) || (loaded.getVCO() > VCOMAX)))
+    {
+      settings.clear();
+      return false;
+    }
+    settings.push_back(loaded);
+  }
+
+  return true;
 }
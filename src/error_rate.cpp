@@ -2,60 +2,239 @@
 #include "convolution.h"
 #include "golden_convolution.h"
 #include "clkwiz.h"
+#include "governor.h"
+#include "recovery.h"
 #include "io.h"
+#include "tensor.h"
 #include <err.h>
 #include <sys/stat.h>
+#include <fstream>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+
+// Seed of input data: image i is the same in all runs
+#define SEED 42
+
+// Recovery mode by name (false if unknown)
+static bool recovery_mode(const char *name, recovery_t *mode)
+{
+  if(strcmp(name, "accelerator") == 0)
+    *mode = RECOVERY_ACCELERATOR;
+  else if(strcmp(name, "cpu") == 0)
+    *mode = RECOVERY_CPU;
+#ifdef FINE_ABFT
+  else if(strcmp(name, "region") == 0)
+    *mode = RECOVERY_REGION;
+#endif
+  else
+    return false;
+  return true;
+}
 
 int main(int argc, char **argv)
 {
-  data_in_t input[BATCHES][N][RR][CC];
-  data_in_t weights[BATCHES][N][M][K][K];
-  data_in_t output[BATCHES][M][R][C];
   bool abftfailed[TILES];
-  int count;
-  int imgs, img;
-  float goal, freq;
+  int count, remaining;
+  int imgs, img, i, safe;
+  float goal, freq, budget;
+  const char *statsfile;
+  bool json = false;
+  std::ofstream stats;
+  fill_params_t data = fill_uniform;
+  conv_shape_t shape = max_shape;
+  TensorReader *input_file = NULL, *weights_file = NULL;
+  TensorWriter *output_file = NULL;
+  recovery_t mode = RECOVERY_ACCELERATOR;
+  bool recover = false;
 
   Clkwiz *clkwiz;
+  Governor *governor = NULL;
+  ConvRecovery *recovery = NULL;
+  ConvSession session;
 
   // Runtime check compatibility with library
   if(!compatibility_check(M, N, R, C, K, S, BATCHES))
     errx(1, "executable incompatible with shared library\n");
 
   if(argc < 3)
-    errx(0, "usage: %s nbimgs freq\n",
+    errx(0, "usage: %s nbimgs freq [budget [stats [data [recovery]]]]\n"
+      "with budget, freq is the maximum frequency reached by the governor\n"
+      "(0: no governor)\n"
+      "stats: file receiving host statistics of each image (JSON if it ends\n"
+      "with .json, CSV otherwise, - for none)\n"
+      "data: distribution of inputs/weights: uniform (default), relu or image,\n"
+      "or prefix of tensor files: images of <data>_input.tnsr with weights of\n"
+      "<data>_weights.tnsr (image i %% count), outputs written to\n"
+      "<data>_output.tnsr (nbimgs 0: all images)\n"
+      "recovery: failed tiles recomputed on the accelerator (at the highest\n"
+      "frequency up to SAFE_CLK), cpu or region (FINE_ABFT), tiles still\n"
+      "failed after it as last column\n",
       argv[0]
     );
   int arg_channel = 1;
   imgs = atoi(argv[arg_channel++]);
   goal = atof(argv[arg_channel++]);
+  budget = (argc > arg_channel) ? atof(argv[arg_channel++]) : 0.f;
+  statsfile = (argc > arg_channel) ? argv[arg_channel++] : NULL;
+  if((argc > arg_channel) && !fill_preset(argv[arg_channel++], &data))
+  {
+    std::string prefix = argv[arg_channel - 1];
+
+    if(access((prefix + "_input.tnsr").c_str(), R_OK) != 0)
+      errx(1, "unknown data distribution %s\n", prefix.c_str());
+
+    // Real layer: shape of the files, streamed image by image
+    input_file = new TensorReader((prefix + "_input.tnsr").c_str());
+    weights_file = new TensorReader((prefix + "_weights.tnsr").c_str());
+    shape = input_file->shape();
+    if((input_file->kind() != TENSOR_INPUT) || (weights_file->kind() != TENSOR_WEIGHTS) ||
+       !(weights_file->shape() == shape) || (weights_file->images() < 1))
+      errx(1, "%s: inputs and weights do not match\n", prefix.c_str());
+    if((imgs <= 0) || (imgs > input_file->images()))
+      imgs = input_file->images();
+    output_file = new TensorWriter((prefix + "_output.tnsr").c_str(), TENSOR_OUTPUT, shape);
+  }
+  if(argc > arg_channel)
+  {
+    if(!recovery_mode(argv[arg_channel++], &mode))
+      errx(1, "unknown recovery mode %s\n", argv[arg_channel - 1]);
+    recover = true;
+  }
+  if((statsfile != NULL) && (strcmp(statsfile, "-") == 0))
+    statsfile = NULL;
+
+  if(statsfile != NULL)
+  {
+    stats.open(statsfile);
+    if(!stats)
+      err(1, "cannot open %s", statsfile);
+    json = (strlen(statsfile) > 5) && (strcmp(statsfile + strlen(statsfile) - 5, ".json") == 0);
+    if(json)
+      stats << '[' << std::endl;
+    else
+    {
+      stats << "image,frequency,";
+      conv_stats_t::print_csv_header(stats);
+      stats << std::endl;
+    }
+  }
+
+  // Heap tensors of the layer (too large for the stack)
+  Tensor input(TENSOR_INPUT, shape), weights(TENSOR_WEIGHTS, shape), output(TENSOR_OUTPUT, shape);
 
   print_convolution_constants();
 
   // We use clocking wizard to directly go to the goal frequency
-  clkwiz = new Clkwiz(std::min(INPUT_CLK, goal) - 1, std::max(INPUT_CLK, goal) + 1, .01);
-  clkwiz->restart();
-  while((freq = clkwiz->next()) < goal);
-  std::cerr << "frequency: " << freq << " (goal: " << goal << ')' << std::endl;
+  // (or the governor starts from SAFE_CLK and adapts it up to goal)
+  if(budget > 0)
+  {
+    clkwiz = new Clkwiz(std::min(SAFE_CLK, goal), goal, 1, CLKWIZ_CACHE);
+    governor = new Governor(*clkwiz, shape.tiles(), budget);
+    freq = governor->start();
+    std::cerr << "governor: from " << freq << " up to " << goal << " (budget: " << budget << ')' << std::endl;
+  }
+  else
+  {
+    clkwiz = new Clkwiz(std::min(INPUT_CLK, goal) - 1, std::max(INPUT_CLK, goal) + 1, .01, CLKWIZ_CACHE);
+    freq = clkwiz->setFrequency(goal);
+    std::cerr << "frequency: " << freq << " (goal: " << goal << ')' << std::endl;
+  }
+
+  // Failed tiles recomputed at the highest settings up to SAFE_CLK
+  if(recover)
+  {
+    safe = 0;
+    for(i = 0; i < clkwiz->count(); i++)
+      if(clkwiz->frequency(i) <= SAFE_CLK)
+        safe = i;
+    recovery = new ConvRecovery(session, mode, clkwiz, safe);
+  }
+
+  // Tile buffers are allocated once for all images
+  session.init();
 
   for(img = 0; img < imgs; img++)
   {
-    fill_random(input, weights);
+    if(input_file)
+    {
+      input_file->read(img, input);
+      weights_file->read(img % weights_file->images(), weights);
+    }
+    else
+      fill_random(shape, input.data(), weights.data(), SEED, img, data);
+    session.stats.reset();
 
     //           #image         number of image
     std::cout << img << '\t' << imgs << '\t';
 
-    count = convolution(
-      input,
-      weights,
-      output,
-      abftfailed
-    );
+    if(governor)
+    {
+      freq = governor->frequency();
+      count = governor->run(
+        session,
+        shape,
+        input.data(),
+        weights.data(),
+        output.data(),
+        abftfailed
+      );
+    }
+    else
+    {
+      count = session.run(
+        shape,
+        input.data(),
+        weights.data(),
+        output.data(),
+        abftfailed
+      );
+    }
+
+    remaining = count;
+    if(recovery && (count > 0))
+      remaining = recovery->recover(shape, input.data(), weights.data(), output.data(), abftfailed);
+
+    if(output_file)
+      output_file->write(output.data());
 
     //           abft detected error?    number of failed tiles  number of tiles
-    std::cout << ((count > 0) ? 1 : 0) << '\t' << count << '\t' << (TILES) << std::endl;
+    std::cout << ((count > 0) ? 1 : 0) << '\t' << count << '\t' << shape.tiles();
+    //                               frequency of this image (governor only)
+    if(governor)
+      std::cout << '\t' << freq;
+    //                               tiles still failed after recovery
+    if(recovery)
+      std::cout << '\t' << remaining;
+    std::cout << std::endl;
+
+    if(json)
+    {
+      stats << "  {\"image\": " << img << ", \"frequency\": " << freq << ", \"stats\": ";
+      session.stats.print_json(stats);
+      stats << ((img < imgs - 1) ? "}," : "}") << std::endl;
+    }
+    else if(statsfile != NULL)
+    {
+      stats << img << ',' << freq << ',';
+      session.stats.print_csv(stats);
+      stats << std::endl;
+    }
   }
 
+  if(json)
+    stats << ']' << std::endl;
+
+  if(recovery)
+    std::cerr << "recovery: " << recovery->recomputed << " tiles recomputed in "
+      << recovery->calls << " calls, " << recovery->time.tot << " cycles" << std::endl;
+
+  session.teardown();
+  delete output_file;
+  delete weights_file;
+  delete input_file;
+  delete recovery;
+  delete governor;
   delete clkwiz;
 
   return 0;
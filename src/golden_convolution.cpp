@@ -1,42 +1,202 @@
 #include "golden_convolution.h"
 
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+
+// Output maps computed together by one work item (each input row is read
+// once for all of them)
+#define GOLDEN_BLOCK_M 8
+
+// Native types for the fast reference: accumulation is done modulo
+// 2^(2 * DATA_WL) like data_out_t, with unsigned (wrapping) arithmetic
+// on a multiple of that width
+#if DATA_WL <= 16
+typedef int16_t golden_in_t;
+typedef uint32_t golden_acc_t;
+#else
+typedef int32_t golden_in_t;
+typedef uint64_t golden_acc_t;
+#endif
+
 // Software simple convolution reference
 void golden_convolution(
   data_in_t input[BATCHES][N][RR][CC],
   data_in_t weights[BATCHES][N][M][K][K],
   data_in_t output[BATCHES][M][R][C]
 )
+{
+  golden_convolution(
+    max_shape,
+    &input[0][0][0][0],
+    &weights[0][0][0][0][0],
+    &output[0][0][0][0]
+  );
+} // golden_convolution()
+
+void golden_convolution_naive(
+  const conv_shape_t &shape,
+  const data_in_t *input,
+  const data_in_t *weights,
+  data_in_t *output,
+  const conv_requant_t &requant
+)
 {
   int b, row, col, to, ti, i, j;
+  int n = shape.n, m = shape.m, k = shape.k;
+  int rr = shape.rr(), cc = shape.cc();
 
   data_out_t output_tmp;
 
   for(b = 0; b < BATCHES; b++)
   {
-    for(to = 0; to < M; to++)
+    for(to = 0; to < m; to++)
     {
-      for(row = 0; row < R; row++)
+      for(row = 0; row < shape.r; row++)
       {
-        for(col = 0; col < C; col++)
+        for(col = 0; col < shape.c; col++)
         {
           output_tmp = 0;
 
-          for(ti = 0; ti < N; ti++)
+          for(ti = 0; ti < n; ti++)
           {
-            for(i = 0; i < K; i++)
+            for(i = 0; i < k; i++)
             {
-              for(j = 0; j < K; j++)
+              for(j = 0; j < k; j++)
               {
                 output_tmp +=
-                  data_out_t(weights[b][ti][to][i][j]) *
-                  data_out_t(input[b][ti][S * row + i][S * col + j]);
+                  data_out_t(weights[((((b * n + ti) * m + to) * k) + i) * k + j]) *
+                  data_out_t(input[((b * n + ti) * rr + S * row + i) * cc + S * col + j]);
               } // j
             } // i
           } // ti
 
-          output[b][to][row][col] = data_in_t(output_tmp >> (data_in_t::width - 1));
+          output[((b * m + to) * shape.r + row) * shape.c + col] =
+            requant.apply(output_tmp, to);
         } // col
       } // row
     } // to
   } // b
+} // golden_convolution_naive()
+
+#if DATA_WL <= 32
+
+// Same scaling as the reference, from a native accumulator
+static inline data_in_t golden_output(golden_acc_t acc, const conv_requant_t &requant, int m)
+{
+  // Sign extension from data_out_t width
+  const int shift = 64 - 2 * DATA_WL;
+  int64_t full = (int64_t) ((uint64_t) acc << shift) >> shift;
+
+  if(requant.enabled())
+    return requant.apply(data_out_t(full), m);
+  return data_in_t(full >> (data_in_t::width - 1));
+}
+
+// Output maps [to0, to1) of batch b
+static void golden_block(
+  const conv_shape_t &shape,
+  const golden_in_t *input,
+  const golden_in_t *weights,
+  data_in_t *output,
+  const conv_requant_t &requant,
+  int b, int to0, int to1
+)
+{
+  int ti, i, j, row, col, tb;
+  int n = shape.n, m = shape.m, k = shape.k;
+  int r = shape.r, c = shape.c, rr = shape.rr(), cc = shape.cc();
+  int blocks = to1 - to0;
+  golden_acc_t w[GOLDEN_BLOCK_M];
+  std::vector<golden_acc_t> acc((size_t) blocks * r * c, 0);
+
+  for(ti = 0; ti < n; ti++)
+  {
+    for(i = 0; i < k; i++)
+    {
+      for(j = 0; j < k; j++)
+      {
+        for(tb = 0; tb < blocks; tb++)
+          w[tb] = (golden_acc_t) weights[(((b * n + ti) * m + to0 + tb) * k + i) * k + j];
+
+        for(row = 0; row < r; row++)
+        {
+          const golden_in_t *line = input + ((size_t) (b * n + ti) * rr + S * row + i) * cc + j;
+
+          for(tb = 0; tb < blocks; tb++)
+          {
+            golden_acc_t *out = &acc[((size_t) tb * r + row) * c];
+            golden_acc_t wt = w[tb];
+
+            for(col = 0; col < c; col++)
+              out[col] += wt * (golden_acc_t) line[S * col];
+          } // tb
+        } // row
+      } // j
+    } // i
+  } // ti
+
+  for(tb = 0; tb < blocks; tb++)
+    for(row = 0; row < r; row++)
+      for(col = 0; col < c; col++)
+        output[((size_t) (b * m + to0 + tb) * r + row) * c + col] =
+          golden_output(acc[((size_t) tb * r + row) * c + col], requant, to0 + tb);
+} // golden_block()
+
+#endif
+
+// Fast reference: native arithmetic, blocked over output maps, parallelized
+// over (batch, block of output maps). Bit-identical to the naive one
+void golden_convolution(
+  const conv_shape_t &shape,
+  const data_in_t *input,
+  const data_in_t *weights,
+  data_in_t *output,
+  const conv_requant_t &requant
+)
+{
+#if DATA_WL > 32
+  // No native type: keep ap_int arithmetic
+  golden_convolution_naive(shape, input, weights, output, requant);
+#else
+  size_t i;
+  size_t input_size = (size_t) BATCHES * shape.n * shape.rr() * shape.cc();
+  size_t weights_size = (size_t) BATCHES * shape.n * shape.m * shape.k * shape.k;
+  int blocks_m = UPPERDIV(shape.m, GOLDEN_BLOCK_M);
+  int items = BATCHES * blocks_m;
+  int threads = std::thread::hardware_concurrency();
+  std::vector<golden_in_t> input_native(input_size), weights_native(weights_size);
+  std::vector<std::thread> workers;
+  std::atomic<int> next(0);
+
+  for(i = 0; i < input_size; i++)
+    input_native[i] = input[i].to_int();
+  for(i = 0; i < weights_size; i++)
+    weights_native[i] = weights[i].to_int();
+
+  auto work = [&]() {
+    int item;
+    while((item = next++) < items)
+    {
+      int b = item / blocks_m;
+      int to0 = (item % blocks_m) * GOLDEN_BLOCK_M;
+      golden_block(
+        shape,
+        input_native.data(),
+        weights_native.data(),
+        output,
+        requant,
+        b, to0, MIN(to0 + GOLDEN_BLOCK_M, shape.m)
+      );
+    }
+  };
+
+  threads = MIN(MAX(threads, 1), items);
+  for(int t = 1; t < threads; t++)
+    workers.push_back(std::thread(work));
+  work();
+  for(auto &worker : workers)
+    worker.join();
+#endif
 } // golden_convolution()
@@ -0,0 +1,179 @@
+#include "governor.h"
+
+// Max windows to hold before trying a failing frequency again (x hold)
+#define MAX_BACKOFF 64
+
+Governor::Governor(
+  Clkwiz &_clkwiz,
+  int _tiles,
+  float _budget,
+  int _window,
+  int _hold,
+  float _panic
+)
+  : clkwiz(_clkwiz)
+  , tiles(_tiles)
+  , budget(_budget)
+  , window(_window)
+  , hold(_hold)
+  , panic(_panic)
+  , failures(0)
+  , calm(0)
+  , safe(0)
+  , ceiling(0)
+  , backoff(0)
+  , steps(0)
+  , fallbacks(0)
+{
+  if(tiles < 1 || window < 1 || hold < 1)
+    errx(-2, "governor needs at least 1 tile, 1 call per window and 1 window to hold");
+}
+
+float Governor::start()
+{
+  int i;
+
+  // Safe settings: highest frequency not above SAFE_CLK (or the lowest one)
+  safe = 0;
+  for(i = 0; i < clkwiz.count(); i++)
+    if(clkwiz.frequency(i) <= SAFE_CLK)
+      safe = i;
+
+  ceiling = clkwiz.count();
+  backoff = 2 * hold;
+  steps = fallbacks = 0;
+
+  return step(safe);
+}
+
+float Governor::step(int index)
+{
+  history.clear();
+  failures = 0;
+  calm = 0;
+
+  // Did not lock: stay, and wait longer before trying a higher one again
+  if(0.f == clkwiz.select(index))
+  {
+    if(index > clkwiz.index())
+      failed_at(index);
+    return frequency();
+  }
+  steps++;
+
+  return frequency();
+}
+
+void Governor::failed_at(int index)
+{
+  // Each failure at the same ceiling doubles the wait before next try
+  if(index == ceiling)
+    backoff = MIN(2 * backoff, MAX_BACKOFF * hold);
+  else
+  {
+    ceiling = MIN(ceiling, index);
+    backoff = 2 * hold;
+  }
+}
+
+float Governor::update(int failedcount)
+{
+  int index = clkwiz.index();
+
+  // Safe fallback on massive failure
+  if(failedcount >= panic * tiles)
+  {
+    fallbacks++;
+    failed_at(index);
+    return step(safe);
+  }
+
+  history.push_back(failedcount);
+  failures += failedcount;
+  if((int) history.size() > window)
+  {
+    failures -= history.front();
+    history.pop_front();
+  }
+
+  if((int) history.size() < window)
+    return frequency();
+
+  if(rate() > budget)
+  {
+    failed_at(index);
+    if(index > 0)
+      return step(index - 1);
+    history.clear(); // nothing lower: measure again
+    failures = 0;
+  }
+  else if(rate() <= budget / 2)
+  {
+    calm++;
+    history.clear(); // next window is disjoint
+    failures = 0;
+    if(index == ceiling)
+      ceiling = clkwiz.count(); // went through
+    if(index + 1 < clkwiz.count() && calm >= (index + 1 == ceiling ? backoff : hold))
+      return step(index + 1);
+  }
+  else
+    calm = 0; // hysteresis band: stay
+
+  return frequency();
+}
+
+int Governor::run(
+  ConvSession &session,
+  data_in_t input[BATCHES][N][RR][CC],
+  data_in_t weights[BATCHES][N][M][K][K],
+  data_in_t output[BATCHES][M][R][C],
+  bool failed[TILES],
+  bool doabft
+)
+{
+  int failedcount = session.run(input, weights, output, failed, doabft);
+
+  update(failedcount);
+
+  return failedcount;
+}
+
+int Governor::run(
+  ConvSession &session,
+  const conv_shape_t &shape,
+  const data_in_t *input,
+  const data_in_t *weights,
+  data_in_t *output,
+  bool *failed,
+  bool doabft
+)
+{
+  int failedcount = session.run(shape, input, weights, output, failed, doabft);
+
+  update(failedcount);
+
+  return failedcount;
+}
+
+float Governor::frequency() const
+{
+  return clkwiz.frequency(clkwiz.index());
+}
+
+float Governor::rate() const
+{
+  if(history.empty())
+    return 0.f;
+  return (float) failures / (history.size() * tiles);
+}
+
+int Governor::changes() const
+{
+  return steps - 1; // start() is not a change
+}
+
+int Governor::fallback_count() const
+{
+  return fallbacks;
+}
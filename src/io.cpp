@@ -1,34 +1,243 @@
 #include "io.h"
 #include <stdlib.h>
+#include <cmath>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <cstring>
 
-void fill_random(
-  data_in_t input[BATCHES][N][RR][CC],
-  data_in_t weights[BATCHES][N][M][K][K]
+// Elements per work item (multiple of the 4 words of a Philox block)
+#define FILL_BLOCK 4096
+
+void philox4x32(const uint32_t ctr[4], const uint32_t key[2], uint32_t out[4])
+{
+  uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+  uint32_t k0 = key[0], k1 = key[1];
+  int round;
+
+  for(round = 0; round < 10; round++)
+  {
+    uint64_t p0 = (uint64_t) 0xD2511F53 * c0;
+    uint64_t p1 = (uint64_t) 0xCD9E8D57 * c2;
+
+    c0 = (uint32_t) (p1 >> 32) ^ c1 ^ k0;
+    c1 = (uint32_t) p1;
+    c2 = (uint32_t) (p0 >> 32) ^ c3 ^ k1;
+    c3 = (uint32_t) p0;
+
+    // Weyl sequence on the key
+    k0 += 0x9E3779B9;
+    k1 += 0xBB67AE85;
+  }
+
+  out[0] = c0;
+  out[1] = c1;
+  out[2] = c2;
+  out[3] = c3;
+}
+
+// Uniform in (0, 1] from a random word
+static inline double fill_unit(uint32_t word)
+{
+  return (word + 1.) / 4294967296.;
+}
+
+// Full scale of data_in_t
+#define FILL_SCALE ((double) ((int64_t) 1 << (data_in_t::width - 1)))
+
+// Fixed-point value of x (fraction of full scale), saturated
+static inline data_in_t fill_fixed(double x)
+{
+  double v = std::round(x * FILL_SCALE);
+
+  return data_in_t((int64_t) MIN(MAX(v, -FILL_SCALE), FILL_SCALE - 1));
+}
+
+// Threshold t with P(z <= t) = p for a standard normal z (bisection)
+static double fill_normal_quantile(double p)
+{
+  double lo = -10., hi = 10.;
+  int i;
+
+  for(i = 0; i < 64; i++)
+  {
+    double mid = (lo + hi) / 2;
+    if(.5 * std::erfc(-mid / std::sqrt(2.)) < p)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return (lo + hi) / 2;
+}
+
+// Elements [first, last) of a tensor, 4 per Philox block
+static void fill_block(
+  data_in_t *data,
+  size_t first, size_t last,
+  fill_dist_t dist,
+  const uint32_t key[2],
+  uint32_t image, uint32_t tensor,
+  const fill_params_t &params,
+  double relu_shift
 )
 {
-  int b, to, ti, row, col, i, j;
+  uint32_t ctr[4], word[4];
+  double gauss[4];
+  size_t i, block;
+  int w;
 
-  for(b = 0; b < BATCHES; b++)
+  for(block = first / 4; block * 4 < last; block++)
   {
-    for(ti = 0; ti < N; ti++)
+    ctr[0] = (uint32_t) block;
+    ctr[1] = (uint32_t) ((uint64_t) block >> 32);
+    ctr[2] = image;
+    ctr[3] = tensor;
+    philox4x32(ctr, key, word);
+
+    // Box-Muller: two normal values per pair of words
+    if((dist == FILL_GAUSSIAN) || (dist == FILL_RELU))
     {
-      for(to = 0; to < M; to++)
+      for(w = 0; w < 4; w += 2)
       {
-        for(i = 0; i < K; i++)
-        {
-          for(j = 0; j < K; j++)
-          {
-            weights[b][ti][to][i][j] = rand();
-          }
-        }
+        double radius = std::sqrt(-2. * std::log(fill_unit(word[w])));
+        double angle = 2. * M_PI * fill_unit(word[w + 1]);
+        gauss[w] = radius * std::cos(angle);
+        gauss[w + 1] = radius * std::sin(angle);
       }
-      for(row = 0; row < RR; row++)
+    }
+
+    for(w = 0; w < 4; w++)
+    {
+      i = block * 4 + w;
+      if((i < first) || (i >= last))
+        continue;
+
+      switch(dist)
       {
-        for(col = 0; col < CC; col++)
-        {
-          input[b][ti][row][col] = rand();
-        }
+        case FILL_UNIFORM:
+          data[i] = (int) word[w];
+          break;
+        case FILL_GAUSSIAN:
+          data[i] = fill_fixed(gauss[w] * params.sigma);
+          break;
+        case FILL_RELU:
+          data[i] = fill_fixed(MAX(gauss[w] - relu_shift, 0.) * params.sigma);
+          break;
+        case FILL_IMAGE:
+          data[i] = fill_fixed((word[w] >> 24) / 256.);
+          break;
       }
     }
   }
 }
+
+void fill_tensor(
+  data_in_t *data,
+  size_t size,
+  fill_dist_t dist,
+  uint64_t seed,
+  uint32_t image,
+  uint32_t tensor,
+  const fill_params_t &params
+)
+{
+  const uint32_t key[2] = {(uint32_t) seed, (uint32_t) (seed >> 32)};
+  size_t items = UPPERDIV(size, FILL_BLOCK);
+  int threads = std::thread::hardware_concurrency();
+  double relu_shift = 0.;
+  std::vector<std::thread> workers;
+  std::atomic<size_t> next(0);
+
+  // ReLU: positive values under half a step round to 0 too, and count in the
+  // sparsity
+  if(dist == FILL_RELU)
+  {
+    relu_shift = fill_normal_quantile(params.sparsity);
+    if(params.sigma > 0)
+      relu_shift -= .5 / (params.sigma * FILL_SCALE);
+  }
+
+  auto work = [&]() {
+    size_t item;
+    while((item = next++) < items)
+      fill_block(
+        data,
+        item * FILL_BLOCK, MIN((item + 1) * FILL_BLOCK, size),
+        dist, key, image, tensor, params, relu_shift
+      );
+  };
+
+  threads = MIN(MAX(threads, 1), (int) items);
+  for(int t = 1; t < threads; t++)
+    workers.push_back(std::thread(work));
+  work();
+  for(auto &worker : workers)
+    worker.join();
+}
+
+void fill_random(
+  const conv_shape_t &shape,
+  data_in_t *input,
+  data_in_t *weights,
+  uint64_t seed,
+  uint32_t image,
+  const fill_params_t &params
+)
+{
+  size_t input_size = (size_t) BATCHES * shape.n * shape.rr() * shape.cc();
+  size_t weights_size = (size_t) BATCHES * shape.n * shape.m * shape.k * shape.k;
+
+  fill_tensor(input, input_size, params.input, seed, image, 0, params);
+  fill_tensor(weights, weights_size, params.weights, seed, image, 1, params);
+}
+
+void fill_random(
+  data_in_t input[BATCHES][N][RR][CC],
+  data_in_t weights[BATCHES][N][M][K][K],
+  uint64_t seed,
+  uint32_t image,
+  const fill_params_t &params
+)
+{
+  fill_random(max_shape, &input[0][0][0][0], &weights[0][0][0][0][0], seed, image, params);
+}
+
+bool fill_preset(const char *name, fill_params_t *params)
+{
+  *params = fill_uniform;
+  params->sigma = .1f;
+
+  if(strcmp(name, "uniform") == 0)
+    *params = fill_uniform;
+  else if(strcmp(name, "relu") == 0)
+  {
+    params->input = FILL_RELU;
+    params->weights = FILL_GAUSSIAN;
+  }
+  else if(strcmp(name, "image") == 0)
+  {
+    params->input = FILL_IMAGE;
+    params->weights = FILL_GAUSSIAN;
+  }
+  else
+    return false;
+  return true;
+}
+
+void fill_random(
+  data_in_t input[BATCHES][N][RR][CC],
+  data_in_t weights[BATCHES][N][M][K][K]
+)
+{
+  fill_random(max_shape, &input[0][0][0][0], &weights[0][0][0][0][0]);
+}
+
+void fill_random(
+  const conv_shape_t &shape,
+  data_in_t *input,
+  data_in_t *weights
+)
+{
+  // Seed from rand(): a new image on each call, reproducible with srand()
+  fill_random(shape, input, weights, rand(), 0);
+}
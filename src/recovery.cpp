@@ -0,0 +1,337 @@
+#include "recovery.h"
+
+#include <algorithm> // copy, fill
+#include <err.h>
+
+ConvRecovery::ConvRecovery(
+  ConvSession &_session,
+  recovery_t _mode,
+  Clkwiz *_clkwiz,
+  int _safe,
+  int _retries
+)
+  : session(_session)
+  , mode(_mode)
+  , clkwiz(_clkwiz)
+  , safe(_safe)
+  , retries(_retries)
+  , requant(no_requant)
+  , recomputed(0)
+  , outputs(0)
+  , calls(0)
+{}
+
+// Copy the input window and output maps of each tile of the sub-batch (zeros
+// outside of the layer)
+void ConvRecovery::pack(
+  const conv_shape_t &shape,
+  const conv_shape_t &sub,
+  const data_in_t *layer_input,
+  const data_in_t *layer_weights
+)
+{
+  int slot, b, to, row, col, tile, ti, tto, y, x;
+  int tiles_m = shape.tiles_m(), tiles_r = shape.tiles_r(), tiles_c = shape.tiles_c();
+  size_t kk = (size_t) shape.k * shape.k;
+
+  std::fill(input.begin(), input.end(), data_in_t(0));
+  std::fill(weights.begin(), weights.end(), data_in_t(0));
+
+  for(slot = 0; slot < BATCHES; slot++)
+  {
+    if(tiles[slot] < 0)
+      continue;
+
+    tile = tiles[slot];
+    col = (tile % tiles_c) * Tc;
+    row = (tile / tiles_c % tiles_r) * Tr;
+    to = (tile / tiles_c / tiles_r % tiles_m) * Tm;
+    b = tile / tiles_c / tiles_r / tiles_m;
+
+    for(ti = 0; ti < shape.n; ti++)
+    {
+      for(y = 0; y < MIN(sub.rr(), shape.rr() - row * S); y++)
+      {
+        for(x = 0; x < MIN(sub.cc(), shape.cc() - col * S); x++)
+        {
+          input[((size_t) (slot * sub.n + ti) * sub.rr() + y) * sub.cc() + x] =
+            layer_input[((size_t) (b * shape.n + ti) * shape.rr() + row * S + y) * shape.cc() + col * S + x];
+        }
+      }
+
+      for(tto = 0; tto < MIN(sub.m, shape.m - to); tto++)
+      {
+        std::copy(
+          layer_weights + ((size_t) (b * shape.n + ti) * shape.m + to + tto) * kk,
+          layer_weights + ((size_t) (b * shape.n + ti) * shape.m + to + tto + 1) * kk,
+          &weights[((size_t) (slot * sub.n + ti) * sub.m + tto) * kk]
+        );
+      }
+    }
+  }
+}
+
+// Copy valid outputs of each recomputed tile (not failed again) in the layer
+void ConvRecovery::patch(
+  const conv_shape_t &shape,
+  const conv_shape_t &sub,
+  data_in_t *layer_output
+)
+{
+  int slot, b, to, row, col, tile, tto, y;
+  int tiles_m = shape.tiles_m(), tiles_r = shape.tiles_r(), tiles_c = shape.tiles_c();
+
+  for(slot = 0; slot < BATCHES; slot++)
+  {
+    if(tiles[slot] < 0 || failed[slot])
+      continue;
+
+    tile = tiles[slot];
+    col = (tile % tiles_c) * Tc;
+    row = (tile / tiles_c % tiles_r) * Tr;
+    to = (tile / tiles_c / tiles_r % tiles_m) * Tm;
+    b = tile / tiles_c / tiles_r / tiles_m;
+
+    for(tto = 0; tto < MIN(sub.m, shape.m - to); tto++)
+    {
+      for(y = 0; y < MIN(sub.r, shape.r - row); y++)
+      {
+        const data_in_t *from = &output[((size_t) (slot * sub.m + tto) * sub.r + y) * sub.c];
+
+        std::copy(
+          from,
+          from + MIN(sub.c, shape.c - col),
+          layer_output + ((size_t) (b * shape.m + to + tto) * shape.r + row + y) * shape.c + col
+        );
+      }
+    }
+  }
+}
+
+// Requantization of sub-batch maps from layer maps [to, to + sub.m) (maps out
+// of the layer keep the fixed rescale, their outputs are not patched)
+void ConvRecovery::offset_requant(
+  const conv_shape_t &shape,
+  const conv_shape_t &sub,
+  const conv_requant_t &layer,
+  int to
+)
+{
+  int tto;
+
+  requant = no_requant;
+  if(!layer.enabled())
+    return;
+
+  shift.assign(sub.m, REQUANT_SHIFT);
+  mult.assign(sub.m, data_in_t(1));
+  for(tto = 0; tto < MIN(sub.m, shape.m - to); tto++)
+  {
+    if(layer.shift)
+      shift[tto] = layer.shift[to + tto];
+    if(layer.mult)
+      mult[tto] = layer.mult[to + tto];
+  }
+  requant.shift = layer.shift ? shift.data() : NULL;
+  requant.mult = layer.mult ? mult.data() : NULL;
+}
+
+#ifdef FINE_ABFT
+// Recompute outputs of the failed region of a tile in the layer
+void ConvRecovery::recompute(
+  const conv_shape_t &shape,
+  int tile,
+  const abft_region_t &region,
+  const data_in_t *layer_input,
+  const data_in_t *layer_weights,
+  data_in_t *layer_output
+)
+{
+  int b, to, row, col, lane, tto, y, x, ti, i, j;
+  int tiles_m = shape.tiles_m(), tiles_r = shape.tiles_r(), tiles_c = shape.tiles_c();
+  data_out_t acc;
+
+  col = (tile % tiles_c) * Tc;
+  row = (tile / tiles_c % tiles_r) * Tr;
+  to = (tile / tiles_c / tiles_r % tiles_m) * Tm;
+  b = tile / tiles_c / tiles_r / tiles_m;
+
+  for(lane = 0; lane < Um; lane++)
+  {
+    if(region.lanes != 0 && !region.lanes[lane])
+      continue;
+
+    for(tto = lane; tto < MIN(Tm, shape.m - to); tto += Um)
+    {
+      for(y = 0; y < MIN(Tr, shape.r - row); y++)
+      {
+        if(region.rows != 0 && !region.rows[y])
+          continue;
+
+        for(x = 0; x < MIN(Tc, shape.c - col); x++)
+        {
+          if(region.cols != 0 && !region.cols[x])
+            continue;
+
+          acc = 0;
+          for(ti = 0; ti < shape.n; ti++)
+            for(i = 0; i < shape.k; i++)
+              for(j = 0; j < shape.k; j++)
+                acc += layer_input[((size_t) (b * shape.n + ti) * shape.rr() + (row + y) * S + i) * shape.cc() + (col + x) * S + j] *
+                  layer_weights[(((size_t) (b * shape.n + ti) * shape.m + to + tto) * shape.k + i) * shape.k + j];
+
+          layer_output[((size_t) (b * shape.m + to + tto) * shape.r + row + y) * shape.c + col + x] = session.get_requant().apply(acc, to + tto);
+        }
+      }
+    }
+  }
+}
+#endif
+
+int ConvRecovery::recover(
+  const conv_shape_t &shape,
+  const data_in_t *layer_input,
+  const data_in_t *layer_weights,
+  data_in_t *layer_output,
+  bool *layer_failed
+)
+{
+  const conv_shape_t sub = {shape.n, MIN(Tm, shape.m), MIN(Tr, shape.r), MIN(Tc, shape.c), shape.k};
+  const conv_requant_t layer_requant = session.get_requant();
+  int tiles_m = shape.tiles_m(), tiles_rc = shape.tiles_r() * shape.tiles_c();
+  // With a requantization, each sub-batch only holds tiles of one group of
+  // output maps
+  int groups = layer_requant.enabled() ? tiles_m : 1;
+  int tile, slot, group, round, remaining, frequency = -1;
+
+  if(session.get_epilogue().enabled())
+    errx(-2, "ConvRecovery does not support layer epilogues");
+
+  time.start();
+
+#ifdef FINE_ABFT
+  // Only failed regions, always successful
+  if(mode == RECOVERY_REGION)
+  {
+    for(tile = 0; tile < shape.tiles(); tile++)
+    {
+      if(!layer_failed[tile])
+        continue;
+
+      const abft_region_t &region = session.failed_regions()[tile];
+      recompute(shape, tile, region, layer_input, layer_weights, layer_output);
+      recomputed++;
+      outputs += region.outputs();
+      layer_failed[tile] = false;
+    }
+
+    time.stop();
+    return 0;
+  }
+#endif
+
+  input.resize((size_t) BATCHES * sub.n * sub.rr() * sub.cc());
+  weights.resize((size_t) BATCHES * sub.n * sub.m * sub.k * sub.k);
+  output.resize((size_t) BATCHES * sub.m * sub.r * sub.c);
+
+  // Safer frequency for accelerator recovery
+  if(mode == RECOVERY_ACCELERATOR && clkwiz)
+  {
+    frequency = clkwiz->index();
+    clkwiz->select(safe);
+  }
+
+  for(round = 0; round < (mode == RECOVERY_CPU ? 1 : retries); round++)
+  {
+    remaining = 0;
+    for(group = 0; group < groups; group++)
+    {
+      offset_requant(shape, sub, layer_requant, group * Tm);
+      if(mode == RECOVERY_ACCELERATOR)
+        session.set_requant(requant);
+
+      tile = 0;
+      while(tile < shape.tiles())
+      {
+        // Next sub-batch of failed tiles
+        for(slot = 0; slot < BATCHES; slot++)
+        {
+          while(tile < shape.tiles() &&
+            (!layer_failed[tile] || (groups > 1 && tile / tiles_rc % tiles_m != group)))
+            tile++;
+          tiles[slot] = (tile < shape.tiles()) ? tile++ : -1;
+        }
+        if(tiles[0] < 0)
+          break;
+
+        pack(shape, sub, layer_input, layer_weights);
+        if(mode == RECOVERY_CPU)
+          convolution_simd(sub, input.data(), weights.data(), output.data(), failed, true, NULL, NULL, requant);
+        else
+          session.run(sub, input.data(), weights.data(), output.data(), failed);
+        patch(shape, sub, layer_output);
+        calls++;
+
+        for(slot = 0; slot < BATCHES && tiles[slot] >= 0; slot++)
+        {
+          recomputed++;
+          outputs += Tm * Tr * Tc;
+          layer_failed[tiles[slot]] = failed[slot];
+          if(failed[slot])
+            remaining++;
+        }
+      }
+    }
+
+    if(remaining == 0)
+      break;
+  }
+
+  if(mode == RECOVERY_ACCELERATOR)
+    session.set_requant(layer_requant);
+  if(frequency >= 0)
+    clkwiz->select(frequency);
+
+  time.stop();
+
+  // Tiles still failed after all rounds
+  remaining = 0;
+  for(tile = 0; tile < shape.tiles(); tile++)
+    if(layer_failed[tile])
+      remaining++;
+
+  return remaining;
+} // ConvRecovery::recover()
+
+int ConvRecovery::run(
+  const conv_shape_t &shape,
+  const data_in_t *input,
+  const data_in_t *weights,
+  data_in_t *output,
+  bool *failed,
+  bool doabft
+)
+{
+  if(session.run(shape, input, weights, output, failed, doabft) == 0)
+    return 0;
+
+  return recover(shape, input, weights, output, failed);
+}
+
+int ConvRecovery::run(
+  data_in_t input[BATCHES][N][RR][CC],
+  data_in_t weights[BATCHES][N][M][K][K],
+  data_in_t output[BATCHES][M][R][C],
+  bool failed[TILES],
+  bool doabft
+)
+{
+  return run(
+    max_shape,
+    &input[0][0][0][0],
+    &weights[0][0][0][0][0],
+    &output[0][0][0][0],
+    failed,
+    doabft
+  );
+}
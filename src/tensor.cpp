@@ -0,0 +1,297 @@
+#include "tensor.h"
+
+#include <err.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// Bytes per element of the build word length
+#define TENSOR_BYTES ((DATA_WL <= 8) ? 1 : (DATA_WL <= 16) ? 2 : (DATA_WL <= 32) ? 4 : 8)
+
+size_t tensor_size(tensor_kind_t kind, const conv_shape_t &shape)
+{
+  switch(kind)
+  {
+    case TENSOR_INPUT:
+      return (size_t) BATCHES * shape.n * shape.rr() * shape.cc();
+    case TENSOR_WEIGHTS:
+      return (size_t) BATCHES * shape.n * shape.m * shape.k * shape.k;
+    case TENSOR_OUTPUT:
+      return (size_t) BATCHES * shape.m * shape.r * shape.c;
+  }
+  return 0;
+}
+
+Tensor::Tensor(tensor_kind_t kind, const conv_shape_t &shape, bool _pinned)
+  : _kind(kind)
+  , _shape(shape)
+  , count(tensor_size(kind, shape))
+  , pinned(_pinned)
+{
+  void *memory;
+
+  if(pinned)
+  {
+    memory = sds_alloc(bytes());
+    if(!memory)
+      errx(2, "%s on line %d: sds_alloc() of %zu bytes", __FILE__, __LINE__ - 2, bytes());
+  }
+  else if(posix_memalign(&memory, TENSOR_ALIGN, bytes()) != 0)
+    errx(2, "%s on line %d: posix_memalign() of %zu bytes", __FILE__, __LINE__ - 1, bytes());
+
+  buffer = (data_in_t *) memory;
+  memset((void *) buffer, 0, bytes());
+}
+
+Tensor::~Tensor()
+{
+  if(pinned)
+    sds_free(buffer);
+  else
+    free(buffer);
+}
+
+tensor_kind_t Tensor::kind() const
+{
+  return _kind;
+}
+
+conv_shape_t Tensor::shape() const
+{
+  return _shape;
+}
+
+size_t Tensor::size() const
+{
+  return count;
+}
+
+size_t Tensor::bytes() const
+{
+  return count * sizeof(data_in_t);
+}
+
+data_in_t *Tensor::data()
+{
+  return buffer;
+}
+
+const data_in_t *Tensor::data() const
+{
+  return buffer;
+}
+
+data_in_t (*Tensor::input())[N][RR][CC]
+{
+  if((_kind != TENSOR_INPUT) || !(_shape == max_shape))
+    errx(2, "tensor is not an input of the synthesized shape");
+  return (data_in_t (*)[N][RR][CC]) buffer;
+}
+
+data_in_t (*Tensor::weights())[N][M][K][K]
+{
+  if((_kind != TENSOR_WEIGHTS) || !(_shape == max_shape))
+    errx(2, "tensor is not weights of the synthesized shape");
+  return (data_in_t (*)[N][M][K][K]) buffer;
+}
+
+data_in_t (*Tensor::output())[M][R][C]
+{
+  if((_kind != TENSOR_OUTPUT) || !(_shape == max_shape))
+    errx(2, "tensor is not an output of the synthesized shape");
+  return (data_in_t (*)[M][R][C]) buffer;
+}
+
+int convolution(
+  const Tensor &input,
+  const Tensor &weights,
+  Tensor &output,
+  bool *failed,
+  bool doabft,
+  conv_stats_t *stats
+)
+{
+  conv_shape_t shape = input.shape();
+
+  if((input.kind() != TENSOR_INPUT) || (weights.kind() != TENSOR_WEIGHTS) ||
+     (output.kind() != TENSOR_OUTPUT) ||
+     !(weights.shape() == shape) || !(output.shape() == shape))
+    errx(2, "convolution(): tensors of different layers");
+
+  return convolution(shape, input.data(), weights.data(), output.data(), failed, doabft, NULL, NULL, stats);
+}
+
+TensorReader::TensorReader(const char *path)
+{
+  struct stat st;
+  conv_shape_t layer;
+
+  fd = open(path, O_RDONLY);
+  if(fd < 0)
+    err(2, "%s on line %d: open(%s)", __FILE__, __LINE__ - 1, path);
+  if(fstat(fd, &st) != 0)
+    err(2, "%s on line %d: fstat()", __FILE__, __LINE__ - 1);
+
+  length = st.st_size;
+  if(length < sizeof(header))
+    errx(2, "%s: not a tensor file", path);
+
+  map = (const char *) mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+  if(MAP_FAILED == map)
+    err(2, "%s on line %d: mmap()", __FILE__, __LINE__ - 1);
+
+  memcpy(&header, map, sizeof(header));
+  layer = shape();
+
+  if((header.magic != TENSOR_MAGIC) || (header.kind > TENSOR_OUTPUT))
+    errx(2, "%s: not a tensor file", path);
+  if((header.batches != BATCHES) || (header.s != S) ||
+     (header.wl != DATA_WL) || (header.bytes != TENSOR_BYTES))
+    errx(2, "%s: batches, stride or word length differ from the build", path);
+  if(!shape_fits(layer))
+    errx(2, "%s: layer shape does not fit in the accelerator", path);
+  if(length < sizeof(header) + (size_t) header.images * size() * header.bytes)
+    errx(2, "%s: truncated file", path);
+
+  // Images are read one after another
+  madvise((void *) map, length, MADV_SEQUENTIAL);
+}
+
+TensorReader::~TensorReader()
+{
+  if(munmap((void *) map, length) != 0)
+    err(2, "%s on line %d: munmap()", __FILE__, __LINE__ - 1);
+  if(close(fd) != 0)
+    err(2, "%s on line %d: close()", __FILE__, __LINE__ - 1);
+}
+
+tensor_kind_t TensorReader::kind() const
+{
+  return (tensor_kind_t) header.kind;
+}
+
+conv_shape_t TensorReader::shape() const
+{
+  conv_shape_t layer = {(int) header.n, (int) header.m, (int) header.r, (int) header.c, (int) header.k};
+  return layer;
+}
+
+int TensorReader::images() const
+{
+  return header.images;
+}
+
+size_t TensorReader::size() const
+{
+  return tensor_size(kind(), shape());
+}
+
+void TensorReader::read(int image, Tensor &tensor)
+{
+  if((tensor.kind() != kind()) || !(tensor.shape() == shape()))
+    errx(2, "tensor image %d read in a tensor of another layer", image);
+  read(image, tensor.data());
+}
+
+void TensorReader::read(int image, data_in_t *data)
+{
+  size_t i, count = size();
+  size_t offset = sizeof(header) + (size_t) image * count * TENSOR_BYTES;
+  const char *raw = map + offset;
+  long page = sysconf(_SC_PAGESIZE);
+  size_t first, last;
+
+  if((image < 0) || (image >= images()))
+    errx(2, "tensor image %d out of range", image);
+
+  for(i = 0; i < count; i++)
+  {
+#if TENSOR_BYTES == 1
+    data[i] = ((const int8_t *) raw)[i];
+#elif TENSOR_BYTES == 2
+    data[i] = ((const int16_t *) raw)[i];
+#elif TENSOR_BYTES == 4
+    data[i] = ((const int32_t *) raw)[i];
+#else
+    data[i] = ((const int64_t *) raw)[i];
+#endif
+  }
+
+  // Release pages of this image (the next one does not share them all)
+  first = offset / page * page;
+  last = (offset + count * TENSOR_BYTES) / page * page;
+  if(last > first)
+    madvise((void *) (map + first), last - first, MADV_DONTNEED);
+}
+
+TensorWriter::TensorWriter(const char *path, tensor_kind_t kind, const conv_shape_t &shape)
+{
+  header.magic = TENSOR_MAGIC;
+  header.kind = kind;
+  header.wl = DATA_WL;
+  header.bytes = TENSOR_BYTES;
+  header.batches = BATCHES;
+  header.s = S;
+  header.n = shape.n;
+  header.m = shape.m;
+  header.r = shape.r;
+  header.c = shape.c;
+  header.k = shape.k;
+  header.images = 0;
+
+  file = fopen(path, "w+b");
+  if(!file)
+    err(2, "%s on line %d: fopen(%s)", __FILE__, __LINE__ - 1, path);
+  if(fwrite(&header, sizeof(header), 1, file) != 1)
+    err(2, "%s on line %d: fwrite()", __FILE__, __LINE__ - 1);
+}
+
+TensorWriter::~TensorWriter()
+{
+  if(fclose(file) != 0)
+    err(2, "%s on line %d: fclose()", __FILE__, __LINE__ - 1);
+}
+
+int TensorWriter::images() const
+{
+  return header.images;
+}
+
+size_t TensorWriter::size() const
+{
+  conv_shape_t shape = {(int) header.n, (int) header.m, (int) header.r, (int) header.c, (int) header.k};
+  return tensor_size((tensor_kind_t) header.kind, shape);
+}
+
+void TensorWriter::write(const data_in_t *data)
+{
+  size_t i, count = size();
+#if TENSOR_BYTES == 1
+  std::vector<int8_t> raw(count);
+#elif TENSOR_BYTES == 2
+  std::vector<int16_t> raw(count);
+#elif TENSOR_BYTES == 4
+  std::vector<int32_t> raw(count);
+#else
+  std::vector<int64_t> raw(count);
+#endif
+
+  for(i = 0; i < count; i++)
+    raw[i] = data[i].to_int64();
+
+  if(fwrite(raw.data(), TENSOR_BYTES, count, file) != count)
+    err(2, "%s on line %d: fwrite()", __FILE__, __LINE__ - 1);
+
+  // Header is kept valid: the file can be read while written
+  header.images++;
+  if((fseek(file, 0, SEEK_SET) != 0) ||
+     (fwrite(&header, sizeof(header), 1, file) != 1) ||
+     (fseek(file, 0, SEEK_END) != 0) ||
+     (fflush(file) != 0))
+    err(2, "%s on line %d: header update", __FILE__, __LINE__ - 4);
+}
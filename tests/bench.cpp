@@ -0,0 +1,60 @@
+#include <gtest/gtest.h>
+#include <sstream>
+
+#include "bench.h"
+
+#define IMAGES 3
+
+TEST(BenchTest, Percentile)
+{
+  std::vector<double> values = {5, 1, 4, 2, 3};
+  std::vector<double> empty;
+
+  // Nearest rank
+  EXPECT_EQ(1, percentile(values, 0));
+  EXPECT_EQ(1, percentile(values, 20));
+  EXPECT_EQ(2, percentile(values, 21));
+  EXPECT_EQ(3, percentile(values, 50));
+  EXPECT_EQ(5, percentile(values, 90));
+  EXPECT_EQ(5, percentile(values, 100));
+  EXPECT_EQ(0, percentile(empty, 50));
+}
+
+TEST(BenchTest, Point)
+{
+  ConvSession session;
+  bench_result_t result;
+  std::ostringstream header, line;
+  int columns = 0;
+
+  session.init();
+  result = bench_point(session, 100.f, IMAGES, true);
+
+  EXPECT_EQ(100.f, result.frequency);
+  EXPECT_EQ(IMAGES, result.images);
+  EXPECT_TRUE(result.doabft);
+  EXPECT_GT(result.p50, 0.);
+  EXPECT_LE(result.p50, result.p90);
+  EXPECT_LE(result.p90, result.p99);
+  EXPECT_GT(result.images_per_s, 0.);
+  EXPECT_EQ(0., result.failure_rate);
+
+  // Throughput is consistent with the mean latency
+  EXPECT_NEAR(
+    2. * BATCHES * M * N * R * C * K * K * result.images_per_s / 1e9,
+    result.gops,
+    result.gops * 1e-6
+  );
+
+  // Session stats cover this point only
+  EXPECT_EQ((uint64_t) IMAGES, session.stats.calls);
+
+  print_bench_header(header);
+  print_bench(line, result);
+  for(char ch : header.str())
+    columns += (ch == ',');
+  for(char ch : line.str())
+    columns -= (ch == ',');
+  EXPECT_EQ(0, columns);
+  std::cerr << header.str() << line.str();
+}
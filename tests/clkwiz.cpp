@@ -0,0 +1,289 @@
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "clkwiz.h"
+#include "tools.h"
+
+#define MINFREQ (INPUT_CLK - 1)
+#define MAXFREQ (2 * INPUT_CLK + 1)
+#define STEP .01f
+#define CACHE "clkwiz_test_settings.bin"
+
+namespace
+{
+  bool legacy_cmp(Settings* a, Settings* b)
+  {
+    return a->out < b->out;
+  }
+
+  // Previous table generation (one heap allocation by legal solution), for
+  // comparison
+  std::vector<Settings*> legacy_settings(float minfreq, float maxfreq, float step)
+  {
+    float clkfbout, divclk_divide, clkout0_divide, vco, pfd, out, goal;
+    std::vector<Settings*> tmp, settings;
+    std::vector<Settings*>::iterator it;
+
+    for(divclk_divide = ceil(INPUT_CLK / PFDMAX); divclk_divide <= floor(INPUT_CLK / PFDMIN); divclk_divide++)
+    {
+      pfd = INPUT_CLK / divclk_divide;
+
+      for(clkfbout = ceil8(VCOMIN / pfd); clkfbout <= floor8(VCOMAX / pfd); clkfbout += .125f)
+      {
+        vco = pfd * clkfbout;
+
+        for(clkout0_divide = ceil8(vco / maxfreq); clkout0_divide <= floor8(vco / minfreq); clkout0_divide += .125f)
+        {
+          out = vco / clkout0_divide;
+          tmp.push_back(new Settings(clkfbout, divclk_divide, clkout0_divide, out));
+        }
+      }
+    }
+
+    std::sort(tmp.begin(), tmp.end(), legacy_cmp);
+
+    goal = minfreq;
+    for(it = tmp.begin(); it != tmp.end(); it++)
+    {
+      if((*it)->out >= goal)
+      {
+        settings.push_back(*it);
+        goal += step;
+      }
+      else
+      {
+        delete *it;
+      }
+    }
+
+    return settings;
+  }
+} // namespace
+
+TEST(ClkwizTest, Generate)
+{
+  std::vector<Settings*> legacy = legacy_settings(MINFREQ, MAXFREQ, STEP);
+  std::vector<Settings> settings = Clkwiz::generate(MINFREQ, MAXFREQ, STEP);
+  size_t i;
+
+  ASSERT_EQ(legacy.size(), settings.size());
+  for(i = 0; i < settings.size(); i++)
+  {
+    EXPECT_EQ(legacy[i]->out, settings[i].out);
+    EXPECT_EQ((float) legacy[i]->clkfbout, (float) settings[i].clkfbout);
+    EXPECT_EQ((int) legacy[i]->divclk_divide, (int) settings[i].divclk_divide);
+    EXPECT_EQ((float) legacy[i]->clkout0_divide, (float) settings[i].clkout0_divide);
+    EXPECT_EQ(settings[i].out, settings[i].getFrequency());
+    delete legacy[i];
+  }
+}
+
+TEST(ClkwizTest, Cache)
+{
+  std::vector<Settings> settings = Clkwiz::generate(MINFREQ, MAXFREQ, STEP), loaded, bad;
+  size_t i;
+
+  unlink(CACHE);
+  EXPECT_FALSE(Clkwiz::loadSettings(CACHE, loaded, MINFREQ, MAXFREQ, STEP));
+  ASSERT_TRUE(Clkwiz::saveSettings(CACHE, settings, MINFREQ, MAXFREQ, STEP));
+
+  // Other parameters: not this table
+  EXPECT_FALSE(Clkwiz::loadSettings(CACHE, loaded, MINFREQ, MAXFREQ, 2 * STEP));
+
+  ASSERT_TRUE(Clkwiz::loadSettings(CACHE, loaded, MINFREQ, MAXFREQ, STEP));
+  ASSERT_EQ(settings.size(), loaded.size());
+  for(i = 0; i < settings.size(); i++)
+  {
+    EXPECT_EQ(settings[i].out, loaded[i].out);
+    EXPECT_EQ((float) settings[i].clkfbout, (float) loaded[i].clkfbout);
+    EXPECT_EQ((int) settings[i].divclk_divide, (int) loaded[i].divclk_divide);
+    EXPECT_EQ((float) settings[i].clkout0_divide, (float) loaded[i].clkout0_divide);
+  }
+
+  // Tables of the stub wizard are only loaded on request
+  ASSERT_TRUE(Clkwiz::saveSettings(CACHE, settings, MINFREQ, MAXFREQ, STEP, true));
+  EXPECT_FALSE(Clkwiz::loadSettings(CACHE, loaded, MINFREQ, MAXFREQ, STEP));
+  EXPECT_TRUE(Clkwiz::loadSettings(CACHE, loaded, MINFREQ, MAXFREQ, STEP, true));
+
+  // Settings not giving their frequency, or out of MMCM bounds
+  bad = settings;
+  bad[0].out += 1.f;
+  ASSERT_TRUE(Clkwiz::saveSettings(CACHE, bad, MINFREQ, MAXFREQ, STEP));
+  EXPECT_FALSE(Clkwiz::loadSettings(CACHE, loaded, MINFREQ, MAXFREQ, STEP));
+  bad = settings;
+  bad[0] = Settings(1, 1, 1, INPUT_CLK); // VCO under VCOMIN
+  ASSERT_TRUE(Clkwiz::saveSettings(CACHE, bad, MINFREQ, MAXFREQ, STEP));
+  EXPECT_FALSE(Clkwiz::loadSettings(CACHE, loaded, MINFREQ, MAXFREQ, STEP));
+
+  // Instances use the cache (stub clocking wizard: its own table)
+  unlink(CACHE);
+  {
+    Clkwiz first(SAFE_CLK, 2 * SAFE_CLK, .5f, CACHE);
+    Clkwiz second(SAFE_CLK, 2 * SAFE_CLK, .5f, CACHE);
+
+    ASSERT_EQ(first.count(), second.count());
+    for(i = 0; i < (size_t) first.count(); i++)
+      EXPECT_EQ(first.frequency(i), second.frequency(i));
+  }
+  unlink(CACHE);
+}
+
+TEST(ClkwizTest, SetFrequency)
+{
+  Clkwiz clkwiz(SAFE_CLK, 2 * SAFE_CLK, .5f);
+  float freq, best;
+  int i, trial;
+
+  srand(42);
+  for(trial = 0; trial < 1000; trial++)
+  {
+    freq = SAFE_CLK - 10 + (rand() % 12000) / 100.f;
+
+    best = clkwiz.frequency(0);
+    for(i = 0; i < clkwiz.count(); i++)
+      if(fabs(clkwiz.frequency(i) - freq) < fabs(best - freq))
+        best = clkwiz.frequency(i);
+
+    // Nearest one (either one on ties)
+    EXPECT_EQ(fabs(best - freq), fabs(clkwiz.setFrequency(freq) - freq)) << "for " << freq;
+    EXPECT_EQ(clkwiz.frequency(clkwiz.index()), clkwiz.setFrequency(freq));
+  }
+}
+
+TEST(ClkwizTest, StartupTime)
+{
+  perf_counter legacy, table, cache;
+  std::vector<Settings*> legacy_table;
+  std::vector<Settings> settings, loaded;
+  size_t i;
+
+  legacy.start();
+  legacy_table = legacy_settings(MINFREQ, MAXFREQ, STEP);
+  legacy.stop();
+  for(i = 0; i < legacy_table.size(); i++)
+    delete legacy_table[i];
+
+  table.start();
+  settings = Clkwiz::generate(MINFREQ, MAXFREQ, STEP);
+  table.stop();
+
+  ASSERT_TRUE(Clkwiz::saveSettings(CACHE, settings, MINFREQ, MAXFREQ, STEP));
+  cache.start();
+  EXPECT_TRUE(Clkwiz::loadSettings(CACHE, loaded, MINFREQ, MAXFREQ, STEP));
+  cache.stop();
+  unlink(CACHE);
+
+  std::cerr << settings.size() << " settings: legacy " << legacy.tot
+    << ", flat table " << table.tot << ", cached " << cache.tot << std::endl;
+}
+
+namespace
+{
+  // Real settings table (from a cache file, also used with the stub wizard)
+  class ClkwizRegsTest : public ::testing::Test
+  {
+    protected:
+      MockClkwizRegs regs;
+      Clkwiz *clkwiz;
+
+      virtual void SetUp()
+      {
+        std::vector<Settings> settings = Clkwiz::generate(MINFREQ, MAXFREQ, 1);
+
+        ASSERT_TRUE(Clkwiz::saveSettings(CACHE, settings, MINFREQ, MAXFREQ, 1));
+        clkwiz = new Clkwiz(MINFREQ, MAXFREQ, 1, CACHE, &regs);
+        unlink(CACHE);
+      }
+
+      virtual void TearDown()
+      {
+        delete clkwiz;
+      }
+  };
+} // namespace
+
+TEST_F(ClkwizRegsTest, OnlyChangedRegisters)
+{
+  int i, cr0, clkout0, cr23;
+
+  clkwiz->restart();
+  EXPECT_EQ(1, regs.writes(CR0));
+  EXPECT_EQ(1, regs.writes(CLKOUT0_DIVIDE));
+  EXPECT_EQ(1, regs.writes(CR23));
+
+  // Same settings: nothing written
+  clkwiz->select(0);
+  EXPECT_EQ(1, regs.writes(CR23));
+
+  // Each switch writes the registers that changed, and reloads once
+  for(i = 1; i < clkwiz->count(); i++)
+  {
+    cr0 = regs.writes(CR0);
+    clkout0 = regs.writes(CLKOUT0_DIVIDE);
+    cr23 = regs.writes(CR23);
+    clkwiz->select(i);
+    EXPECT_LE(regs.writes(CR0) - cr0 + regs.writes(CLKOUT0_DIVIDE) - clkout0, 2);
+    EXPECT_GE(regs.writes(CR0) - cr0 + regs.writes(CLKOUT0_DIVIDE) - clkout0, 1);
+    EXPECT_EQ(cr23 + 1, regs.writes(CR23));
+  }
+
+  // Registers hold the last settings
+  EXPECT_EQ(clkwiz->frequency(clkwiz->count() - 1), clkwiz->frequency(clkwiz->index()));
+  EXPECT_EQ(0, clkwiz->timeoutCount());
+}
+
+TEST_F(ClkwizRegsTest, LockLatency)
+{
+  const int delay = 200; // us
+  const LatencyHistogram &latency = clkwiz->lockLatency();
+  uint64_t bucketed = 0;
+  int i;
+
+  regs.setDelay(delay);
+  for(i = 0; i < 10; i++)
+    clkwiz->select(i);
+
+  EXPECT_EQ(10u, latency.count);
+  EXPECT_GE(latency.min, delay * 1000u);
+  EXPECT_GE(latency.mean(), delay * 1000u);
+  for(i = 0; i < LATENCY_BUCKETS; i++)
+    bucketed += latency.bucket[i];
+  EXPECT_EQ(latency.count, bucketed);
+  EXPECT_EQ(0u, latency.bucket[0]); // not under 1 us
+  EXPECT_EQ(0, clkwiz->timeoutCount());
+
+  std::cerr << "lock latency: min " << latency.min << ", mean " << latency.mean()
+    << ", max " << latency.max << std::endl;
+}
+
+TEST_F(ClkwizRegsTest, Timeout)
+{
+  perf_counter time;
+  int cr0, clkout0;
+
+  clkwiz->restart();
+  clkwiz->setTimeout(1000);
+  regs.setDelay(-1); // never locks again
+
+  time.start();
+  EXPECT_EQ(0.f, clkwiz->select(1));
+  time.stop();
+
+  // Bounded: next switch gives up too (still unlocked)
+  EXPECT_EQ(0.f, clkwiz->select(2));
+  EXPECT_EQ(2, clkwiz->timeoutCount());
+  EXPECT_LT(time.tot, 1000000000u);
+
+  // Failed switches keep the settings, and all registers are written again
+  // once the MMCM locks
+  EXPECT_EQ(0, clkwiz->index());
+  regs.setDelay(0);
+  regs.write(CR23, 0x03);
+  cr0 = regs.writes(CR0);
+  clkout0 = regs.writes(CLKOUT0_DIVIDE);
+  EXPECT_EQ(clkwiz->frequency(1), clkwiz->select(1));
+  EXPECT_EQ(cr0 + 1, regs.writes(CR0));
+  EXPECT_EQ(clkout0 + 1, regs.writes(CLKOUT0_DIVIDE));
+  EXPECT_EQ(2, clkwiz->timeoutCount());
+}
@@ -1,19 +1,35 @@
 #include <gtest/gtest.h>
 #include <stdlib.h>
+#include <vector>
 
 #include "convolution.h"
 #include "io.h"
 #include "golden_convolution.h"
+#include "tensor.h"
 
 namespace
 {
   class ConvolutionTest : public ::testing::Test
   {
     protected:
-      data_in_t input[BATCHES][N][RR][CC];
-      data_in_t weights[BATCHES][N][M][K][K];
-      data_in_t output[BATCHES][M][R][C];
-      data_in_t golden_output[BATCHES][M][R][C];
+      // Heap tensors, and their views as synthesized-shape arrays
+      Tensor input_data, weights_data, output_data, golden_data;
+      data_in_t (*input)[N][RR][CC];
+      data_in_t (*weights)[N][M][K][K];
+      data_in_t (*output)[M][R][C];
+      data_in_t (*golden_output)[M][R][C];
+
+      ConvolutionTest()
+        : input_data(TENSOR_INPUT)
+        , weights_data(TENSOR_WEIGHTS)
+        , output_data(TENSOR_OUTPUT)
+        , golden_data(TENSOR_OUTPUT)
+        , input(input_data.input())
+        , weights(weights_data.weights())
+        , output(output_data.output())
+        , golden_output(golden_data.output())
+      {
+      }
 
       virtual void SetUp()
       {
@@ -72,6 +88,95 @@ TEST_F(ConvolutionTest, PrepareInputTile)
   }
 }
 
+#ifdef INPUT_ZERO_COPY
+TEST_F(ConvolutionTest, RecvInputZeroCopy)
+{
+  data_in_t input_tile[Tn][Trr][Tcc];
+  data_in_t input_tile_hw[Tn][Trr][Tcc];
+#ifdef ENABLE_HARDWARE_ABFT
+  hls::stream<section_t> section_fifo;
+  section_t section;
+#endif
+#ifdef FINE_ABFT
+  hls::stream<section_t> row_section_fifo[SECTIONS], col_section_fifo[SECTIONS];
+  int s;
+#endif
+#ifdef PROFILING
+  hw_profile_t profile = {0, 0};
+#endif
+  int row, col, ti;
+  int iti, ir, ic;
+
+  // Tiles read by accelerator must be the ones packed by host
+  for(row = 0; row < R; row += Tr)
+  {
+    for(col = 0; col < C; col += Tc)
+    {
+      for(ti = 0; ti < N; ti += Tn)
+      {
+        prepare_input_tile(ti, row, col, input[0], input_tile);
+        hw_recv_input(
+          ti, row, col,
+          input[0],
+          input_tile_hw
+#ifdef ENABLE_HARDWARE_ABFT
+          , section_fifo
+#endif
+#ifdef FINE_ABFT
+          , row_section_fifo
+          , col_section_fifo
+#endif
+#ifdef PROFILING
+          , profile
+#endif
+        );
+
+#ifdef ENABLE_HARDWARE_ABFT
+        while(!section_fifo.empty())
+          section_fifo >> section;
+#endif
+#ifdef FINE_ABFT
+        for(s = 0; s < SECTIONS; s++)
+        {
+          while(!row_section_fifo[s].empty())
+            row_section_fifo[s] >> section;
+          while(!col_section_fifo[s].empty())
+            col_section_fifo[s] >> section;
+        }
+#endif
+
+        for(iti = 0; iti < Tn; iti++)
+          for(ir = 0; ir < Trr; ir++)
+            for(ic = 0; ic < Tcc; ic++)
+              EXPECT_EQ(input_tile[iti][ir][ic], input_tile_hw[iti][ir][ic]);
+      }
+    }
+  }
+}
+#endif
+
+TEST_F(ConvolutionTest, InputPackingTime)
+{
+  const int calls = 4;
+  const transfer_volume_t volume = transfer_volume();
+  ConvSession session;
+  int call;
+
+  // Host packing of ConvSession::prepare() in this build: input tiles are
+  // not packed with INPUT_ZERO_COPY (compare builds with and without it)
+  session.init();
+  for(call = 0; call < calls; call++)
+    session.prepare(max_shape, &input[0][0][0][0], &weights[0][0][0][0][0]);
+
+  EXPECT_EQ((uint64_t) calls, session.stats.phase[PHASE_PACK].calls);
+
+  std::cerr << "input " << (INPUT_ZERO_COPY_DEFAULT ? "zero-copy" : "tiles")
+    << ": host packing " << session.stats.phase[PHASE_PACK].avg_cpu_cycles()
+    << " cycles per call, " << volume.packed << " bytes" << std::endl;
+
+  session.teardown();
+}
+
 TEST_F(ConvolutionTest, PrepareWeightsTile)
 {
   data_in_t weights_tile[Tn][Tm][K][K];
@@ -172,9 +277,78 @@ TEST_F(ConvolutionTest, ManageOutputTile)
 
 TEST_F(ConvolutionTest, ABFTValid)
 {
-  // ABFT is not valid outside of these constraints
-  ASSERT_GT(Tcc, 2 * K - S);
-  ASSERT_GT(Trr, 2 * K - S);
+  // ABFT is not valid outside of these constraints: middle rows (resp.
+  // columns) of input tiles must hold the S classes of sections
+  ASSERT_GE(Trr - 2 * (K - 1), S);
+  ASSERT_GE(Tcc - 2 * (K - 1), S);
+}
+
+TEST_F(ConvolutionTest, ABFTSections)
+{
+  // Input checksum formulation for several strides, on one input map:
+  // X[i][j] (sum of inputs multiplied by weight i, j) from sections
+  const int strides[] = {1, 2, 4};
+  int s, trr, tcc, y, x, i, j, sy, sx, prev;
+  long X, expected;
+
+  for(int is = 0; is < 3; is++)
+  {
+    s = strides[is];
+    trr = (Tr - 1) * s + K;
+    tcc = (Tc - 1) * s + K;
+    if((trr - 2 * (K - 1) < s) || (tcc - 2 * (K - 1) < s))
+      continue;
+
+    const int sections = 2 * (K - 1) + s;
+    std::vector<long> input(trr * tcc), section(sections * sections, 0);
+    for(y = 0; y < trr * tcc; y++)
+      input[y] = rand() % 1000;
+
+    // Accumulate like hw_recv_input: each section is initialized by its
+    // first value and completed (last value) in sy, sx order
+    prev = -1;
+    for(y = 0; y < trr; y++)
+    {
+      for(x = 0; x < tcc; x++)
+      {
+        sy = hw_section(y, s, K, Tr);
+        sx = hw_section(x, s, K, Tc);
+        ASSERT_LT(sy, sections);
+        ASSERT_LT(sx, sections);
+
+        if(hw_section_first(y, s, K, Tr) && hw_section_first(x, s, K, Tc))
+          section[sy * sections + sx] = input[y * tcc + x];
+        else
+          section[sy * sections + sx] += input[y * tcc + x];
+
+        if(hw_section_last(y, s, K, Tr) && hw_section_last(x, s, K, Tc))
+        {
+          EXPECT_EQ(prev + 1, sy * sections + sx) << "stride " << s;
+          prev = sy * sections + sx;
+        }
+      }
+    }
+    EXPECT_EQ(sections * sections - 1, prev) << "stride " << s;
+
+    for(i = 0; i < K; i++)
+    {
+      for(j = 0; j < K; j++)
+      {
+        X = 0;
+        for(sy = 0; sy < sections; sy++)
+          for(sx = 0; sx < sections; sx++)
+            if(hw_section_has(sy, i, s, K, Tr) && hw_section_has(sx, j, s, K, Tc))
+              X += section[sy * sections + sx];
+
+        expected = 0;
+        for(y = 0; y < Tr; y++)
+          for(x = 0; x < Tc; x++)
+            expected += input[(s * y + i) * tcc + s * x + j];
+
+        EXPECT_EQ(expected, X) << "stride " << s << " kernel " << i << ", " << j;
+      }
+    }
+  }
 }
 
 TEST_F(ConvolutionTest, ABFTTotal)
@@ -245,4 +419,72 @@ TEST_F(ConvolutionTest, Compatibility)
   ASSERT_FALSE(compatibility_check(M, N, R, C, K + 1, S, BATCHES));
   ASSERT_FALSE(compatibility_check(M, N, R, C, K, S + 1, BATCHES));
   ASSERT_FALSE(compatibility_check(M, N, R, C, K, S, BATCHES + 1));
+  ASSERT_FALSE(compatibility_check(M - 1, N, R, C, K, S, BATCHES));
+}
+
+TEST_F(ConvolutionTest, ShapeFits)
+{
+  const conv_shape_t small = {1, 1, 1, 1, 1};
+  const conv_shape_t large = {N, M + 1, R, C, K};
+  const conv_shape_t empty = {N, 0, R, C, K};
+
+  // Smaller layers run on the same accelerator
+  ASSERT_TRUE(shape_fits(max_shape));
+  ASSERT_TRUE(shape_fits(small));
+  ASSERT_FALSE(shape_fits(large));
+  ASSERT_FALSE(shape_fits(empty));
+}
+
+TEST(TransferTest, WeightsReuse)
+{
+  transfer_volume_t base, reuse;
+  int rc;
+
+  // Weights sent once per output feature maps tile: volume no longer grows
+  // with rows/columns tiles
+  for(rc = Tr; rc <= 8 * Tr; rc *= 2)
+  {
+    base = transfer_volume(N, M, rc, rc, false, false);
+    reuse = transfer_volume(N, M, rc, rc, true, false);
+
+    EXPECT_EQ(base.input, reuse.input);
+    EXPECT_EQ(base.output, reuse.output);
+    // Only weights_index is added with one rows/columns tile
+    if(rc > Tr)
+    {
+      EXPECT_LT(reuse.total(), base.total());
+    }
+    EXPECT_GE(base.weights / reuse.weights, UPPERDIV(rc, Tr) * UPPERDIV(rc, Tc) / 2);
+
+    std::cerr << "R=C=" << rc << ": weights "
+      << base.weights << " -> " << reuse.weights << " bytes, total "
+      << base.total() << " -> " << reuse.total() << " bytes" << std::endl;
+  }
+}
+
+TEST(TransferTest, InputZeroCopy)
+{
+  transfer_volume_t base, zc;
+  int rc;
+
+  // Input no longer duplicated by overlapping tiles in host memory, and
+  // padding is not transferred
+  for(rc = Tr; rc <= 8 * Tr; rc *= 2)
+  {
+    base = transfer_volume(N, M, rc, rc, false, false);
+    zc = transfer_volume(N, M, rc, rc, false, true);
+
+    EXPECT_EQ(base.weights, zc.weights);
+    EXPECT_EQ(base.output, zc.output);
+    EXPECT_LE(zc.input, base.input);
+    EXPECT_LE(zc.packed, base.packed);
+    if(rc > Tr)
+    {
+      EXPECT_LT(zc.packed, base.packed);
+    }
+
+    std::cerr << "R=C=" << rc << ": input read "
+      << base.input << " -> " << zc.input << " bytes, host packing "
+      << base.packed << " -> " << zc.packed << " bytes" << std::endl;
+  }
 }
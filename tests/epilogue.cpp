@@ -0,0 +1,176 @@
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "conv_network.h"
+#include "io.h"
+#include "golden_convolution.h"
+
+namespace
+{
+  class EpilogueTest : public ::testing::Test
+  {
+    protected:
+      std::vector<data_in_t> input, weights, bias, residual;
+      std::vector<data_in_t> output, golden_output, result;
+
+      void fill(const conv_shape_t &shape)
+      {
+        input.assign((size_t) BATCHES * shape.n * shape.rr() * shape.cc(), 0);
+        weights.assign((size_t) BATCHES * shape.n * shape.m * shape.k * shape.k, 0);
+        fill_random(shape, input.data(), weights.data(), 7, 0);
+
+        bias.resize(shape.m);
+        fill_tensor(bias.data(), bias.size(), FILL_UNIFORM, 7, 0, 2);
+        residual.resize((size_t) BATCHES * shape.m * shape.r * shape.c);
+        fill_tensor(residual.data(), residual.size(), FILL_UNIFORM, 7, 0, 3);
+
+        golden_output.resize(residual.size());
+        golden_convolution(shape, input.data(), weights.data(), golden_output.data());
+      }
+
+      // Session output against golden convolution then host epilogue
+      void check(const conv_shape_t &shape, bool with_bias, bool with_residual, bool relu, bool pool)
+      {
+        const conv_epilogue_t epilogue = {
+          with_bias ? bias.data() : NULL,
+          with_residual ? residual.data() : NULL,
+          relu,
+          pool
+        };
+        ConvSession session;
+        bool failed[TILES];
+        size_t i;
+
+        result.assign((size_t) BATCHES * shape.m * epilogue.rows(shape) * epilogue.cols(shape), 0);
+        conv_epilogue(shape, epilogue, golden_output.data(), result.data());
+
+        output.assign(result.size(), 0);
+        session.init();
+        session.set_epilogue(epilogue);
+        EXPECT_EQ(0, session.run(shape, input.data(), weights.data(), output.data(), failed));
+        session.teardown();
+
+        for(i = 0; i < result.size(); i++)
+          ASSERT_EQ(result[i], output[i]) << "element " << i;
+      }
+  };
+} // namespace
+
+TEST(EpilogueHostTest, Window)
+{
+  const conv_shape_t shape = {1, 1, 2, 4, K};
+  data_in_t out[BATCHES * 8], res[BATCHES * 8], pooled[BATCHES * 2];
+  const data_in_t b[1] = {1};
+  const conv_epilogue_t epilogue = {b, res, true, true};
+  int i;
+
+  // Bias, residual, ReLU then max of each 2x2 window
+  for(i = 0; i < BATCHES * 8; i++)
+  {
+    out[i] = i - 6;
+    res[i] = (i % 2) ? -2 : 0;
+  }
+  conv_epilogue(shape, epilogue, out, pooled);
+  EXPECT_EQ(0, pooled[0]); // max(-5, -6, -1, -2) after ReLU
+  EXPECT_EQ(1, pooled[1]); // max(-3, -4, 1, 0)
+  if(BATCHES > 1)
+  {
+    EXPECT_EQ(7, pooled[2]);
+    EXPECT_EQ(9, pooled[3]);
+  }
+}
+
+TEST_F(EpilogueTest, Session)
+{
+  const conv_shape_t shapes[] = {max_shape, {N / 2 + 1, M / 2 + 1, R - 1, C - 2, K}};
+  size_t i;
+
+  for(i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++)
+  {
+    SCOPED_TRACE(testing::Message() << "shape " << i);
+    fill(shapes[i]);
+    check(shapes[i], true, false, false, false);
+    check(shapes[i], false, true, false, false);
+    check(shapes[i], false, false, true, false);
+    check(shapes[i], false, false, false, true);
+    check(shapes[i], true, true, true, true);
+  }
+}
+
+// ABFT checks the convolution: no false alarm nor missed tile with an epilogue
+TEST_F(EpilogueTest, Abft)
+{
+  ConvSession session;
+  bool failed[TILES];
+  int tile;
+
+  fill(max_shape);
+  bias.assign(M, 1);
+  output.resize((size_t) BATCHES * M * R * C);
+
+  session.init();
+  session.set_epilogue({bias.data(), NULL, true, true});
+  EXPECT_EQ(0, session.run(max_shape, input.data(), weights.data(), output.data(), failed));
+  for(tile = 0; tile < TILES; tile++)
+    EXPECT_FALSE(failed[tile]) << "tile " << tile;
+}
+
+// Pooled output of a layer in the padded input of the next one
+TEST_F(EpilogueTest, Network)
+{
+  conv_shape_t first = {N / 2, M / 2, R, C, K};
+  std::vector<conv_layer_t> layers;
+  std::vector<data_in_t> next_input, next_weights, final_output, network_output;
+  conv_layer_t next = {{first.m, M / 2, 0, 0, K}, 0, NULL, no_epilogue};
+  int b, m, r, pad = 0, shrink;
+  size_t i;
+
+  // Padded pooled outputs must be whole strided windows of the next layer:
+  // the first one is shrunk if needed
+  for(shrink = 0; (shrink < 2 * S) && (next.shape.r == 0); shrink++)
+  {
+    for(pad = (K - 1) / 2; pad <= K; pad++)
+    {
+      int rows = (R - shrink) / 2 + 2 * pad - K, cols = (C - shrink) / 2 + 2 * pad - K;
+      if((rows >= 0) && (cols >= 0) && (rows % S == 0) && (cols % S == 0))
+      {
+        first.r = R - shrink;
+        first.c = C - shrink;
+        next.shape.r = rows / S + 1;
+        next.shape.c = cols / S + 1;
+        next.pad = pad;
+        break;
+      }
+    }
+  }
+  ASSERT_GT(next.shape.r, 0);
+
+  fill(first);
+  layers.push_back({first, 0, weights.data(), {bias.data(), NULL, true, true}});
+  next_weights.resize((size_t) BATCHES * next.shape.n * next.shape.m * K * K);
+  fill_tensor(next_weights.data(), next_weights.size(), FILL_UNIFORM, 7, 1, 1);
+  next.weights = next_weights.data();
+  layers.push_back(next);
+
+  // Golden: host epilogue, re-padding, then second layer
+  result.assign((size_t) BATCHES * first.m * (first.r / 2) * (first.c / 2), 0);
+  conv_epilogue(first, layers[0].epilogue, golden_output.data(), result.data());
+  next_input.assign((size_t) BATCHES * next.shape.n * next.shape.rr() * next.shape.cc(), 0);
+  for(b = 0; b < BATCHES; b++)
+    for(m = 0; m < first.m; m++)
+      for(r = 0; r < first.r / 2; r++)
+        std::copy(
+          result.begin() + ((b * first.m + m) * (first.r / 2) + r) * (first.c / 2),
+          result.begin() + ((b * first.m + m) * (first.r / 2) + r + 1) * (first.c / 2),
+          next_input.begin() + ((b * next.shape.n + m) * next.shape.rr() + r + pad) * next.shape.cc() + pad
+        );
+  final_output.resize((size_t) BATCHES * next.shape.m * next.shape.r * next.shape.c);
+  golden_convolution(next.shape, next_input.data(), next.weights, final_output.data());
+
+  ConvNetwork network(layers);
+  network_output.resize(final_output.size());
+  network.init();
+  EXPECT_EQ(0, network.run(input.data(), network_output.data()));
+  for(i = 0; i < final_output.size(); i++)
+    ASSERT_EQ(final_output[i], network_output[i]) << "element " << i;
+}
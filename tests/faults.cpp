@@ -0,0 +1,180 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include "recovery.h"
+#include "fixtures.h"
+
+// Faults are injected in the accelerator, only seen by hardware ABFT
+#ifdef ENABLE_HARDWARE_ABFT
+
+namespace
+{
+  class FaultTest : public LayerFixture<>
+  {
+    protected:
+      ConvSession session;
+
+      virtual void SetUp()
+      {
+        LayerFixture::SetUp();
+        golden();
+        session.init();
+      }
+
+      virtual void TearDown()
+      {
+        std::fill(hw_faults, hw_faults + HW_FAULTS, hw_fault_t());
+      }
+
+      // Timing error on output (m, r, c) of a tile, large enough for its
+      // checksums
+      void inject(int f, int tile, int m, int r, int c)
+      {
+        hw_faults[f].tile = tile;
+        hw_faults[f].m = m;
+        hw_faults[f].r = r;
+        hw_faults[f].c = c;
+        hw_faults[f].delta = data_out_t(1) << (DATA_WL + 4);
+      }
+
+      int failures()
+      {
+        return session.run(input, weights, output, failed);
+      }
+  };
+} // namespace
+
+TEST_F(FaultTest, TileFailed)
+{
+  int tile;
+
+  EXPECT_EQ(0, failures());
+
+  inject(0, TILES - 1, Tm - 1, Tr - 1, Tc - 1);
+  EXPECT_EQ(1, failures());
+  for(tile = 0; tile < TILES; tile++)
+    EXPECT_EQ(tile == TILES - 1, failed[tile]) << "tile " << tile;
+}
+
+#ifdef FINE_ABFT
+TEST_F(FaultTest, NoRegion)
+{
+  const conv_shape_t shape = {N / 2 + 1, M / 2 + 1, R - 1, C - 2, K};
+  int tile;
+
+  // Lane and row checksums also hold on partial tiles
+  fill_random(shape, &input[0][0][0][0], &weights[0][0][0][0][0]);
+  EXPECT_EQ(0, session.run(shape, &input[0][0][0][0], &weights[0][0][0][0][0], &output[0][0][0][0], failed));
+  for(tile = 0; tile < shape.tiles(); tile++)
+  {
+    EXPECT_EQ(0u, (unsigned int) session.failed_regions()[tile].lanes) << "tile " << tile;
+    EXPECT_EQ(0u, (unsigned int) session.failed_regions()[tile].rows) << "tile " << tile;
+    EXPECT_EQ(0u, (unsigned int) session.failed_regions()[tile].cols) << "tile " << tile;
+  }
+}
+
+TEST_F(FaultTest, Region)
+{
+  const abft_region_t &region = session.failed_regions()[1];
+
+  // One output: one lane, one row, one column
+  inject(0, 1, Um + 2, 3, 5);
+  EXPECT_EQ(1, failures());
+  EXPECT_EQ(1u << 2, (unsigned int) region.lanes);
+  EXPECT_EQ(1u << 3, (unsigned int) region.rows);
+  EXPECT_EQ(1u << 5, (unsigned int) region.cols);
+  EXPECT_EQ(Tm / Um, region.outputs());
+
+  // Two outputs: a 2 x 2 x 2 region
+  inject(1, 1, 0, Tr - 1, 0);
+  EXPECT_EQ(1, failures());
+  EXPECT_EQ((1u << 2) | 1u, (unsigned int) region.lanes);
+  EXPECT_EQ((1u << 3) | (1u << (Tr - 1)), (unsigned int) region.rows);
+  EXPECT_EQ((1u << 5) | 1u, (unsigned int) region.cols);
+  EXPECT_EQ(2 * (Tm / Um) * 2 * 2, region.outputs());
+}
+
+TEST_F(FaultTest, RegionRecovery)
+{
+  ConvRecovery region(session, RECOVERY_REGION), tile(session, RECOVERY_CPU);
+  int f, i;
+
+  // One faulty output in each of the first tiles
+  for(f = 0; f < MIN(HW_FAULTS, TILES); f++)
+    inject(f, f, (f * 5) % Tm, (f * 3) % Tr, (f * 7) % Tc);
+
+  EXPECT_EQ(0, region.run(input, weights, output, failed));
+  for(i = 0; i < BATCHES * M * R * C; i++)
+    ASSERT_EQ((&golden_output[0][0][0][0])[i], (&output[0][0][0][0])[i]) << "at " << i;
+  EXPECT_EQ(MIN(HW_FAULTS, TILES), region.recomputed);
+
+  EXPECT_EQ(0, tile.run(input, weights, output, failed));
+  EXPECT_EQ(0, memcmp(output, golden_output, sizeof(output)));
+
+  // Cost of lane, row and column checksums (pipelined iterations of hw_incs
+  // per input tile, next to hw_conv), against the recovery work they save
+  std::cerr << "incs iterations: +" << Trr + Tcc + (Um - 1) * K * K + (Tr + Tc) * K * K
+    << " per input tile (conv: " << UPPERDIV(Tm, Um) * Tr * Tc * K * K * UPPERDIV(Tn, Un) << ")" << std::endl
+    << "checksums per output tile: " << 1 + Um + Tr + Tc << " instead of 1" << std::endl
+    << "recovery\toutputs\ttime (cycles)" << std::endl
+    << "tiles\t\t" << tile.outputs << "\t" << tile.time.tot << std::endl
+    << "regions\t\t" << region.outputs << "\t" << region.time.tot << std::endl;
+  EXPECT_LT(region.outputs, tile.outputs);
+}
+
+TEST_F(FaultTest, Correction)
+{
+  int tile, i;
+
+  session.set_correction(true);
+
+  // Single faults (two maps of a lane at one position are still one
+  // candidate set): corrected in place
+  inject(0, 0, 1, 2, 3);
+  inject(1, TILES - 1, Tm - 1, Tr - 1, Tc - 1);
+  inject(2, TILES - 1, Tm - 1 - Um, Tr - 1, Tc - 1);
+  EXPECT_EQ(0, failures());
+  for(i = 0; i < BATCHES * M * R * C; i++)
+    ASSERT_EQ((&golden_output[0][0][0][0])[i], (&output[0][0][0][0])[i]) << "at " << i;
+  EXPECT_EQ(2u, session.stats.corrected);
+  EXPECT_EQ(0u, session.stats.failed);
+
+  // Double fault in another row and column: only this tile stays failed
+  inject(3, 0, 1 + Um / 2, 0, 0);
+  EXPECT_EQ(1, failures());
+  for(tile = 0; tile < TILES; tile++)
+    EXPECT_EQ(tile == 0, failed[tile]) << "tile " << tile;
+  EXPECT_EQ(3u, session.stats.corrected);
+
+  ConvRecovery recovery(session, RECOVERY_REGION);
+  EXPECT_EQ(0, recovery.recover(max_shape, &input[0][0][0][0], &weights[0][0][0][0][0], &output[0][0][0][0], failed));
+  EXPECT_EQ(0, memcmp(output, golden_output, sizeof(output)));
+}
+
+TEST_F(FaultTest, CorrectionShape)
+{
+  const conv_shape_t shape = {N / 2 + 1, M / 2 + 1, R - 1, C - 2, K};
+  std::vector<data_in_t> golden((size_t) BATCHES * shape.m * shape.r * shape.c);
+  int f;
+
+  fill_random(shape, &input[0][0][0][0], &weights[0][0][0][0][0]);
+  golden_convolution(shape, &input[0][0][0][0], &weights[0][0][0][0][0], golden.data());
+
+  // Last tile: partial in maps, rows and columns
+  session.set_correction(true);
+  for(f = 0; f < MIN(HW_FAULTS, shape.tiles()); f++)
+    inject(f, shape.tiles() - 1 - f, f % ((shape.m - 1) % Tm + 1), f % ((shape.r - 1) % Tr + 1), f % ((shape.c - 1) % Tc + 1));
+  EXPECT_EQ(0, session.run(shape, &input[0][0][0][0], &weights[0][0][0][0][0], &output[0][0][0][0], failed));
+  EXPECT_EQ(0, memcmp(&output[0][0][0][0], golden.data(), golden.size() * sizeof(data_in_t)));
+}
+#else
+TEST_F(FaultTest, CorrectionUnsupported)
+{
+  session.set_correction(false);
+  EXPECT_EXIT(session.set_correction(true), ::testing::ExitedWithCode(254), "FINE_ABFT option");
+}
+#endif
+
+#endif
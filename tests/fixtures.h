@@ -0,0 +1,83 @@
+#ifndef __FIXTURES_H
+#define __FIXTURES_H
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+
+#include "convolution.h"
+#include "io.h"
+#include "golden_convolution.h"
+
+// Tensors of one call with the synthesized shape: random input and weights,
+// same seed for all tests. Base is ::testing::Test or a TestWithParam<>
+template<class Base = ::testing::Test>
+class LayerFixture : public Base
+{
+  protected:
+    data_in_t input[BATCHES][N][RR][CC];
+    data_in_t weights[BATCHES][N][M][K][K];
+    data_in_t output[BATCHES][M][R][C];
+    data_in_t golden_output[BATCHES][M][R][C];
+    bool failed[TILES];
+
+    virtual void SetUp()
+    {
+      srand(42);
+      fill_random(input, weights);
+    }
+
+    // Reference outputs of input and weights
+    void golden()
+    {
+      golden_convolution(input, weights, golden_output);
+    }
+};
+
+// Same for several images of the synthesized shape (heap allocated)
+template<int IMAGES_MAX>
+class ImagesFixture : public ::testing::Test
+{
+  protected:
+    data_in_t (*input)[BATCHES][N][RR][CC];
+    data_in_t (*weights)[BATCHES][N][M][K][K];
+    data_in_t (*output)[BATCHES][M][R][C];
+    data_in_t golden_output[BATCHES][M][R][C];
+
+    virtual void SetUp()
+    {
+      int image;
+
+      input = new data_in_t[IMAGES_MAX][BATCHES][N][RR][CC];
+      weights = new data_in_t[IMAGES_MAX][BATCHES][N][M][K][K];
+      output = new data_in_t[IMAGES_MAX][BATCHES][M][R][C];
+
+      srand(42);
+      for(image = 0; image < IMAGES_MAX; image++)
+        fill_random(input[image], weights[image]);
+    }
+
+    virtual void TearDown()
+    {
+      delete[] input;
+      delete[] weights;
+      delete[] output;
+    }
+
+    void expect_golden(int image)
+    {
+      int b, ito, ir, ic;
+
+      golden_convolution(input[image], weights[image], golden_output);
+
+      for(b = 0; b < BATCHES; b++)
+        for(ito = 0; ito < M; ito++)
+          for(ir = 0; ir < R; ir++)
+            for(ic = 0; ic < C; ic++)
+              EXPECT_EQ(
+                output[image][b][ito][ir][ic],
+                golden_output[b][ito][ir][ic]
+              );
+    }
+};
+
+#endif // __FIXTURES_H
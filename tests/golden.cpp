@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <thread>
+
+#include "convolution.h"
+#include "io.h"
+#include "golden_convolution.h"
+
+namespace
+{
+  class GoldenTest : public ::testing::Test
+  {
+    protected:
+      data_in_t input[BATCHES][N][RR][CC];
+      data_in_t weights[BATCHES][N][M][K][K];
+      data_in_t output[BATCHES][M][R][C];
+      data_in_t naive_output[BATCHES][M][R][C];
+
+      virtual void SetUp()
+      {
+        srand(42);
+        fill_random(input, weights);
+      }
+
+      void expect_identical(const conv_shape_t &shape)
+      {
+        int i;
+
+        golden_convolution(shape, &input[0][0][0][0], &weights[0][0][0][0][0], &output[0][0][0][0]);
+        golden_convolution_naive(shape, &input[0][0][0][0], &weights[0][0][0][0][0], &naive_output[0][0][0][0]);
+
+        for(i = 0; i < BATCHES * shape.m * shape.r * shape.c; i++)
+          ASSERT_EQ((&naive_output[0][0][0][0])[i], (&output[0][0][0][0])[i]) << "at " << i;
+      }
+  };
+} // namespace
+
+TEST_F(GoldenTest, Differential)
+{
+  const conv_shape_t shapes[] = {
+    max_shape,
+    {1, 1, 1, 1, 1},
+    {MAX(1, N / 3), MIN(M, 13), MAX(1, R - 1), C, MAX(1, K - 1)},
+  };
+
+  for(const conv_shape_t &shape : shapes)
+    expect_identical(shape);
+}
+
+TEST_F(GoldenTest, Overflow)
+{
+  // Largest magnitudes: accumulation wraps like data_out_t
+  const data_in_t extremes[] = {
+    data_in_t(-(1 << (data_in_t::width - 1))),
+    data_in_t((1 << (data_in_t::width - 1)) - 1),
+  };
+  int i;
+
+  for(i = 0; i < BATCHES * N * RR * CC; i++)
+    (&input[0][0][0][0])[i] = extremes[rand() % 4 == 0];
+  for(i = 0; i < BATCHES * N * M * K * K; i++)
+    (&weights[0][0][0][0][0])[i] = extremes[rand() % 4 == 0];
+
+  expect_identical(max_shape);
+}
+
+TEST_F(GoldenTest, Speedup)
+{
+  perf_counter naive, fast;
+
+  naive.start();
+  golden_convolution_naive(max_shape, &input[0][0][0][0], &weights[0][0][0][0][0], &naive_output[0][0][0][0]);
+  naive.stop();
+
+  fast.start();
+  golden_convolution(input, weights, output);
+  fast.stop();
+
+  EXPECT_EQ(0, memcmp(output, naive_output, sizeof(output)));
+
+  std::cerr << "golden: naive " << naive.tot << ", fast " << fast.tot
+    << " (speedup " << (double) naive.tot / fast.tot << ", "
+    << std::thread::hardware_concurrency() << " threads)" << std::endl;
+}
@@ -0,0 +1,151 @@
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "governor.h"
+#include "io.h"
+#include "tensor.h"
+
+#define GOV_TILES 64
+#define GOV_CALLS 2000
+#define GOV_CACHE "governor_test_settings.bin"
+
+namespace
+{
+  // Simulated failure model: tiles fail with a probability rising linearly
+  // from 0 at threshold frequency to 1 at threshold + slope
+  int simulated_failures(float freq, float threshold, float slope)
+  {
+    float p = MIN(1.f, MAX(0.f, (freq - threshold) / slope));
+    int tile, count = 0;
+
+    for(tile = 0; tile < GOV_TILES; tile++)
+      if(rand() < p * RAND_MAX)
+        count++;
+
+    return count;
+  }
+
+  class GovernorTest : public ::testing::Test
+  {
+    protected:
+      // Stubbed clock wizard (no ENABLE_CLKWIZ): 1 MHz steps
+      Clkwiz clkwiz;
+
+      GovernorTest() : clkwiz(SAFE_CLK - 20, SAFE_CLK + 100, 1) {}
+
+      virtual void SetUp()
+      {
+        srand(42);
+      }
+  };
+} // namespace
+
+TEST_F(GovernorTest, StartsSafe)
+{
+  Governor governor(clkwiz, GOV_TILES);
+
+  EXPECT_FLOAT_EQ(SAFE_CLK, governor.start());
+  EXPECT_FLOAT_EQ(SAFE_CLK, governor.frequency());
+  EXPECT_EQ(0, governor.changes());
+}
+
+TEST_F(GovernorTest, Converges)
+{
+  const float threshold = SAFE_CLK + 50, slope = 20, budget = 0.01;
+  Governor governor(clkwiz, GOV_TILES, budget, 16, 2);
+  int call, failures = 0, changes;
+  float freq = governor.start();
+
+  for(call = 0; call < GOV_CALLS; call++)
+    freq = governor.update(simulated_failures(freq, threshold, slope));
+
+  // Stable around highest frequency under budget
+  EXPECT_GE(freq, threshold - 5);
+  EXPECT_LE(freq, threshold + budget * slope + 2);
+
+  // Hysteresis: few changes and failures once converged
+  changes = governor.changes();
+  for(call = 0; call < GOV_CALLS; call++)
+  {
+    int count = simulated_failures(freq, threshold, slope);
+    failures += count;
+    freq = governor.update(count);
+  }
+  EXPECT_LE(governor.changes() - changes, GOV_CALLS / 16);
+  EXPECT_LE((float) failures / (GOV_CALLS * GOV_TILES), budget);
+  EXPECT_EQ(0, governor.fallback_count());
+}
+
+TEST_F(GovernorTest, StepsDown)
+{
+  Governor governor(clkwiz, GOV_TILES, 0.01, 4, 1);
+  float freq = governor.start();
+  int call;
+
+  // Climb without failure
+  for(call = 0; call < 40; call++)
+    freq = governor.update(0);
+  EXPECT_GT(freq, SAFE_CLK);
+
+  // Failures over budget (but under panic): one step down
+  for(call = 0; call < 4; call++)
+    governor.update(2);
+  EXPECT_FLOAT_EQ(freq - 1, governor.frequency());
+}
+
+TEST_F(GovernorTest, Fallback)
+{
+  Governor governor(clkwiz, GOV_TILES, 0.01, 4, 1);
+  int call;
+
+  governor.start();
+  for(call = 0; call < 40; call++)
+    governor.update(0);
+  EXPECT_GT(governor.frequency(), SAFE_CLK);
+
+  EXPECT_FLOAT_EQ(SAFE_CLK, governor.update(GOV_TILES / 2));
+  EXPECT_EQ(1, governor.fallback_count());
+}
+
+TEST_F(GovernorTest, SwitchTimeout)
+{
+  const float minfreq = SAFE_CLK - 20, maxfreq = SAFE_CLK + 100;
+  MockClkwizRegs regs;
+  int call;
+  float freq;
+
+  // Real settings table (the stub one never reloads)
+  ASSERT_TRUE(Clkwiz::saveSettings(GOV_CACHE,
+    Clkwiz::generate(minfreq, maxfreq, 1), minfreq, maxfreq, 1));
+  Clkwiz mocked(minfreq, maxfreq, 1, GOV_CACHE, &regs);
+  Governor governor(mocked, GOV_TILES, 0.01, 4, 1);
+  unlink(GOV_CACHE);
+
+  freq = governor.start();
+
+  // MMCM never locks again: no step up is accounted
+  mocked.setTimeout(100);
+  regs.setDelay(-1);
+  for(call = 0; call < 40; call++)
+    EXPECT_FLOAT_EQ(freq, governor.update(0));
+  EXPECT_EQ(0, governor.changes());
+  EXPECT_GT(mocked.timeoutCount(), 0);
+}
+
+TEST_F(GovernorTest, Session)
+{
+  Tensor input(TENSOR_INPUT), weights(TENSOR_WEIGHTS), output(TENSOR_OUTPUT);
+  bool failed[TILES];
+  ConvSession session;
+  Governor governor(clkwiz, TILES, 0.01, 1, 1);
+
+  fill_random(input.input(), weights.weights());
+  session.init();
+  governor.start();
+
+  // No failure in simulation: one step up per call
+  EXPECT_EQ(0, governor.run(session, input.input(), weights.weights(), output.output(), failed));
+  EXPECT_EQ(0, governor.run(session, max_shape, input.data(), weights.data(), output.data(), failed));
+  EXPECT_FLOAT_EQ(SAFE_CLK + 2, governor.frequency());
+}
@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+
+#include "conv_hybrid.h"
+#include "fixtures.h"
+
+#define CALLS 4
+
+namespace
+{
+  class HybridTest : public LayerFixture<>
+  {
+    protected:
+      virtual void SetUp()
+      {
+        LayerFixture::SetUp();
+        golden();
+      }
+  };
+} // namespace
+
+TEST_F(HybridTest, GoldenComparison)
+{
+  const double fractions[] = {0, 0.5, 1};
+  int tile;
+
+  for(double fraction : fractions)
+  {
+    ConvHybrid hybrid(fraction, false);
+
+    hybrid.init();
+    memset(output, 0, sizeof(output));
+    EXPECT_EQ(0, hybrid.run(input, weights, output, failed));
+    EXPECT_EQ(0, memcmp(output, golden_output, sizeof(output))) << "fraction " << fraction;
+    for(tile = 0; tile < TILES; tile++)
+      EXPECT_FALSE(failed[tile]);
+    EXPECT_EQ(fraction, hybrid.fraction()); // static
+  }
+}
+
+TEST_F(HybridTest, Split)
+{
+  const conv_shape_t shape = {N, 3 * Tm - 1, R, C, K};
+  ConvHybrid none(0, false), half(0.5, false), all(1, false);
+
+  EXPECT_EQ(shape.m, none.split(shape));
+  EXPECT_EQ(Tm, half.split(shape)); // 1.5 rounded up for CPU
+  EXPECT_EQ(0, all.split(shape));
+}
+
+TEST_F(HybridTest, Latency)
+{
+  ConvSession session;
+  ConvHybrid hybrid;
+  perf_counter accel;
+  int call;
+
+  // Accelerator only
+  session.init();
+  for(call = 0; call < CALLS; call++)
+  {
+    accel.start();
+    session.run(input, weights, output, failed);
+    accel.stop();
+  }
+  session.teardown();
+
+  // Adaptive split: results do not depend on it
+  hybrid.init();
+  for(call = 0; call < CALLS; call++)
+  {
+    memset(output, 0, sizeof(output));
+    hybrid.run(input, weights, output, failed);
+    EXPECT_EQ(0, memcmp(output, golden_output, sizeof(output))) << "call " << call;
+    EXPECT_GE(hybrid.fraction(), 0);
+    EXPECT_LE(hybrid.fraction(), 1);
+  }
+
+  std::cerr << "accelerator only: " << accel.tot / CALLS
+    << ", hybrid: " << hybrid.total.tot / CALLS
+    << " (CPU share " << hybrid.fraction() << ")" << std::endl;
+}
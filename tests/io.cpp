@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <cmath>
+
+#include "io.h"
+
+#define SIZE 100000
+
+TEST(IoTest, PhiloxKnownAnswers)
+{
+  // Known-answer vectors of the Random123 reference implementation
+  const uint32_t ctr0[4] = {0, 0, 0, 0}, key0[2] = {0, 0};
+  const uint32_t ctr1[4] = {0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff};
+  const uint32_t key1[2] = {0xffffffff, 0xffffffff};
+  const uint32_t ctr2[4] = {0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344};
+  const uint32_t key2[2] = {0xa4093822, 0x299f31d0};
+  uint32_t out[4];
+
+  philox4x32(ctr0, key0, out);
+  EXPECT_EQ(0x6627e8d5u, out[0]);
+  EXPECT_EQ(0xe169c58du, out[1]);
+  EXPECT_EQ(0xbc57ac4cu, out[2]);
+  EXPECT_EQ(0x9b00dbd8u, out[3]);
+
+  philox4x32(ctr1, key1, out);
+  EXPECT_EQ(0x408f276du, out[0]);
+  EXPECT_EQ(0x41c83b0eu, out[1]);
+  EXPECT_EQ(0xa20bc7c6u, out[2]);
+  EXPECT_EQ(0x6d5451fdu, out[3]);
+
+  philox4x32(ctr2, key2, out);
+  EXPECT_EQ(0xd16cfe09u, out[0]);
+  EXPECT_EQ(0x94fdccebu, out[1]);
+  EXPECT_EQ(0x5001e420u, out[2]);
+  EXPECT_EQ(0x24126ea1u, out[3]);
+}
+
+TEST(IoTest, Reproducible)
+{
+  std::vector<data_in_t> a(SIZE), b(SIZE), c(SIZE);
+  int i, same = 0;
+
+  // Elements only depend on their index: a prefix is the same tensor
+  fill_tensor(a.data(), SIZE, FILL_UNIFORM, 42, 3, 0);
+  fill_tensor(b.data(), SIZE - 7, FILL_UNIFORM, 42, 3, 0);
+  for(i = 0; i < SIZE - 7; i++)
+    EXPECT_EQ(a[i], b[i]);
+
+  // Another image (or tensor) is different
+  fill_tensor(c.data(), SIZE, FILL_UNIFORM, 42, 4, 0);
+  for(i = 0; i < SIZE; i++)
+    same += (a[i] == c[i]);
+  EXPECT_LT(same, SIZE / 100);
+  fill_tensor(c.data(), SIZE, FILL_UNIFORM, 42, 3, 1);
+  for(same = 0, i = 0; i < SIZE; i++)
+    same += (a[i] == c[i]);
+  EXPECT_LT(same, SIZE / 100);
+}
+
+TEST(IoTest, Distributions)
+{
+  std::vector<data_in_t> data(SIZE);
+  const fill_params_t params = {FILL_RELU, FILL_GAUSSIAN, .1f, .6f};
+  const double scale = (double) ((int64_t) 1 << (data_in_t::width - 1));
+  double sum, sum2, x;
+  int i, zeros;
+
+  // Gaussian weights: mean 0, standard deviation sigma
+  fill_tensor(data.data(), SIZE, FILL_GAUSSIAN, 1, 0, 1, params);
+  for(sum = sum2 = 0, i = 0; i < SIZE; i++)
+  {
+    x = (int64_t) data[i] / scale;
+    sum += x;
+    sum2 += x * x;
+  }
+  EXPECT_NEAR(0., sum / SIZE, .005);
+  EXPECT_NEAR(params.sigma, std::sqrt(sum2 / SIZE - (sum / SIZE) * (sum / SIZE)), .005);
+
+  // ReLU activations: non-negative, sparsity zeros once quantized (any DATA_WL)
+  fill_tensor(data.data(), SIZE, FILL_RELU, 1, 0, 0, params);
+  for(zeros = 0, i = 0; i < SIZE; i++)
+  {
+    EXPECT_GE((int64_t) data[i], 0);
+    zeros += (data[i] == 0);
+  }
+  EXPECT_NEAR(params.sparsity, (double) zeros / SIZE, .01);
+
+  // Pixels: [0, 1) with 8-bit steps
+  fill_tensor(data.data(), SIZE, FILL_IMAGE, 1, 0, 0, params);
+  for(sum = 0, i = 0; i < SIZE; i++)
+  {
+    x = (int64_t) data[i] / scale;
+    EXPECT_GE(x, 0.);
+    EXPECT_LT(x, 1.);
+    sum += x;
+  }
+  EXPECT_NEAR(.5, sum / SIZE, .01);
+}
+
+TEST(IoTest, FillTime)
+{
+  data_in_t (*input)[N][RR][CC] = new data_in_t[BATCHES][N][RR][CC];
+  data_in_t (*weights)[N][M][K][K] = new data_in_t[BATCHES][N][M][K][K];
+  data_in_t *flat_input = &input[0][0][0][0], *flat_weights = &weights[0][0][0][0][0];
+  size_t input_size = (size_t) BATCHES * N * RR * CC;
+  size_t weights_size = (size_t) BATCHES * N * M * K * K;
+  perf_counter serial, parallel;
+  size_t i;
+
+  // Reference: one rand() per element
+  srand(42);
+  serial.start();
+  for(i = 0; i < weights_size; i++)
+    flat_weights[i] = rand();
+  for(i = 0; i < input_size; i++)
+    flat_input[i] = rand();
+  serial.stop();
+
+  parallel.start();
+  fill_random(input, weights, 42, 0);
+  parallel.stop();
+
+  std::cerr << "fill time: rand() " << serial.tot << ", counter-based " << parallel.tot
+    << " (x" << (double) serial.tot / parallel.tot << ")" << std::endl;
+
+  delete[] input;
+  delete[] weights;
+}
@@ -0,0 +1,180 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include <algorithm>
+
+#include "conv_network.h"
+#include "io.h"
+#include "golden_convolution.h"
+
+#define LAYERS 3
+#define CALLS 4
+
+namespace
+{
+  // Next layer reading the whole output of prev (padded), with m maps:
+  // "same" padding (K - 1) / 2 if the stride allows it
+  conv_layer_t next_layer(const conv_shape_t &prev, int m)
+  {
+    conv_layer_t layer = {{prev.m, m, 0, 0, K}, 0, NULL};
+    int i, pad;
+
+    for(i = 0; i <= K + 1; i++)
+    {
+      pad = (i == 0) ? (K - 1) / 2 : i - 1;
+      int rows = prev.r + 2 * pad - K, cols = prev.c + 2 * pad - K;
+      if((rows >= 0) && (cols >= 0) && (rows % S == 0) && (cols % S == 0))
+      {
+        layer.shape.r = rows / S + 1;
+        layer.shape.c = cols / S + 1;
+        layer.pad = pad;
+        break;
+      }
+    }
+    return layer;
+  }
+
+  // Output of a layer copied in the padded input of the next one (what
+  // callers of convolution() do between layers)
+  void pad_output(
+    const conv_shape_t &prev,
+    const data_in_t *output,
+    const conv_layer_t &next,
+    data_in_t *input
+  )
+  {
+    int b, m, r;
+
+    for(b = 0; b < BATCHES; b++)
+      for(m = 0; m < prev.m; m++)
+        for(r = 0; r < prev.r; r++)
+          std::copy(
+            output + ((b * prev.m + m) * prev.r + r) * prev.c,
+            output + ((b * prev.m + m) * prev.r + r + 1) * prev.c,
+            input + ((b * next.shape.n + m) * next.shape.rr() + r + next.pad) * next.shape.cc() + next.pad
+          );
+  }
+
+  class NetworkTest : public ::testing::Test
+  {
+    protected:
+      std::vector<conv_layer_t> layers;
+      std::vector<data_in_t> weights[LAYERS];
+      std::vector<data_in_t> input, output, golden_output;
+
+      virtual void SetUp()
+      {
+        const conv_shape_t first = {N / 2, MIN(M, N), R, C, K};
+        int i;
+
+        layers.push_back({first, 0, NULL});
+        layers.push_back(next_layer(layers[0].shape, N / 2 + 1));
+        layers.push_back(next_layer(layers[1].shape, M / 2 + 1));
+
+        for(i = 0; i < LAYERS; i++)
+        {
+          const conv_shape_t &shape = layers[i].shape;
+          weights[i].resize((size_t) BATCHES * shape.n * shape.m * shape.k * shape.k);
+          fill_tensor(weights[i].data(), weights[i].size(), FILL_UNIFORM, 42, i, 1);
+          layers[i].weights = weights[i].data();
+        }
+
+        input.resize((size_t) BATCHES * first.n * first.rr() * first.cc());
+        fill_tensor(input.data(), input.size(), FILL_UNIFORM, 42, 0, 0);
+        output.resize((size_t) BATCHES * layers[LAYERS - 1].shape.m *
+          layers[LAYERS - 1].shape.r * layers[LAYERS - 1].shape.c);
+        golden_output.resize(output.size());
+      }
+
+      // Layer by layer, with host copies and re-padding between layers
+      void per_layer(ConvSession *session, data_in_t *result)
+      {
+        std::vector<data_in_t> layer_input = input, layer_output;
+        bool failed[TILES];
+        int i;
+
+        for(i = 0; i < LAYERS; i++)
+        {
+          const conv_shape_t &shape = layers[i].shape;
+
+          layer_output.assign((size_t) BATCHES * shape.m * shape.r * shape.c, 0);
+          if(session)
+            EXPECT_EQ(0, session->run(shape, layer_input.data(), layers[i].weights, layer_output.data(), failed));
+          else
+            golden_convolution(shape, layer_input.data(), layers[i].weights, layer_output.data());
+
+          if(i < LAYERS - 1)
+          {
+            const conv_shape_t &next = layers[i + 1].shape;
+            layer_input.assign((size_t) BATCHES * next.n * next.rr() * next.cc(), 0);
+            pad_output(shape, layer_output.data(), layers[i + 1], layer_input.data());
+          }
+        }
+        std::copy(layer_output.begin(), layer_output.end(), result);
+      }
+  };
+} // namespace
+
+TEST_F(NetworkTest, Layers)
+{
+  int i;
+
+  for(i = 1; i < LAYERS; i++)
+  {
+    ASSERT_GT(layers[i].shape.r, 0) << "no padding chains layer " << i;
+    EXPECT_TRUE(shape_fits(layers[i].shape));
+  }
+}
+
+TEST_F(NetworkTest, GoldenComparison)
+{
+  ConvNetwork network(layers);
+  int i;
+  size_t j;
+
+  per_layer(NULL, golden_output.data());
+
+  network.init();
+  EXPECT_EQ(LAYERS, network.size());
+  EXPECT_EQ(0, network.run(input.data(), output.data()));
+  for(i = 0; i < LAYERS; i++)
+    EXPECT_EQ(0, network.failed(i));
+  for(j = 0; j < output.size(); j++)
+    ASSERT_EQ(golden_output[j], output[j]) << "element " << j;
+
+  // Borders of activations stay zero across runs
+  EXPECT_EQ(0, network.run(input.data(), output.data()));
+  EXPECT_EQ(0, memcmp(output.data(), golden_output.data(), output.size() * sizeof(data_in_t)));
+  if(layers[1].pad > 0)
+  {
+    EXPECT_EQ(0, network.activations(1)[0]);
+  }
+}
+
+TEST_F(NetworkTest, Latency)
+{
+  ConvSession session;
+  ConvNetwork network(layers);
+  perf_counter calls;
+  int call;
+
+  // Per-layer calls: host copies and re-padding between layers
+  session.init();
+  for(call = 0; call < CALLS; call++)
+  {
+    calls.start();
+    per_layer(&session, golden_output.data());
+    calls.stop();
+  }
+  session.teardown();
+
+  network.init();
+  for(call = 0; call < CALLS; call++)
+    EXPECT_EQ(0, network.run(input.data(), output.data()));
+  EXPECT_EQ(0, memcmp(output.data(), golden_output.data(), output.size() * sizeof(data_in_t)));
+
+  std::cerr << "network latency (" << LAYERS << " layers): per-layer calls "
+    << calls.avg_cpu_cycles() << ", network " << network.total.avg_cpu_cycles()
+    << " (" << (double) calls.tot / network.total.tot << "x)" << std::endl;
+  for(call = 0; call < LAYERS; call++)
+    std::cerr << "  layer " << call << ": " << network.layer_time[call].avg_cpu_cycles() << std::endl;
+}
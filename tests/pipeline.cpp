@@ -0,0 +1,76 @@
+#include <gtest/gtest.h>
+
+#include "conv_pipeline.h"
+#include "fixtures.h"
+
+#define IMAGES 4
+
+namespace
+{
+  class PipelineTest : public ImagesFixture<IMAGES>
+  {
+    protected:
+      bool failed[IMAGES][TILES];
+  };
+} // namespace
+
+TEST_F(PipelineTest, GoldenComparison)
+{
+  ConvPipeline pipeline(2);
+  int image, next;
+
+  pipeline.init();
+
+  // Keep slots full: wait oldest call only when submit() is not possible
+  for(image = 0, next = 0; image < IMAGES; image++)
+  {
+    while(next < IMAGES && !pipeline.full())
+    {
+      pipeline.submit(input[next], weights[next], output[next], failed[next]);
+      next++;
+    }
+    EXPECT_EQ(0, pipeline.wait());
+    expect_golden(image);
+  }
+  EXPECT_EQ(0, pipeline.in_flight());
+
+  pipeline.teardown();
+  EXPECT_FALSE(pipeline.ready());
+}
+
+TEST_F(PipelineTest, Overlap)
+{
+  ConvSession session;
+  ConvPipeline pipeline(2);
+  perf_counter sequential, pipelined;
+  int image;
+
+  // Reference: stages in sequence
+  session.init();
+  sequential.start();
+  for(image = 0; image < IMAGES; image++)
+    session.run(input[image], weights[image], output[image], failed[image]);
+  sequential.stop();
+
+  // Pipelined: pack k+1 and scatter k-1 during compute k
+  pipeline.init();
+  pipelined.start();
+  for(image = 0; image < IMAGES; image++)
+  {
+    if(pipeline.full())
+      pipeline.wait();
+    pipeline.submit(input[image], weights[image], output[image], failed[image]);
+  }
+  while(pipeline.in_flight() > 0)
+    pipeline.wait();
+  pipelined.stop();
+
+  for(image = 0; image < IMAGES; image++)
+    expect_golden(image);
+
+  std::cerr << "stages: pack " << pipeline.pack.tot
+    << ", compute " << pipeline.compute.tot
+    << ", scatter " << pipeline.scatter.tot << std::endl;
+  std::cerr << "sequential " << sequential.tot
+    << ", pipelined " << pipelined.tot << std::endl;
+}
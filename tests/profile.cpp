@@ -0,0 +1,169 @@
+#include <gtest/gtest.h>
+#include <stdlib.h>
+
+#include "convolution.h"
+#include "conv_stream.h"
+#include "io.h"
+
+// Profiling counters are only built with PROFILING option
+#ifdef PROFILING
+
+#define STREAM_IMAGES 2
+
+namespace
+{
+  class ProfileTest : public ::testing::Test
+  {
+    protected:
+      data_in_t input[BATCHES][N][RR][CC];
+      data_in_t weights[BATCHES][N][M][K][K];
+      data_in_t output[BATCHES][M][R][C];
+      bool failed[TILES];
+
+      virtual void SetUp()
+      {
+        srand(42);
+        fill_random(input, weights);
+      }
+
+      // Expected iterations of each actor for one call of a runtime shape:
+      // one hw_dataflow() per input tile, outputs sent once per output tile
+      void expected_iterations(
+        const conv_shape_t &shape,
+        unsigned int iterations[ACTORS]
+      )
+      {
+        unsigned int dataflows = shape.tiles() * shape.tiles_n();
+        unsigned int incs;
+
+#if S == 1
+        incs = SECTIONS * SECTIONS + K * K + (K - 1) * K + K * (K - 1) * K + K * K;
+#else
+        incs = SECTIONS * SECTIONS + K * SECTIONS * SECTIONS + K * K * SECTIONS + K * K;
+#endif
+#ifdef FINE_ABFT
+        // Row and column sections, other lanes, output rows and columns
+        incs += Trr + Tcc + (Um - 1) * K * K + Tr * K * K + Tc * K * K;
+#endif
+
+        iterations[ACTOR_RECV_INPUT] = dataflows * Tn * Trr * Tcc;
+        iterations[ACTOR_RECV_WEIGHTS] = dataflows * Tn * Tm * K * K;
+        iterations[ACTOR_CONV] = dataflows *
+          UPPERDIV(Tm, Um) * Tr * Tc * K * K * UPPERDIV(Tn, Un);
+        iterations[ACTOR_SEND_OUTPUT] = shape.tiles() * Tm * Tr * Tc;
+#ifdef ENABLE_HARDWARE_ABFT
+        iterations[ACTOR_INCS] = dataflows * Tn * incs;
+#else
+        (void) incs;
+        iterations[ACTOR_INCS] = 0;
+#endif
+#ifdef HW_OUTCS
+        iterations[ACTOR_OUTCS] = shape.tiles() * UPPERDIV(Tm, Um) * Tr * Tc;
+#else
+        iterations[ACTOR_OUTCS] = 0;
+#endif
+#ifdef REQUANT
+        iterations[ACTOR_OUTCS] += shape.tiles() * Tm;
+#endif
+#ifdef EPILOGUE
+        iterations[ACTOR_EPILOGUE] = shape.tiles() * (Tm + UPPERDIV(Tm, Um) * Tr * Tc);
+#else
+        iterations[ACTOR_EPILOGUE] = 0;
+#endif
+      }
+  };
+} // namespace
+
+TEST_F(ProfileTest, Iterations)
+{
+  ConvSession session;
+  const conv_shape_t shapes[] = {max_shape, {Tn, Tm, Tr, Tc, K}};
+  unsigned int iterations[ACTORS];
+  int i, a;
+
+  session.init();
+
+  for(i = 0; i < 2; i++)
+  {
+    session.run(shapes[i], &input[0][0][0][0], &weights[0][0][0][0][0],
+      &output[0][0][0][0], failed);
+
+    // Counters are reset by each call
+    expected_iterations(shapes[i], iterations);
+    for(a = 0; a < ACTORS; a++)
+      EXPECT_EQ(iterations[a], (unsigned int) session.profile()[a].iterations)
+        << "actor " << a << ", shape " << i;
+  }
+
+  // Dataflow balance of the synthesized shape
+  session.run(input, weights, output, failed);
+  print_profile(session.profile());
+}
+
+TEST_F(ProfileTest, NoStallInSimulation)
+{
+  ConvSession session;
+  int a;
+
+  // Actors run one after another: FIFOs are never empty on read
+  session.init();
+  session.run(input, weights, output, failed);
+  for(a = 0; a < ACTORS; a++)
+    EXPECT_EQ(0u, (unsigned int) session.profile()[a].stalls) << "actor " << a;
+}
+
+TEST_F(ProfileTest, FifoOccupancy)
+{
+  ConvSession session;
+  unsigned int outputs = UPPERDIV(Tm, Um) * Tr * Tc;
+
+  // A FIFO is filled by its producer before being emptied by its consumer
+  session.init();
+  session.run(input, weights, output, failed);
+#ifdef ENABLE_HARDWARE_ABFT
+  EXPECT_EQ((unsigned int) (Tn * SECTIONS * SECTIONS), hw_fifo_max[FIFO_SECTION]);
+#else
+  EXPECT_EQ(0u, hw_fifo_max[FIFO_SECTION]);
+#endif
+#ifdef FINE_ABFT
+  EXPECT_EQ((unsigned int) (Tn * Um * K * K), hw_fifo_max[FIFO_KERNEL]);
+  EXPECT_EQ((unsigned int) (Tn * Trr), hw_fifo_max[FIFO_ROW_SECTION]);
+  EXPECT_EQ((unsigned int) (Tn * Tcc), hw_fifo_max[FIFO_COL_SECTION]);
+#elif defined(ENABLE_HARDWARE_ABFT)
+  EXPECT_EQ((unsigned int) (Tn * K * K), hw_fifo_max[FIFO_KERNEL]);
+  EXPECT_EQ(0u, hw_fifo_max[FIFO_ROW_SECTION]);
+  EXPECT_EQ(0u, hw_fifo_max[FIFO_COL_SECTION]);
+#else
+  EXPECT_EQ(0u, hw_fifo_max[FIFO_KERNEL]);
+  EXPECT_EQ(0u, hw_fifo_max[FIFO_ROW_SECTION]);
+  EXPECT_EQ(0u, hw_fifo_max[FIFO_COL_SECTION]);
+#endif
+#ifdef HW_OUTCS
+  EXPECT_EQ(outputs, hw_fifo_max[FIFO_OUTPUT_FULLP]);
+#else
+  EXPECT_EQ(0u, hw_fifo_max[FIFO_OUTPUT_FULLP]);
+#endif
+  EXPECT_EQ(outputs, hw_fifo_max[FIFO_OUTPUT]);
+}
+
+TEST_F(ProfileTest, Stream)
+{
+  ConvStream stream(STREAM_IMAGES);
+  unsigned int iterations[ACTORS];
+  int image, a;
+
+  // One hardware call for all images
+  stream.init();
+  for(image = 0; image < STREAM_IMAGES; image++)
+    stream.push(input, weights);
+  stream.flush();
+  for(image = 0; image < STREAM_IMAGES; image++)
+    stream.pop(output, failed);
+
+  expected_iterations(max_shape, iterations);
+  for(a = 0; a < ACTORS; a++)
+    EXPECT_EQ(STREAM_IMAGES * iterations[a], (unsigned int) stream.profile()[a].iterations)
+      << "actor " << a;
+}
+
+#endif
@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+
+#include "recovery.h"
+#include "fixtures.h"
+
+namespace
+{
+  class RecoveryTest : public LayerFixture<::testing::TestWithParam<recovery_t> >
+  {
+    protected:
+      ConvSession session;
+
+      virtual void SetUp()
+      {
+        LayerFixture::SetUp();
+        session.init();
+      }
+
+      // Simulated faults: garbage in output tiles, flagged as failed
+      void inject(const conv_shape_t &shape, int faults)
+      {
+        int tile, tto, y, x, b, to, row, col;
+        data_in_t *out = &output[0][0][0][0];
+
+        for(tile = 0; tile < shape.tiles(); tile++)
+          failed[tile] = false;
+
+        for(tile = 0; tile < shape.tiles() && faults > 0; tile += 1 + tile % 2, faults--)
+        {
+          failed[tile] = true;
+          col = (tile % shape.tiles_c()) * Tc;
+          row = (tile / shape.tiles_c() % shape.tiles_r()) * Tr;
+          to = (tile / shape.tiles_c() / shape.tiles_r() % shape.tiles_m()) * Tm;
+          b = tile / shape.tiles_c() / shape.tiles_r() / shape.tiles_m();
+          for(tto = to; tto < MIN(to + Tm, shape.m); tto++)
+            for(y = row; y < MIN(row + Tr, shape.r); y++)
+              for(x = col; x < MIN(col + Tc, shape.c); x++)
+                out[((b * shape.m + tto) * shape.r + y) * shape.c + x] = data_in_t(rand());
+        }
+      }
+  };
+} // namespace
+
+TEST_P(RecoveryTest, GoldenComparison)
+{
+  const conv_shape_t shapes[] = {
+    max_shape,
+    {MAX(1, N / 3), MAX(1, M - 5), MAX(1, R - 2), MAX(1, C - 1), K},
+  };
+  ConvRecovery recovery(session, GetParam());
+  int tile;
+
+  for(const conv_shape_t &shape : shapes)
+  {
+    fill_random(shape, &input[0][0][0][0], &weights[0][0][0][0][0]);
+    golden_convolution(shape, &input[0][0][0][0], &weights[0][0][0][0][0], &golden_output[0][0][0][0]);
+    session.run(shape, &input[0][0][0][0], &weights[0][0][0][0][0], &output[0][0][0][0], failed);
+
+    inject(shape, shape.tiles());
+    EXPECT_EQ(0, recovery.recover(shape, &input[0][0][0][0], &weights[0][0][0][0][0], &output[0][0][0][0], failed));
+
+    for(tile = 0; tile < BATCHES * shape.m * shape.r * shape.c; tile++)
+      ASSERT_EQ((&golden_output[0][0][0][0])[tile], (&output[0][0][0][0])[tile]) << "at " << tile;
+    for(tile = 0; tile < shape.tiles(); tile++)
+      EXPECT_FALSE(failed[tile]);
+  }
+
+  EXPECT_GT(recovery.recomputed, 0);
+}
+
+#ifdef REQUANT
+TEST_P(RecoveryTest, Requant)
+{
+  const conv_shape_t shape = {N / 2 + 1, M - 5, R - 1, C - 2, K};
+  int shifts[M];
+  data_in_t mults[M];
+  const conv_requant_t requant = {shifts, mults};
+  ConvRecovery recovery(session, GetParam());
+  int m, i;
+
+  // Per-map rescale: recomputed tiles use the maps of their layer tile
+  for(m = 0; m < shape.m; m++)
+  {
+    shifts[m] = REQUANT_SHIFT - 4 + m % 9;
+    mults[m] = (m % 7) - 2;
+  }
+  fill_random(shape, &input[0][0][0][0], &weights[0][0][0][0][0]);
+  golden_convolution(shape, &input[0][0][0][0], &weights[0][0][0][0][0], &golden_output[0][0][0][0], requant);
+  session.set_requant(requant);
+  session.run(shape, &input[0][0][0][0], &weights[0][0][0][0][0], &output[0][0][0][0], failed);
+
+  inject(shape, shape.tiles());
+  EXPECT_EQ(0, recovery.recover(shape, &input[0][0][0][0], &weights[0][0][0][0][0], &output[0][0][0][0], failed));
+  for(i = 0; i < BATCHES * shape.m * shape.r * shape.c; i++)
+    ASSERT_EQ((&golden_output[0][0][0][0])[i], (&output[0][0][0][0])[i]) << "at " << i;
+  EXPECT_EQ(requant.shift, session.get_requant().shift);
+}
+#endif
+
+TEST_P(RecoveryTest, EpilogueUnsupported)
+{
+  const conv_epilogue_t epilogue = {NULL, NULL, true, false};
+  ConvRecovery recovery(session, GetParam());
+
+  inject(max_shape, 1);
+  session.set_epilogue(epilogue);
+  EXPECT_EXIT(
+    recovery.recover(max_shape, &input[0][0][0][0], &weights[0][0][0][0][0], &output[0][0][0][0], failed),
+    ::testing::ExitedWithCode(254),
+    "epilogue"
+  );
+}
+
+TEST_P(RecoveryTest, NoFault)
+{
+  ConvRecovery recovery(session, GetParam());
+
+  fill_random(input, weights);
+  EXPECT_EQ(0, recovery.run(input, weights, output, failed));
+  EXPECT_EQ(0, recovery.calls);
+}
+
+TEST_P(RecoveryTest, Throughput)
+{
+  ConvRecovery recovery(session, GetParam());
+  perf_counter run;
+  int faults;
+
+  fill_random(input, weights);
+  run.start();
+  session.run(input, weights, output, failed);
+  run.stop();
+
+  // Full retry: one more call as soon as one tile fails
+  std::cerr << "failed tiles\tfull retry (img/s)\tselective (img/s)" << std::endl;
+  for(faults = 0; faults <= TILES; faults += MAX(1, TILES / 4))
+  {
+    inject(max_shape, faults);
+    recovery.time.reset();
+    recovery.recover(max_shape, &input[0][0][0][0], &weights[0][0][0][0][0], &output[0][0][0][0], failed);
+
+    std::cerr << faults << '/' << TILES << "\t\t"
+      << 1e9 / (run.tot * (faults > 0 ? 2 : 1)) << "\t\t\t"
+      << 1e9 / (run.tot + recovery.time.tot) << std::endl;
+  }
+}
+
+#ifdef FINE_ABFT
+// Regions of tiles not failed in hardware cover whole tiles
+INSTANTIATE_TEST_CASE_P(
+  Backends,
+  RecoveryTest,
+  ::testing::Values(RECOVERY_ACCELERATOR, RECOVERY_CPU, RECOVERY_REGION)
+);
+#else
+INSTANTIATE_TEST_CASE_P(
+  Backends,
+  RecoveryTest,
+  ::testing::Values(RECOVERY_ACCELERATOR, RECOVERY_CPU)
+);
+#endif
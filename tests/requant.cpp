@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "conv_network.h"
+#include "io.h"
+#include "golden_convolution.h"
+
+namespace
+{
+  class RequantTest : public ::testing::Test
+  {
+    protected:
+      std::vector<data_in_t> input, weights, mult, output, golden_output;
+      std::vector<int> shift;
+      conv_requant_t requant;
+
+      // Per-map shifts around the fixed one, and small multipliers (some
+      // negative, some zero)
+      void fill(const conv_shape_t &shape)
+      {
+        int m;
+
+        input.assign((size_t) BATCHES * shape.n * shape.rr() * shape.cc(), 0);
+        weights.assign((size_t) BATCHES * shape.n * shape.m * shape.k * shape.k, 0);
+        fill_random(shape, input.data(), weights.data(), 11, 0);
+
+        shift.resize(shape.m);
+        mult.resize(shape.m);
+        for(m = 0; m < shape.m; m++)
+        {
+          shift[m] = REQUANT_SHIFT - 4 + m % 9;
+          mult[m] = (m % 7) - 2;
+        }
+        requant.shift = shift.data();
+        requant.mult = mult.data();
+
+        output.assign((size_t) BATCHES * shape.m * shape.r * shape.c, 0);
+        golden_output.assign(output.size(), 0);
+      }
+  };
+} // namespace
+
+TEST_F(RequantTest, Golden)
+{
+  const conv_shape_t shape = {N / 2 + 1, M / 2 + 1, R - 1, C - 2, K};
+  const conv_requant_t fixed = {NULL, NULL};
+  std::vector<data_in_t> naive_output;
+  size_t i;
+
+  fill(shape);
+  naive_output.resize(output.size());
+
+  // Fast reference bit-identical to the naive one
+  golden_convolution(shape, input.data(), weights.data(), output.data(), requant);
+  golden_convolution_naive(shape, input.data(), weights.data(), naive_output.data(), requant);
+  for(i = 0; i < output.size(); i++)
+    ASSERT_EQ(naive_output[i], output[i]) << "element " << i;
+
+  // Fixed rescale by default
+  golden_convolution(shape, input.data(), weights.data(), output.data());
+  golden_convolution_naive(shape, input.data(), weights.data(), naive_output.data(), fixed);
+  EXPECT_EQ(0, memcmp(output.data(), naive_output.data(), output.size() * sizeof(data_in_t)));
+}
+
+TEST_F(RequantTest, AbftShift)
+{
+  const conv_shape_t shape = {N, 2, R, C, K};
+  int shifts[2] = {REQUANT_SHIFT, REQUANT_SHIFT};
+  data_in_t mults[2] = {1, 1};
+  conv_requant_t q = {shifts, mults};
+
+  EXPECT_EQ(REQUANT_SHIFT, conv_abft_shift(shape, no_requant));
+  EXPECT_EQ(REQUANT_SHIFT, conv_abft_shift(shape, q));
+
+  // Lowest accumulator bit reaching an output, within data_in_t bits
+  shifts[1] = 4;
+  EXPECT_EQ(4, conv_abft_shift(shape, q));
+  mults[1] = -8;
+  EXPECT_EQ(1, conv_abft_shift(shape, q));
+  mults[1] = 0;
+  EXPECT_EQ(REQUANT_SHIFT, conv_abft_shift(shape, q));
+  shifts[0] = REQUANT_SHIFT_MAX;
+  EXPECT_EQ(DATA_WL, conv_abft_shift(shape, q));
+}
+
+#ifdef REQUANT
+TEST_F(RequantTest, Session)
+{
+  const conv_shape_t shapes[] = {max_shape, {N / 2 + 1, M / 2 + 1, R - 1, C - 2, K}};
+  ConvSession session;
+  bool failed[TILES];
+  size_t i, j;
+
+  session.init();
+  for(i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++)
+  {
+    fill(shapes[i]);
+    golden_convolution(shapes[i], input.data(), weights.data(), golden_output.data(), requant);
+
+    // ABFT stays valid: no tile fails
+    session.set_requant(requant);
+    EXPECT_EQ(0, session.run(shapes[i], input.data(), weights.data(), output.data(), failed));
+    for(j = 0; j < output.size(); j++)
+      ASSERT_EQ(golden_output[j], output[j]) << "shape " << i << " element " << j;
+
+    // Back to the fixed rescale
+    session.set_requant(no_requant);
+    golden_convolution(shapes[i], input.data(), weights.data(), golden_output.data());
+    EXPECT_EQ(0, session.run(shapes[i], input.data(), weights.data(), output.data(), failed));
+    EXPECT_EQ(0, memcmp(output.data(), golden_output.data(), output.size() * sizeof(data_in_t)));
+  }
+}
+
+TEST_F(RequantTest, Network)
+{
+  const conv_shape_t shape = {N / 2, M / 2, R, C, K};
+  std::vector<conv_layer_t> layers;
+
+  fill(shape);
+  golden_convolution(shape, input.data(), weights.data(), golden_output.data(), requant);
+
+  layers.push_back({shape, 0, weights.data(), no_epilogue, requant});
+  ConvNetwork network(layers);
+  network.init();
+  EXPECT_EQ(0, network.run(input.data(), output.data()));
+  EXPECT_EQ(0, memcmp(output.data(), golden_output.data(), output.size() * sizeof(data_in_t)));
+}
+#else
+TEST_F(RequantTest, Unsupported)
+{
+  ConvSession session;
+
+  fill(max_shape);
+  session.set_requant(no_requant);
+  EXPECT_EXIT(session.set_requant(requant), ::testing::ExitedWithCode(254), "REQUANT option");
+}
+#endif
@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+
+#include "fixtures.h"
+
+// Allocation counters from stubs
+extern "C" {
+extern unsigned int sds_alloc_count;
+extern unsigned int sds_free_count;
+}
+
+#define CALLS 2
+
+namespace
+{
+  typedef LayerFixture<> SessionTest;
+} // namespace
+
+TEST_F(SessionTest, GoldenComparison)
+{
+  ConvSession session;
+  int call, b, ito, ir, ic;
+
+  session.init();
+
+  // Buffers are reused: results must not depend on previous calls
+  for(call = 0; call < CALLS; call++)
+  {
+    fill_random(input, weights);
+    golden_convolution(input, weights, golden_output);
+
+    EXPECT_EQ(0, session.run(input, weights, output, failed));
+
+    for(b = 0; b < BATCHES; b++)
+      for(ito = 0; ito < M; ito++)
+        for(ir = 0; ir < R; ir++)
+          for(ic = 0; ic < C; ic++)
+            EXPECT_EQ(
+              output[b][ito][ir][ic],
+              golden_output[b][ito][ir][ic]
+            );
+  }
+}
+
+TEST_F(SessionTest, Lifecycle)
+{
+  ConvSession session;
+
+  EXPECT_FALSE(session.ready());
+  session.init();
+  EXPECT_TRUE(session.ready());
+  session.teardown();
+  EXPECT_FALSE(session.ready());
+  session.teardown(); // twice is fine
+}
+
+TEST_F(SessionTest, CallOverhead)
+{
+  ConvSession session;
+  perf_counter total, intern;
+  unsigned int allocs, frees, session_allocs;
+  int call;
+
+  // Allocations done by one session
+  allocs = sds_alloc_count;
+  session.init();
+  session_allocs = sds_alloc_count - allocs;
+  session.teardown();
+
+  // Without session: allocations on each call
+  allocs = sds_alloc_count;
+  frees = sds_free_count;
+  for(call = 0; call < CALLS; call++)
+  {
+    total.start();
+    convolution(input, weights, output, failed, true, &intern);
+    total.stop();
+  }
+  EXPECT_EQ(session_allocs * CALLS, sds_alloc_count - allocs);
+  EXPECT_EQ(session_allocs * CALLS, sds_free_count - frees);
+
+  std::cerr << "without session: host overhead per call "
+    << (total.tot - intern.tot) / CALLS << std::endl;
+
+  // With session: allocations only once
+  total.reset();
+  intern.reset();
+  allocs = sds_alloc_count;
+  frees = sds_free_count;
+  session.init();
+  for(call = 0; call < CALLS; call++)
+  {
+    total.start();
+    session.run(input, weights, output, failed, true, &intern);
+    total.stop();
+  }
+  session.teardown();
+  EXPECT_EQ(session_allocs, sds_alloc_count - allocs);
+  EXPECT_EQ(session_allocs, sds_free_count - frees);
+
+  std::cerr << "with session: host overhead per call "
+    << (total.tot - intern.tot) / CALLS << std::endl;
+}
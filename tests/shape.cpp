@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+#include <stdlib.h>
+
+#include "convolution.h"
+#include "io.h"
+#include "golden_convolution.h"
+
+namespace
+{
+  // Layer shapes, all fitting in the synthesized one
+  const conv_shape_t shapes[] = {
+    {N, M, R, C, K},
+    {1, 1, 1, 1, 1},
+    {MAX(1, N - 1), M, R, C, K},
+    {N, MAX(1, M - 1), MAX(1, R - 1), C, K},
+    {MIN(N, Tn + 1), MIN(M, Tm + 1), R, MAX(1, C / 2), K},
+    {N / 2 + 1, M / 3 + 1, MAX(1, R / 3), MAX(1, C - 1), MAX(1, K - 1)},
+    {N, M, 1, C, 1},
+    {MIN(N, Un), MIN(M, Um), R, 1, K},
+  };
+
+  class ShapeTest : public ::testing::TestWithParam<conv_shape_t>
+  {
+    protected:
+      data_in_t *input;
+      data_in_t *weights;
+      data_in_t *output;
+      data_in_t *golden_output;
+      bool failed[TILES];
+
+      virtual void SetUp()
+      {
+        const conv_shape_t &shape = GetParam();
+
+        input = new data_in_t[BATCHES * shape.n * shape.rr() * shape.cc()];
+        weights = new data_in_t[BATCHES * shape.n * shape.m * shape.k * shape.k];
+        output = new data_in_t[BATCHES * shape.m * shape.r * shape.c];
+        golden_output = new data_in_t[BATCHES * shape.m * shape.r * shape.c];
+
+        srand(42);
+        fill_random(shape, input, weights);
+      }
+
+      virtual void TearDown()
+      {
+        delete[] input;
+        delete[] weights;
+        delete[] output;
+        delete[] golden_output;
+      }
+  };
+} // namespace
+
+TEST_P(ShapeTest, GoldenComparison)
+{
+  const conv_shape_t &shape = GetParam();
+  int i;
+
+  ASSERT_TRUE(shape_fits(shape));
+  ASSERT_LE(shape.tiles(), TILES);
+
+  golden_convolution(shape, input, weights, golden_output);
+  EXPECT_EQ(0, convolution(shape, input, weights, output, failed));
+
+  for(i = 0; i < BATCHES * shape.m * shape.r * shape.c; i++)
+    EXPECT_EQ(output[i], golden_output[i]) << "at " << i;
+}
+
+TEST_P(ShapeTest, SessionReuse)
+{
+  const conv_shape_t &shape = GetParam();
+  ConvSession session;
+  int i;
+
+  // A session sized for the synthesized shape runs any smaller one, after
+  // a full-size call (stale buffer contents must not leak)
+  data_in_t (*full_input)[N][RR][CC] = new data_in_t[BATCHES][N][RR][CC];
+  data_in_t (*full_weights)[N][M][K][K] = new data_in_t[BATCHES][N][M][K][K];
+  data_in_t (*full_output)[M][R][C] = new data_in_t[BATCHES][M][R][C];
+
+  fill_random(full_input, full_weights);
+  session.init();
+  session.run(full_input, full_weights, full_output, failed);
+
+  golden_convolution(shape, input, weights, golden_output);
+  EXPECT_EQ(0, session.run(shape, input, weights, output, failed));
+
+  for(i = 0; i < BATCHES * shape.m * shape.r * shape.c; i++)
+    EXPECT_EQ(output[i], golden_output[i]) << "at " << i;
+
+  delete[] full_input;
+  delete[] full_weights;
+  delete[] full_output;
+}
+
+INSTANTIATE_TEST_CASE_P(Shapes, ShapeTest, ::testing::ValuesIn(shapes));
@@ -0,0 +1,76 @@
+#include <gtest/gtest.h>
+
+#include "conv_simd.h"
+#include "tensor.h"
+#include "fixtures.h"
+
+namespace
+{
+  class SimdTest : public LayerFixture<>
+  {
+    protected:
+      virtual void TearDown()
+      {
+        set_conv_backend(CONV_BACKEND_HARDWARE);
+      }
+  };
+} // namespace
+
+TEST_F(SimdTest, GoldenComparison)
+{
+  const conv_shape_t shapes[] = {
+    max_shape,
+    {1, 1, 1, 1, 1},
+    {MAX(1, N / 3), MIN(M, 13), MAX(1, R - 2), MAX(1, C - 1), MAX(1, K - 1)},
+  };
+  int i;
+
+  std::cerr << "simd: " << simd_isa() << std::endl;
+
+  for(const conv_shape_t &shape : shapes)
+  {
+    fill_random(shape, &input[0][0][0][0], &weights[0][0][0][0][0]);
+    golden_convolution(shape, &input[0][0][0][0], &weights[0][0][0][0][0], &golden_output[0][0][0][0]);
+
+    EXPECT_EQ(0, convolution_simd(shape, &input[0][0][0][0], &weights[0][0][0][0][0], &output[0][0][0][0], failed));
+
+    for(i = 0; i < BATCHES * shape.m * shape.r * shape.c; i++)
+      ASSERT_EQ((&golden_output[0][0][0][0])[i], (&output[0][0][0][0])[i]) << "at " << i;
+    for(i = 0; i < shape.tiles(); i++)
+      EXPECT_FALSE(failed[i]);
+  }
+}
+
+TEST_F(SimdTest, Overflow)
+{
+  // Largest magnitudes: accumulation wraps like data_out_t
+  const data_in_t extremes[] = {
+    data_in_t(-(1 << (data_in_t::width - 1))),
+    data_in_t((1 << (data_in_t::width - 1)) - 1),
+  };
+  int i;
+
+  for(i = 0; i < BATCHES * N * RR * CC; i++)
+    (&input[0][0][0][0])[i] = extremes[rand() % 4 == 0];
+  for(i = 0; i < BATCHES * N * M * K * K; i++)
+    (&weights[0][0][0][0][0])[i] = extremes[rand() % 4 == 0];
+
+  golden_convolution(input, weights, golden_output);
+  convolution_simd(input, weights, output, failed);
+
+  EXPECT_EQ(0, memcmp(output, golden_output, sizeof(output)));
+}
+
+TEST_F(SimdTest, Backend)
+{
+  Tensor hw_output(TENSOR_OUTPUT);
+
+  EXPECT_EQ(CONV_BACKEND_HARDWARE, get_conv_backend());
+  convolution(input, weights, hw_output.output(), failed);
+
+  set_conv_backend(CONV_BACKEND_SIMD);
+  EXPECT_EQ(CONV_BACKEND_SIMD, get_conv_backend());
+  EXPECT_EQ(0, convolution(input, weights, output, failed));
+
+  EXPECT_EQ(0, memcmp(output, hw_output.data(), sizeof(output)));
+}
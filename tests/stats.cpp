@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <sstream>
+#include <vector>
+
+#include "convolution.h"
+#include "conv_stats.h"
+#include "io.h"
+
+#define CALLS 2
+
+namespace
+{
+  class StatsTest : public ::testing::Test
+  {
+    protected:
+      data_in_t input[BATCHES][N][RR][CC];
+      data_in_t weights[BATCHES][N][M][K][K];
+      data_in_t output[BATCHES][M][R][C];
+      bool failed[TILES];
+
+      virtual void SetUp()
+      {
+        srand(42);
+        fill_random(input, weights);
+      }
+  };
+} // namespace
+
+TEST_F(StatsTest, Session)
+{
+  ConvSession session;
+  transfer_volume_t volume = transfer_volume();
+  int call;
+
+  session.init();
+  for(call = 0; call < CALLS; call++)
+    session.run(input, weights, output, failed);
+
+  // Counts are accumulated over calls
+  EXPECT_EQ((uint64_t) CALLS, session.stats.calls);
+  EXPECT_EQ((uint64_t) CALLS * TILES, session.stats.tiles);
+  EXPECT_EQ(0u, session.stats.failed);
+  EXPECT_EQ((uint64_t) CALLS * BATCHES * M * N * R * C * K * K, session.stats.macs);
+  EXPECT_EQ(CALLS * volume.packed, session.stats.packed);
+  EXPECT_EQ(CALLS * volume.total(), session.stats.transferred);
+
+  // Each phase is timed once per call (allocation once per session)
+  EXPECT_EQ(1u, session.stats.phase[PHASE_ALLOC].calls);
+  EXPECT_EQ((uint64_t) CALLS, session.stats.phase[PHASE_PACK].calls);
+  EXPECT_EQ((uint64_t) CALLS, session.stats.phase[PHASE_COMPUTE].calls);
+  EXPECT_EQ((uint64_t) CALLS, session.stats.phase[PHASE_GATHER].calls);
+  EXPECT_EQ((uint64_t) CALLS, session.stats.phase[PHASE_SCATTER].calls);
+  EXPECT_EQ(0u, session.stats.phase[PHASE_FREE].calls);
+  EXPECT_GT(session.stats.phase[PHASE_COMPUTE].tot, 0u);
+  EXPECT_GT(session.stats.gmacs(), 0.);
+  EXPECT_GE(session.stats.hw_gmacs(), session.stats.gmacs());
+
+  session.teardown();
+  EXPECT_EQ(1u, session.stats.phase[PHASE_FREE].calls);
+  session.teardown(); // nothing freed
+  EXPECT_EQ(1u, session.stats.phase[PHASE_FREE].calls);
+
+  session.stats.reset();
+  EXPECT_EQ(0u, session.stats.calls);
+  EXPECT_EQ(0u, session.stats.cycles());
+}
+
+TEST_F(StatsTest, Convolution)
+{
+  conv_stats_t stats;
+  const conv_shape_t shape = {Tn, Tm, Tr, Tc, K};
+  int call;
+
+  // One-shot sessions: allocation on each call
+  for(call = 0; call < CALLS; call++)
+    convolution(shape, &input[0][0][0][0], &weights[0][0][0][0][0],
+      &output[0][0][0][0], failed, true, NULL, NULL, &stats);
+
+  EXPECT_EQ((uint64_t) CALLS, stats.calls);
+  EXPECT_EQ((uint64_t) CALLS * shape.tiles(), stats.tiles);
+  EXPECT_EQ((uint64_t) CALLS, stats.phase[PHASE_ALLOC].calls);
+  EXPECT_EQ((uint64_t) CALLS, stats.phase[PHASE_FREE].calls);
+  EXPECT_EQ(CALLS * transfer_volume(Tn, Tm, Tr, Tc).total(), stats.transferred);
+
+  // Software backend: compute only, nothing transferred
+  stats.reset();
+  set_conv_backend(CONV_BACKEND_SIMD);
+  convolution(input, weights, output, failed, true, NULL, NULL, &stats);
+  set_conv_backend(CONV_BACKEND_HARDWARE);
+  EXPECT_EQ(1u, stats.calls);
+  EXPECT_EQ(1u, stats.phase[PHASE_COMPUTE].calls);
+  EXPECT_EQ(0u, stats.phase[PHASE_ALLOC].calls);
+  EXPECT_EQ(0u, stats.transferred);
+}
+
+#ifdef EPILOGUE
+TEST_F(StatsTest, Residual)
+{
+  ConvSession session;
+  std::vector<data_in_t> residual((size_t) BATCHES * M * R * C, data_in_t(1));
+  const conv_epilogue_t epilogue = {NULL, residual.data(), false, false};
+  transfer_volume_t with = transfer_volume(N, M, R, C, WEIGHTS_REUSE_DEFAULT, INPUT_ZERO_COPY_DEFAULT, true);
+
+  // Residual tiles are only transferred when the fused epilogue has one
+  session.init();
+  session.run(input, weights, output, failed);
+  EXPECT_EQ(transfer_volume().total(), session.stats.transferred);
+
+  session.stats.reset();
+  session.set_epilogue(epilogue);
+  session.run(input, weights, output, failed);
+  EXPECT_EQ(with.total(), session.stats.transferred);
+  EXPECT_EQ(with.packed, session.stats.packed);
+  EXPECT_EQ(transfer_volume().total() + (size_t) TILES * Tm * Tr * Tc * sizeof(data_in_t), with.total());
+}
+#endif
+
+TEST_F(StatsTest, Dump)
+{
+  ConvSession session;
+  std::ostringstream json, header, line;
+  int p, columns = 0;
+
+  session.init();
+  session.run(input, weights, output, failed);
+  session.teardown();
+
+  session.stats.print_json(json);
+  EXPECT_EQ('{', json.str().front());
+  EXPECT_EQ('}', json.str().back());
+  for(p = 0; p < PHASES; p++)
+    EXPECT_NE(std::string::npos, json.str().find(std::string("\"") + conv_phase_name(p) + "\": "));
+  EXPECT_NE(std::string::npos, json.str().find("\"tiles\": " + std::to_string(TILES)));
+
+  // As many columns in header and lines
+  conv_stats_t::print_csv_header(header);
+  session.stats.print_csv(line);
+  for(char ch : header.str())
+    columns += (ch == ',');
+  for(char ch : line.str())
+    columns -= (ch == ',');
+  EXPECT_EQ(0, columns);
+  EXPECT_EQ(0u, line.str().find("1," + std::to_string(TILES) + ",0,"));
+
+  std::cerr << header.str() << std::endl << line.str() << std::endl;
+}
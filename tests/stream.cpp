@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+
+#include "conv_stream.h"
+#include "fixtures.h"
+
+#define MAX_IMAGES 4
+
+namespace
+{
+  class StreamTest : public ImagesFixture<MAX_IMAGES>
+  {
+    protected:
+      bool failed[TILES];
+  };
+} // namespace
+
+TEST_F(StreamTest, GoldenComparison)
+{
+  ConvStream stream(MAX_IMAGES);
+  int image;
+
+  stream.init();
+
+  for(image = 0; image < MAX_IMAGES; image++)
+    stream.push(input[image], weights[image]);
+  EXPECT_TRUE(stream.full());
+  EXPECT_EQ(MAX_IMAGES, stream.pending());
+
+  stream.flush();
+  EXPECT_EQ(1, stream.hardware_calls());
+  EXPECT_EQ(0, stream.pending());
+  EXPECT_EQ(MAX_IMAGES, stream.available());
+
+  for(image = 0; image < MAX_IMAGES; image++)
+  {
+    EXPECT_EQ(0, stream.pop(output[image], failed));
+    expect_golden(image);
+  }
+  EXPECT_EQ(0, stream.available());
+}
+
+TEST_F(StreamTest, Throughput)
+{
+  ConvStream stream(MAX_IMAGES);
+  perf_counter intern;
+  int images, image, calls;
+#ifdef PROFILING
+  unsigned int bottleneck, first = 0;
+  int a;
+#endif
+
+  stream.init();
+
+  // One hardware call per flush, whatever the number of images
+  for(images = 1, calls = 1; images <= MAX_IMAGES; images *= 2, calls++)
+  {
+    intern.reset();
+
+    for(image = 0; image < images; image++)
+      stream.push(input[image], weights[image]);
+    stream.flush(&intern);
+    EXPECT_EQ(calls, stream.hardware_calls());
+
+    for(image = 0; image < images; image++)
+    {
+      EXPECT_EQ(0, stream.pop(output[image], failed));
+      expect_golden(image);
+    }
+
+#ifdef PROFILING
+    // Cycles of the slowest actor grow with the tiles computed, not more
+    bottleneck = 0;
+    for(a = 0; a < ACTORS; a++)
+      bottleneck = MAX(bottleneck, (unsigned int) stream.profile()[a].iterations);
+    if(images == 1)
+      first = bottleneck;
+    EXPECT_EQ(images * first, bottleneck);
+#endif
+
+    // Wall-clock time of C simulation is only printed
+    std::cerr << images << " image(s) per call: "
+      << 1e9 * images * TILES / intern.tot << " tiles/s" << std::endl;
+  }
+}
+
+TEST_F(StreamTest, Capacity)
+{
+  EXPECT_EXIT(ConvStream stream(STREAM_BATCHES / BATCHES + 1), ::testing::ExitedWithCode(254), "capacity");
+  EXPECT_EXIT(ConvStream stream(0), ::testing::ExitedWithCode(254), "capacity");
+}
@@ -2,32 +2,50 @@ extern "C" {
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <time.h>
+
+// Allocation counters, to check buffers reuse in tests
+unsigned int sds_alloc_count = 0;
+unsigned int sds_free_count = 0;
 
 void sds_wait(int unused)
 {}
 
+// Nanoseconds instead of CPU cycles, so perf_counter can be used in simulation
 uint64_t sds_clock_counter()
 {
-  return 0;
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000000ULL + uint64_t(ts.tv_nsec);
+}
+
+unsigned long long sds_clock_frequency()
+{
+  return 1000000000ULL;
 }
 
 void *sds_alloc(unsigned int size)
 {
+  sds_alloc_count++;
   return malloc(size);
 }
 
 void *sds_alloc_cacheable(unsigned int size)
 {
+  sds_alloc_count++;
   return malloc(size);
 }
 
 void *sds_alloc_non_cacheable(unsigned int size)
 {
+  sds_alloc_count++;
   return malloc(size);
 }
 
 void sds_free(void *memptr)
 {
+  sds_free_count++;
   free(memptr);
 }
 
@@ -0,0 +1,165 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <cstdio>
+
+#include "tensor.h"
+#include "io.h"
+#include "golden_convolution.h"
+
+#define INPUT_FILE "tensor_test_input.tnsr"
+#define WEIGHTS_FILE "tensor_test_weights.tnsr"
+#define OUTPUT_FILE "tensor_test_output.tnsr"
+#define IMAGES 3
+
+extern unsigned int sds_alloc_count;
+extern unsigned int sds_free_count;
+
+// Smaller than the synthesized shape: several tiles of each dimension
+const conv_shape_t layer = {N / 2 + 1, M / 2 + 1, R - 2, C - 1, K};
+
+TEST(TensorTest, Containers)
+{
+  unsigned int allocs = sds_alloc_count, frees = sds_free_count;
+  bool failed[TILES];
+
+  {
+    Tensor input(TENSOR_INPUT, layer), weights(TENSOR_WEIGHTS, layer, true);
+    Tensor output(TENSOR_OUTPUT, layer), golden(TENSOR_OUTPUT, layer);
+    size_t i;
+
+    // Aligned heap memory, or pinned
+    EXPECT_EQ(0u, (uintptr_t) input.data() % TENSOR_ALIGN);
+    EXPECT_EQ(allocs + 1, sds_alloc_count);
+    EXPECT_EQ(tensor_size(TENSOR_WEIGHTS, layer) * sizeof(data_in_t), weights.bytes());
+    EXPECT_TRUE(layer == output.shape());
+    for(i = 0; i < output.size(); i++)
+      ASSERT_EQ(0, output.data()[i]);
+
+    fill_random(layer, input.data(), weights.data(), 3, 0);
+    golden_convolution(layer, input.data(), weights.data(), golden.data());
+    EXPECT_EQ(0, convolution(input, weights, output, failed));
+    EXPECT_EQ(0, memcmp(output.data(), golden.data(), output.bytes()));
+  }
+  EXPECT_EQ(sds_alloc_count - allocs, sds_free_count - frees);
+
+  // Synthesized shape by default, viewed as arrays
+  Tensor input(TENSOR_INPUT), weights(TENSOR_WEIGHTS), output(TENSOR_OUTPUT);
+  EXPECT_EQ((void *) input.data(), (void *) input.input());
+  EXPECT_EQ((size_t) BATCHES * N * M * K * K, weights.size());
+  EXPECT_EQ((void *) &output.data()[(size_t) (BATCHES - 1) * M * R * C], (void *) output.output()[BATCHES - 1]);
+}
+
+TEST(TensorTest, RoundTrip)
+{
+  std::vector<data_in_t> input[IMAGES], weights(tensor_size(TENSOR_WEIGHTS, layer)), loaded;
+  int img;
+  size_t i;
+
+  unlink(INPUT_FILE);
+  {
+    TensorWriter writer(INPUT_FILE, TENSOR_INPUT, layer);
+    EXPECT_EQ(tensor_size(TENSOR_INPUT, layer), writer.size());
+
+    for(img = 0; img < IMAGES; img++)
+    {
+      input[img].resize(writer.size());
+      fill_random(layer, input[img].data(), weights.data(), 1, img);
+      writer.write(input[img].data());
+      EXPECT_EQ(img + 1, writer.images());
+    }
+  }
+
+  TensorReader reader(INPUT_FILE);
+  EXPECT_EQ(TENSOR_INPUT, reader.kind());
+  EXPECT_TRUE(layer == reader.shape());
+  ASSERT_EQ(IMAGES, reader.images());
+  ASSERT_EQ(input[0].size(), reader.size());
+
+  // Any order, full range of values (signed)
+  loaded.resize(reader.size());
+  for(img = IMAGES - 1; img >= 0; img--)
+  {
+    reader.read(img, loaded.data());
+    for(i = 0; i < loaded.size(); i++)
+      ASSERT_EQ(input[img][i], loaded[i]) << "image " << img << " element " << i;
+  }
+
+  unlink(INPUT_FILE);
+}
+
+TEST(TensorTest, Layer)
+{
+  std::vector<data_in_t> input(tensor_size(TENSOR_INPUT, layer));
+  std::vector<data_in_t> weights(tensor_size(TENSOR_WEIGHTS, layer));
+  std::vector<data_in_t> output(tensor_size(TENSOR_OUTPUT, layer)), golden(output.size());
+  bool failed[TILES];
+  ConvSession session;
+  size_t i;
+
+  fill_random(layer, input.data(), weights.data(), 2, 0);
+  {
+    TensorWriter input_writer(INPUT_FILE, TENSOR_INPUT, layer);
+    TensorWriter weights_writer(WEIGHTS_FILE, TENSOR_WEIGHTS, layer);
+    input_writer.write(input.data());
+    weights_writer.write(weights.data());
+  }
+
+  // Files loaded in the runtime-shape layout, outputs written back
+  TensorReader input_reader(INPUT_FILE), weights_reader(WEIGHTS_FILE);
+  std::fill(input.begin(), input.end(), 0);
+  std::fill(weights.begin(), weights.end(), 0);
+  input_reader.read(0, input.data());
+  weights_reader.read(0, weights.data());
+
+  session.init();
+  EXPECT_EQ(0, session.run(input_reader.shape(), input.data(), weights.data(), output.data(), failed));
+  session.teardown();
+  {
+    TensorWriter output_writer(OUTPUT_FILE, TENSOR_OUTPUT, layer);
+    output_writer.write(output.data());
+  }
+
+  golden_convolution(layer, input.data(), weights.data(), golden.data());
+  TensorReader output_reader(OUTPUT_FILE);
+  EXPECT_EQ(TENSOR_OUTPUT, output_reader.kind());
+  ASSERT_EQ(golden.size(), output_reader.size());
+  std::fill(output.begin(), output.end(), 0);
+  output_reader.read(0, output.data());
+  for(i = 0; i < golden.size(); i++)
+    ASSERT_EQ(golden[i], output[i]) << "element " << i;
+
+  unlink(INPUT_FILE);
+  unlink(WEIGHTS_FILE);
+  unlink(OUTPUT_FILE);
+}
+
+TEST(TensorTest, Rejected)
+{
+  conv_shape_t large = max_shape;
+  FILE *file;
+
+  // Not a tensor file
+  file = fopen(INPUT_FILE, "wb");
+  ASSERT_TRUE(file != NULL);
+  fputs("not a tensor file, but long enough for a header", file);
+  fclose(file);
+  EXPECT_EXIT(TensorReader reader(INPUT_FILE), ::testing::ExitedWithCode(2), "not a tensor file");
+
+  // Shape larger than the synthesized one
+  large.m++;
+  {
+    TensorWriter writer(INPUT_FILE, TENSOR_INPUT, large);
+  }
+  EXPECT_EXIT(TensorReader reader(INPUT_FILE), ::testing::ExitedWithCode(2), "does not fit");
+
+  // Truncated (header of one image, no data)
+  {
+    TensorWriter writer(INPUT_FILE, TENSOR_INPUT, layer);
+    std::vector<data_in_t> input(writer.size());
+    writer.write(input.data());
+  }
+  ASSERT_EQ(0, truncate(INPUT_FILE, 100));
+  EXPECT_EXIT(TensorReader reader(INPUT_FILE), ::testing::ExitedWithCode(2), "truncated");
+
+  unlink(INPUT_FILE);
+}